@@ -29,7 +29,21 @@ SOURCES +=  main.cpp\
             mappingdialog.cpp \
             qharmonicmap.cpp \
             qvideoslider.cpp \
-            qprocessingdialog.cpp
+            qprocessingdialog.cpp \
+            qframering.cpp \
+            qframepool.cpp \
+            qfacedetector.cpp \
+            qdetectionstage.cpp \
+            roikernels.cpp \
+            roispans.cpp \
+            skinlut.cpp \
+            roireduction.cpp \
+            yuvinput.cpp \
+            qharmonicpool.cpp \
+            qfacetracker.cpp \
+            patchfusion.cpp \
+            slidingdft.cpp \
+            fftplancache.cpp
 
 HEADERS  += mainwindow.h \
             qimagewidget.h \
@@ -43,7 +57,24 @@ HEADERS  += mainwindow.h \
             mappingdialog.h \
             qharmonicmap.h \
             qvideoslider.h \
-            qprocessingdialog.h
+            qprocessingdialog.h \
+            qframering.h \
+            qframepool.h \
+            qfacedetector.h \
+            qdetectionstage.h \
+            roikernels.h \
+            roispans.h \
+            skinlut.h \
+            roireduction.h \
+            yuvinput.h \
+            qmapframe.h \
+            qregionframe.h \
+            qharmonicpool.h \
+            qfacetracker.h \
+            patchfusion.h \
+            slidingstats.h \
+            slidingdft.h \
+            fftplancache.h
 
 FORMS += qsettingsdialog.ui \
          mappingdialog.ui \
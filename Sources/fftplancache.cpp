@@ -0,0 +1,88 @@
+/*------------------------------------------------------------------------------------------------------
+Taranov Alex, 2015									     SOURCE FILE
+FFTPlanCache keeps process-wide FFTW plans keyed by transform size, so every QHarmonicProcessor of the
+same buffer length shares one plan instead of building its own ones, a map of 32x32 cells makes a single
+plan at start instead of 4096. Plans are made by FFT_PLANNER_FLAGS on scratch arrays and are executed
+by fftw_execute_dft_r2c(...) on arrays of the caller, which must be allocated by fftw_malloc(...).
+Measured plans are slow to make, so FFTW wisdom is loaded from FFT_WISDOM_FILE before the first plan
+and saved after every new one, then the next run gets the same plans without measurements.
+FFTW planner is not thread safe, so plans are made under a mutex; execution of a plan is thread safe.
+------------------------------------------------------------------------------------------------------*/
+
+#include "fftplancache.h"
+
+//------------------------------------------------------------------------------------------------------
+
+QMutex FFTPlanCache::m_mutex;
+QHash<int, fftw_plan> FFTPlanCache::m_realPlans;
+QHash<QPair<int, int>, fftw_plan> FFTPlanCache::m_realBatchPlans;
+bool FFTPlanCache::m_wisdomLoaded = false;
+
+//------------------------------------------------------------------------------------------------------
+
+fftw_plan FFTPlanCache::getRealPlan(int length)
+{
+    QMutexLocker locker(&m_mutex);
+    fftw_plan plan = m_realPlans.value(length, NULL);
+    if(plan == NULL)
+    {
+        loadWisdom();
+        plan = makeRealPlan(length);
+        m_realPlans.insert(length, plan);
+        fftw_export_wisdom_to_filename(FFT_WISDOM_FILE);
+    }
+    return plan;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+fftw_plan FFTPlanCache::getRealBatchPlan(int length, int count)
+{
+    QMutexLocker locker(&m_mutex);
+    fftw_plan plan = m_realBatchPlans.value(qMakePair(length, count), NULL);
+    if(plan == NULL)
+    {
+        loadWisdom();
+        plan = makeRealBatchPlan(length, count);
+        m_realBatchPlans.insert(qMakePair(length, count), plan);
+        fftw_export_wisdom_to_filename(FFT_WISDOM_FILE);
+    }
+    return plan;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void FFTPlanCache::loadWisdom()
+{
+    if(!m_wisdomLoaded)
+    {
+        fftw_import_wisdom_from_filename(FFT_WISDOM_FILE); // it is fine if the file does not exist yet
+        m_wisdomLoaded = true;
+    }
+}
+
+//------------------------------------------------------------------------------------------------------
+
+fftw_plan FFTPlanCache::makeRealPlan(int length)
+{
+    // measurements overwrite arrays, so plan is made on scratch ones, fftw_malloc(...) gives them the same alignment the callers' arrays have
+    double *input = (double*) fftw_malloc(sizeof(double) * length);
+    fftw_complex *output = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * (length/2 + 1));
+    fftw_plan plan = fftw_plan_dft_r2c_1d(length, input, output, FFT_PLANNER_FLAGS);
+    fftw_free(input);
+    fftw_free(output);
+    return plan;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+fftw_plan FFTPlanCache::makeRealBatchPlan(int length, int count)
+{
+    double *input = (double*) fftw_malloc(sizeof(double) * length * count);
+    fftw_complex *output = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * (length/2 + 1) * count);
+    // bin k of transform i goes to output[k*count + i], so a bin of all transforms is contiguous
+    fftw_plan plan = fftw_plan_many_dft_r2c(1, &length, count, input, NULL, 1, length, output, NULL, count, 1, FFT_PLANNER_FLAGS);
+    fftw_free(input);
+    fftw_free(output);
+    return plan;
+}
@@ -0,0 +1,44 @@
+/*------------------------------------------------------------------------------------------------------
+Taranov Alex, 2015									     HEADER FILE
+FFTPlanCache keeps process-wide FFTW plans keyed by transform size, so every QHarmonicProcessor of the
+same buffer length shares one plan instead of building its own ones, a map of 32x32 cells makes a single
+plan at start instead of 4096. Plans are made by FFT_PLANNER_FLAGS on scratch arrays and are executed
+by fftw_execute_dft_r2c(...) on arrays of the caller, which must be allocated by fftw_malloc(...).
+Measured plans are slow to make, so FFTW wisdom is loaded from FFT_WISDOM_FILE before the first plan
+and saved after every new one, then the next run gets the same plans without measurements.
+FFTW planner is not thread safe, so plans are made under a mutex; execution of a plan is thread safe.
+------------------------------------------------------------------------------------------------------*/
+
+#ifndef FFTPLANCACHE_H
+#define FFTPLANCACHE_H
+//------------------------------------------------------------------------------------------------------
+
+#include <QHash>
+#include <QPair>
+#include <QMutex>
+#include "fftw3.h"
+
+#define FFT_PLANNER_FLAGS FFTW_MEASURE // FFTW_PATIENT could be used as well, it is paid once while the wisdom file exists
+#define FFT_WISDOM_FILE "fftw.wisdom"
+
+//------------------------------------------------------------------------------------------------------
+
+class FFTPlanCache
+{
+public:
+    static fftw_plan getRealPlan(int length); // real to complex forward plan of length counts, output has (length/2 + 1) bins
+    static fftw_plan getRealBatchPlan(int length, int count); // count transforms at once, input is count rows of length counts, output is (length/2 + 1) rows of count bins, bin-major
+
+private:
+    static QMutex m_mutex;
+    static QHash<int, fftw_plan> m_realPlans; // plans live until the process ends
+    static QHash<QPair<int, int>, fftw_plan> m_realBatchPlans;
+    static bool m_wisdomLoaded;
+
+    static void loadWisdom();
+    static fftw_plan makeRealPlan(int length);
+    static fftw_plan makeRealBatchPlan(int length, int count);
+};
+
+//------------------------------------------------------------------------------------------------------
+#endif // FFTPLANCACHE_H
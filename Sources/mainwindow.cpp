@@ -57,6 +57,8 @@ MainWindow::MainWindow(QWidget *parent):
     //--------------------------------------------------------------
     m_dialogSetCounter = 0;
     m_sessionsCounter = 0;
+    m_offlineFlag = false;
+    m_pipelineFlag = false;
     pt_videoSlider = NULL;
 
     //--------------------------------------------------------------
@@ -155,10 +157,53 @@ void MainWindow::createActions()
     connect(pt_experimentalAct,SIGNAL(triggered()), pt_colorMapper, SLOT(map()));
     pt_greenAct->setChecked(true);
 
+    pt_detectionActGroup = new QActionGroup(this);
+    pt_detectionMapper = new QSignalMapper(this);
+    const int detectionPeriods[] = {1, 2, 4, 8};
+    for(quint8 i = 0; i < sizeof(detectionPeriods)/sizeof(int); i++)
+    {
+        QAction *pt_act = new QAction(detectionPeriods[i] == 1 ? tr("Every frame") : tr("Every %1 frames").arg(detectionPeriods[i]), pt_detectionActGroup);
+        pt_act->setStatusTip(tr("Run face detection this often, face is tracked by template on the rest of frames"));
+        pt_act->setCheckable(true);
+        pt_act->setChecked(detectionPeriods[i] == DEFAULT_DETECTION_PERIOD);
+        pt_detectionMapper->setMapping(pt_act, detectionPeriods[i]);
+        connect(pt_act, SIGNAL(triggered()), pt_detectionMapper, SLOT(map()));
+    }
+
+    pt_downscaleActGroup = new QActionGroup(this);
+    pt_downscaleMapper = new QSignalMapper(this);
+    const int downscales[] = {1, 2, 4};
+    for(quint8 i = 0; i < sizeof(downscales)/sizeof(int); i++)
+    {
+        QAction *pt_act = new QAction(downscales[i] == 1 ? tr("Full resolution") : tr("1/%1 resolution").arg(downscales[i]), pt_downscaleActGroup);
+        pt_act->setStatusTip(tr("Resolution of the image where faces are detected"));
+        pt_act->setCheckable(true);
+        pt_act->setChecked(downscales[i] == qRound(1.0 / DEFAULT_DETECTION_SCALE));
+        pt_downscaleMapper->setMapping(pt_act, downscales[i]);
+        connect(pt_act, SIGNAL(triggered()), pt_downscaleMapper, SLOT(map()));
+    }
+
+    pt_patchActGroup = new QActionGroup(this);
+    pt_patchMapper = new QSignalMapper(this);
+    const int patches[] = {1, 2, 4, 6, 9};
+    for(quint8 i = 0; i < sizeof(patches)/sizeof(int); i++)
+    {
+        QAction *pt_act = new QAction(patches[i] == 1 ? tr("Whole face") : tr("%1 patches").arg(patches[i]), pt_patchActGroup);
+        pt_act->setStatusTip(tr("Split face into patches, their signals are mixed by signal-to-noise ratio"));
+        pt_act->setCheckable(true);
+        pt_act->setChecked(patches[i] == 1);
+        pt_patchMapper->setMapping(pt_act, patches[i]);
+        connect(pt_act, SIGNAL(triggered()), pt_patchMapper, SLOT(map()));
+    }
+
     pt_pcaAct = new QAction(tr("PCA align"), this);
     pt_pcaAct->setStatusTip(tr("Control PCA alignment, affects on result only in harmonic analysis mode"));
     pt_pcaAct->setCheckable(true);
 
+    pt_sdftAct = new QAction(tr("Sliding &DFT"), this);
+    pt_sdftAct->setStatusTip(tr("Update heart and breath bands of spectrum on each count instead of FFT of the whole buffer, does not affect PCA alignment"));
+    pt_sdftAct->setCheckable(true);
+
     pt_mapAct = new QAction(tr("Mapping"), this);
     pt_mapAct->setStatusTip(tr("Map clarity of a pulse signal on image"));
     pt_mapAct->setCheckable(true);
@@ -173,6 +218,11 @@ void MainWindow::createActions()
     pt_skinAct->setCheckable(true);
     pt_skinAct->setChecked(true);
 
+    pt_lowResMaskAct = new QAction(tr("Low-res skin &mask"), this);
+    pt_lowResMaskAct->setStatusTip(tr("Test skin on the downscaled region instead of the blurred one, colors are summed without blur"));
+    pt_lowResMaskAct->setCheckable(true);
+    pt_lowResMaskAct->setChecked(false);
+
     pt_adjustAct = new QAction(tr("&Timing"), this);
     pt_adjustAct->setStatusTip(tr("Allows to adjust time between frequency evaluations & data normalization interval"));
     connect(pt_adjustAct, SIGNAL(triggered()), this, SLOT(openProcessingDialog()));
@@ -188,6 +238,14 @@ void MainWindow::createActions()
     pt_calibAct->setCheckable(true);
     pt_calibAct->setChecked(false);
 
+    pt_openSkinModelAct = new QAction(tr("&Load skin model"), this);
+    pt_openSkinModelAct->setStatusTip(tr("Load skin color model from file, it replaces the rule-based skin test"));
+    connect(pt_openSkinModelAct, SIGNAL(triggered()), this, SLOT(openSkinModel()));
+
+    pt_saveSkinModelAct = new QAction(tr("&Save skin model"), this);
+    pt_saveSkinModelAct->setStatusTip(tr("Save skin color model of the last calibration to file"));
+    connect(pt_saveSkinModelAct, SIGNAL(triggered()), this, SLOT(saveSkinModel()));
+
     pt_measRecAct = new QAction(tr("&Measurements"), this);
     pt_measRecAct->setStatusTip(tr("Start to record heart rate & breath rate in to output text file"));
     pt_measRecAct->setCheckable(true);
@@ -202,6 +260,35 @@ void MainWindow::createActions()
     pt_fillAct->setStatusTip(tr("Toggles color filling of the analyzed object"));
     pt_fillAct->setCheckable(true);
     pt_fillAct->setChecked(true);
+
+    pt_grabAct = new QAction(tr("&Grab thread"), this);
+    pt_grabAct->setStatusTip(tr("Grab frames by dedicated thread as fast as device delivers them, takes effect on new session"));
+    pt_grabAct->setCheckable(true);
+    pt_grabAct->setChecked(false);
+
+    pt_offlineAct = new QAction(tr("&Offline"), this);
+    pt_offlineAct->setStatusTip(tr("Process video file as fast as possible, measurements are evaluated in media time, takes effect on new session"));
+    pt_offlineAct->setCheckable(true);
+    pt_offlineAct->setChecked(false);
+
+    pt_pipelineAct = new QAction(tr("&Pipeline"), this);
+    pt_pipelineAct->setStatusTip(tr("Run face detection, processing and display on separate threads, works with grab thread, takes effect on new session"));
+    pt_pipelineAct->setCheckable(true);
+    pt_pipelineAct->setChecked(false);
+
+    pt_rawAct = new QAction(tr("&Raw YUV input"), this);
+    pt_rawAct->setStatusTip(tr("Take YUYV or NV12 frames from device without conversion, frames are converted only for display, takes effect on new session"));
+    pt_rawAct->setCheckable(true);
+    pt_rawAct->setChecked(false);
+
+    pt_regionsAct = new QAction(tr("Multiple &regions"), this);
+    pt_regionsAct->setStatusTip(tr("Every selected rectangle or lasso adds a region with its own heart rate, with cascade every face is measured, takes effect on new session"));
+    pt_regionsAct->setCheckable(true);
+    pt_regionsAct->setChecked(false);
+
+    pt_clearRegionsAct = new QAction(tr("&Clear regions"), this);
+    pt_clearRegionsAct->setStatusTip(tr("Remove all regions of multiple regions mode"));
+    connect(pt_clearRegionsAct, SIGNAL(triggered()), this, SLOT(clearRegions()));
 }
 
 //------------------------------------------------------------------------------------
@@ -210,6 +297,7 @@ void MainWindow::createMenus()
 {
     pt_fileMenu = this->menuBar()->addMenu(tr("&Session"));
     pt_fileMenu->addAction(pt_openSessionAct);
+    pt_fileMenu->addAction(pt_offlineAct);
     pt_fileMenu->addSeparator();
     pt_fileMenu->addAction(pt_exitAct);
 
@@ -222,11 +310,24 @@ void MainWindow::createMenus()
     pt_colormodeMenu->addActions(pt_colorActGroup->actions());
     pt_modeMenu = pt_optionsMenu->addMenu(tr("&Mode"));
     pt_modeMenu->addAction(pt_pcaAct);
+    pt_modeMenu->addAction(pt_sdftAct);
     pt_modeMenu->addSeparator();
     pt_modeMenu->addAction(pt_skinAct);
+    pt_modeMenu->addAction(pt_lowResMaskAct);
     pt_modeMenu->addAction(pt_calibAct);
+    pt_modeMenu->addAction(pt_openSkinModelAct);
+    pt_modeMenu->addAction(pt_saveSkinModelAct);
     pt_modeMenu->addSeparator();
     pt_modeMenu->addAction(pt_prunAct);
+    pt_modeMenu->addSeparator();
+    pt_modeMenu->addAction(pt_regionsAct);
+    pt_modeMenu->addAction(pt_clearRegionsAct);
+    pt_detectionMenu = pt_optionsMenu->addMenu(tr("&Detection"));
+    pt_detectionMenu->addActions(pt_detectionActGroup->actions());
+    pt_detectionMenu->addSeparator();
+    pt_detectionMenu->addActions(pt_downscaleActGroup->actions());
+    pt_detectionMenu->addSeparator();
+    pt_detectionMenu->addActions(pt_patchActGroup->actions());
     pt_optionsMenu->setEnabled(false);
 
     pt_RecordsMenu = this->menuBar()->addMenu(tr("&Records"));
@@ -244,6 +345,9 @@ void MainWindow::createMenus()
     pt_deviceMenu = menuBar()->addMenu(tr("&Device"));
     pt_deviceMenu->addAction(pt_deviceSetAct);
     pt_deviceMenu->addAction(pt_deviceResAct);
+    pt_deviceMenu->addAction(pt_grabAct);
+    pt_deviceMenu->addAction(pt_pipelineAct);
+    pt_deviceMenu->addAction(pt_rawAct);
     pt_deviceMenu->addSeparator();
     pt_deviceMenu->addAction(pt_DirectShowAct);
 
@@ -263,6 +367,7 @@ void MainWindow::createThreads()
     pt_opencvProcessor->moveToThread( pt_improcThread );
     connect(pt_improcThread, SIGNAL(finished()), pt_opencvProcessor, SLOT(deleteLater()));
     connect(pt_skinAct, SIGNAL(triggered(bool)), pt_opencvProcessor, SLOT(setSkinSearchingFlag(bool)));
+    connect(pt_lowResMaskAct, SIGNAL(triggered(bool)), pt_opencvProcessor, SLOT(setLowResMaskFlag(bool)));
     connect(pt_calibAct, SIGNAL(triggered(bool)), pt_opencvProcessor, SLOT(calibrate(bool)));
     //---------------------------------------------------------------
 
@@ -270,6 +375,8 @@ void MainWindow::createThreads()
     pt_harmonicThread = NULL;
     pt_map = NULL;
     pt_mapThread = NULL;
+    pt_regionPool = NULL;
+    pt_regionThread = NULL;
 
     //--------------------QVideoCapture------------------------------
     pt_videoThread = new QThread(this);
@@ -282,10 +389,20 @@ void MainWindow::createThreads()
     //----------Register openCV types in Qt meta-type system---------
     qRegisterMetaType<cv::Mat>("cv::Mat");
     qRegisterMetaType<cv::Rect>("cv::Rect");
+    qRegisterMetaType<std::string>("std::string");
+    qRegisterMetaType<std::vector<cv::Point> >("std::vector<cv::Point>");
+    qRegisterMetaType<const QMapFrame*>("const QMapFrame*");
+    qRegisterMetaType<const QRegionFrame*>("const QRegionFrame*");
+
+    //--------------------QDetectionStage----------------------------
+    pt_detectThread = new QThread(this);
+    pt_detectionStage = new QDetectionStage();
+    pt_detectionStage->moveToThread(pt_detectThread);
+    connect(pt_detectThread, SIGNAL(finished()), pt_detectionStage, SLOT(deleteLater()));
 
     //----------------------Connections------------------------------
-    connect(pt_opencvProcessor, SIGNAL(frameProcessed(cv::Mat,double,quint32)), pt_display, SLOT(updateImage(cv::Mat,double,quint32)), Qt::BlockingQueuedConnection);
     connect(pt_display, SIGNAL(rect_was_entered(cv::Rect)), pt_opencvProcessor, SLOT(setRect(cv::Rect)));
+    connect(pt_display, SIGNAL(polygon_was_entered(std::vector<cv::Point>)), pt_opencvProcessor, SLOT(setPolygon(std::vector<cv::Point>)));
     connect(pt_opencvProcessor, SIGNAL(selectRegion(const char*)), pt_display, SLOT(set_warning_status(const char*)));
     connect(pt_opencvProcessor, SIGNAL(mapRegionUpdated(cv::Rect)), pt_display, SLOT(updadeMapRegion(cv::Rect)));
     connect(this, &MainWindow::pauseVideo, pt_videoCapture, &QVideoCapture::pause);
@@ -293,13 +410,105 @@ void MainWindow::createThreads()
     connect(this, &MainWindow::closeVideo, pt_videoCapture, &QVideoCapture::close);
     connect(this, &MainWindow::updateTimer, pt_opencvProcessor, &QOpencvProcessor::updateTime);
     connect(pt_fillAct, SIGNAL(triggered(bool)), pt_opencvProcessor, SLOT(setFillFlag(bool)));
+    connect(pt_display, SIGNAL(imageUpdated()), pt_opencvProcessor, SLOT(frameDisplayed()), Qt::DirectConnection); // only an atomic flag is touched
+    pt_detectionStage->setFrameRing(pt_videoCapture->getFrameRing(), pt_videoCapture->getFramePool());
+    connect(pt_detectionStage, SIGNAL(framesAvailable()), pt_opencvProcessor, SLOT(drainFrameRing()), Qt::QueuedConnection);
+    connect(pt_detectionMapper, SIGNAL(mapped(int)), pt_opencvProcessor, SLOT(setDetectionPeriod(int)));
+    connect(pt_detectionMapper, SIGNAL(mapped(int)), pt_detectionStage, SLOT(setDetectionPeriod(int)));
+    connect(pt_downscaleMapper, SIGNAL(mapped(int)), pt_opencvProcessor, SLOT(setDetectionDownscale(int)));
+    connect(pt_downscaleMapper, SIGNAL(mapped(int)), pt_detectionStage, SLOT(setDetectionDownscale(int)));
+    connect(pt_patchMapper, SIGNAL(mapped(int)), pt_opencvProcessor, SLOT(setPatchCount(int)));
+    connect(pt_videoCapture, SIGNAL(pixelFormatChanged(int)), pt_opencvProcessor, SLOT(setPixelFormat(int))); // queued before the first frame of the session
+    connect(pt_videoCapture, SIGNAL(pixelFormatChanged(int)), pt_detectionStage, SLOT(setPixelFormat(int)));
+    connect(pt_videoCapture, SIGNAL(grabbingStopped()), pt_detectionStage, SLOT(flushFrameRing())); // queued after pending drainFrameRing() calls
+    connect(pt_imageAct, SIGNAL(triggered(bool)), pt_opencvProcessor, SLOT(setDisplayImageFlag(bool)));
+    setupPipeline(false);
     //----------------------Thread start-----------------------------
     pt_improcThread->start(QThread::HighPriority);
+    pt_detectThread->start(QThread::HighPriority);
     pt_videoThread->start(QThread::LowPriority);
 }
 
 //------------------------------------------------------------------------------------
 
+void MainWindow::connectFrameSource(const char *processSlot)
+{
+    if(pt_videoCapture->getGrabThreadMode())
+        connect(pt_opencvProcessor, SIGNAL(frameDequeued(cv::Mat,double,cv::Rect)), pt_opencvProcessor, processSlot, Qt::DirectConnection); // frames are popped from ring in pt_improcThread
+    else
+        connect(pt_videoCapture, SIGNAL(frame_was_captured(cv::Mat,double)), pt_opencvProcessor, processSlot, Qt::BlockingQueuedConnection);
+}
+
+//------------------------------------------------------------------------------------
+
+void MainWindow::disconnectFrameSource(const char *processSlot)
+{
+    disconnect(pt_opencvProcessor, SIGNAL(frameDequeued(cv::Mat,double,cv::Rect)), pt_opencvProcessor, processSlot);
+    disconnect(pt_videoCapture, SIGNAL(frame_was_captured(cv::Mat,double)), pt_opencvProcessor, processSlot);
+}
+
+//------------------------------------------------------------------------------------
+
+void MainWindow::setupPipeline(bool value)
+{
+    disconnect(pt_videoCapture, SIGNAL(framesAvailable()), pt_opencvProcessor, SLOT(drainFrameRing()));
+    disconnect(pt_videoCapture, SIGNAL(framesAvailable()), pt_detectionStage, SLOT(drainFrameRing()));
+    disconnect(pt_opencvProcessor, SIGNAL(frameProcessed(cv::Mat,double,quint32)), pt_display, SLOT(updateImage(cv::Mat,double,quint32)));
+    m_pipelineFlag = value;
+    if(m_pipelineFlag)
+    {
+        // capture ring -> detection stage -> detection ring -> processor, frames keep their order and timestamps
+        pt_opencvProcessor->setFrameRing(pt_detectionStage->getOutputRing(), pt_videoCapture->getFramePool());
+        connect(pt_videoCapture, SIGNAL(framesAvailable()), pt_detectionStage, SLOT(drainFrameRing()), Qt::QueuedConnection);
+        connect(pt_opencvProcessor, SIGNAL(frameProcessed(cv::Mat,double,quint32)), pt_display, SLOT(updateImage(cv::Mat,double,quint32)), Qt::QueuedConnection);
+    }
+    else
+    {
+        pt_opencvProcessor->setFrameRing(pt_videoCapture->getFrameRing(), pt_videoCapture->getFramePool());
+        connect(pt_videoCapture, SIGNAL(framesAvailable()), pt_opencvProcessor, SLOT(drainFrameRing()), Qt::QueuedConnection);
+        connect(pt_opencvProcessor, SIGNAL(frameProcessed(cv::Mat,double,quint32)), pt_display, SLOT(updateImage(cv::Mat,double,quint32)), Qt::BlockingQueuedConnection);
+    }
+    pt_opencvProcessor->setAsyncDisplay(m_pipelineFlag);
+}
+
+//------------------------------------------------------------------------------------
+
+void MainWindow::createRegionPool()
+{
+    pt_regionThread = new QThread(this);
+    pt_regionPool = new QHarmonicProcessorPool(NULL, m_settingsDialog.get_datalength(), m_settingsDialog.get_datalength());
+    pt_regionPool->moveToThread(pt_regionThread);
+    connect(pt_opencvProcessor, SIGNAL(regionsProcessed(const QRegionFrame*)), pt_regionPool, SLOT(updateHarmonicProcessors(const QRegionFrame*)), Qt::BlockingQueuedConnection);
+    connect(pt_regionPool, SIGNAL(heartRateUpdated(quint32,qreal,qreal,bool)), pt_display, SLOT(updateRegionValues(quint32,qreal,qreal,bool)));
+    connect(pt_regionPool, SIGNAL(processorRemoved(quint32)), pt_display, SLOT(removeRegionValues(quint32)));
+    connect(pt_pcaAct, SIGNAL(triggered(bool)), pt_regionPool, SLOT(setPCAMode(bool)));
+    connect(pt_sdftAct, SIGNAL(triggered(bool)), pt_regionPool, SLOT(setSlidingDFT(bool)));
+    connect(pt_colorMapper, SIGNAL(mapped(int)), pt_regionPool, SLOT(switchColorMode(int)));
+    connect(pt_regionThread, SIGNAL(finished()), pt_regionThread, SLOT(deleteLater()));
+    connectClock(pt_regionPool, SIGNAL(updateRates()));
+    pt_regionThread->start(QThread::HighPriority);
+}
+
+//------------------------------------------------------------------------------------
+
+void MainWindow::connectClock(const QObject *receiver, const char *method)
+{
+    if(m_offlineFlag)
+        connect(pt_opencvProcessor, SIGNAL(mediaClockTick()), receiver, method);
+    else
+        connect(&m_timer, SIGNAL(timeout()), receiver, method);
+}
+
+//------------------------------------------------------------------------------------
+
+void MainWindow::disconnectClock(const QObject *receiver, const char *method)
+{
+    disconnect(&m_timer, SIGNAL(timeout()), receiver, method);
+    disconnect(pt_opencvProcessor, SIGNAL(mediaClockTick()), receiver, method);
+}
+
+//------------------------------------------------------------------------------------
+
 void MainWindow::contextMenuEvent(QContextMenuEvent *event)
 {
     QMenu menu(this);
@@ -438,6 +647,9 @@ MainWindow::~MainWindow()
     pt_videoThread->quit();
     pt_videoThread->wait();
 
+    pt_detectThread->quit();
+    pt_detectThread->wait();
+
     pt_improcThread->quit();
     pt_improcThread->wait();
 
@@ -447,6 +659,13 @@ MainWindow::~MainWindow()
         pt_mapThread->wait();
     }
 
+    if(pt_regionPool)
+    {
+        pt_regionThread->quit();
+        pt_regionThread->wait();
+        delete pt_regionPool;
+    }
+
     if(pt_harmonicThread)
     {
         pt_harmonicThread->quit();
@@ -546,8 +765,32 @@ void MainWindow::configure_and_start_session()
             }
         }
         //---------------------------------------------------------------
-        disconnect(pt_videoCapture,SIGNAL(frame_was_captured(cv::Mat)), pt_opencvProcessor, SLOT(faceProcess(cv::Mat)));
-        disconnect(pt_videoCapture,SIGNAL(frame_was_captured(cv::Mat)), pt_opencvProcessor, SLOT(rectProcess(cv::Mat)));
+        disconnectFrameSource(SLOT(faceProcess(cv::Mat,double)));
+        disconnectFrameSource(SLOT(faceRegionProcess(cv::Mat,double,cv::Rect)));
+        disconnectFrameSource(SLOT(rectProcess(cv::Mat,double)));
+        disconnectFrameSource(SLOT(mapProcess(cv::Mat,double)));
+        disconnectFrameSource(SLOT(regionsProcess(cv::Mat,double)));
+        disconnectFrameSource(SLOT(facesProcess(cv::Mat,double)));
+        disconnect(pt_display, SIGNAL(rect_was_completed(cv::Rect)), pt_opencvProcessor, SLOT(addRegion(cv::Rect)));
+        disconnect(pt_display, SIGNAL(polygon_was_entered(std::vector<cv::Point>)), pt_opencvProcessor, SLOT(addPolygonRegion(std::vector<cv::Point>)));
+        if(pt_regionPool)
+        {
+            disconnectClock(pt_regionPool, SIGNAL(updateRates()));
+            pt_regionThread->quit();
+            pt_regionThread->wait();
+            delete pt_regionPool;
+            pt_regionPool = NULL;
+            pt_display->clearRegionValues();
+        }
+        pt_videoCapture->setGrabThreadMode(pt_grabAct->isChecked() && !m_settingsDialog.get_flagVideoFile()); // video files are always read by timer
+        pt_videoCapture->setRawMode(pt_rawAct->isChecked());
+        setupPipeline(pt_pipelineAct->isChecked() && pt_videoCapture->getGrabThreadMode() && m_settingsDialog.get_flagCascade() && !pt_regionsAct->isChecked());
+        if(pt_map)
+        {
+            disconnectClock(pt_map, SIGNAL(updateMap()));
+        }
+        m_offlineFlag = m_settingsDialog.get_flagVideoFile() && pt_offlineAct->isChecked();
+        pt_videoCapture->setOfflineMode(m_offlineFlag);
         if(m_settingsDialog.get_flagCascade())
         {
             QString filename = m_settingsDialog.get_stringCascade();
@@ -567,24 +810,50 @@ void MainWindow::configure_and_start_session()
                     break;
                 }
             }
-            connect(pt_videoCapture, SIGNAL(frame_was_captured(cv::Mat)), pt_opencvProcessor, SLOT(faceProcess(cv::Mat)), Qt::BlockingQueuedConnection);
+            if(pt_regionsAct->isChecked()) // every face gets its own processor, detection is made inline
+            {
+                createRegionPool();
+                connectFrameSource(SLOT(facesProcess(cv::Mat,double)));
+            }
+            else if(m_pipelineFlag)
+            {
+                QMetaObject::invokeMethod(pt_detectionStage, "loadClassifier", Qt::QueuedConnection, Q_ARG(std::string, filename.toStdString())); // detector belongs to pt_detectThread
+                connectFrameSource(SLOT(faceRegionProcess(cv::Mat,double,cv::Rect)));
+            }
+            else
+            {
+                connectFrameSource(SLOT(faceProcess(cv::Mat,double)));
+            }
+        }
+        else if(pt_regionsAct->isChecked())
+        {
+            createRegionPool();
+            connect(pt_display, SIGNAL(rect_was_completed(cv::Rect)), pt_opencvProcessor, SLOT(addRegion(cv::Rect)));
+            connect(pt_display, SIGNAL(polygon_was_entered(std::vector<cv::Point>)), pt_opencvProcessor, SLOT(addPolygonRegion(std::vector<cv::Point>)));
+            connectFrameSource(SLOT(regionsProcess(cv::Mat,double)));
         }
         else
         {
-            connect(pt_videoCapture, SIGNAL(frame_was_captured(cv::Mat)), pt_opencvProcessor, SLOT(rectProcess(cv::Mat)), Qt::BlockingQueuedConnection);
+            connectFrameSource(SLOT(rectProcess(cv::Mat,double)));
+        }
+        if(pt_map)
+        {
+            connectFrameSource(SLOT(mapProcess(cv::Mat,double))); // frames source could be changed, map should follow it
+            connectClock(pt_map, SIGNAL(updateMap()));
         }
         //--------------------------------------------------------------      
         if(m_settingsDialog.get_FFTflag())
         {
-            connect(&m_timer, SIGNAL(timeout()), pt_harmonicProcessor, SLOT(computeHeartRate()));
+            connectClock(pt_harmonicProcessor, SLOT(computeHeartRate()));
         }
         else
         {
-            connect(&m_timer, SIGNAL(timeout()), pt_harmonicProcessor, SLOT(CountFrequency()));
+            connectClock(pt_harmonicProcessor, SLOT(CountFrequency()));
         }
-        connect(&m_timer, SIGNAL(timeout()), pt_harmonicProcessor, SLOT(computeBreathRate()));
+        connectClock(pt_harmonicProcessor, SLOT(computeBreathRate()));
+        QMetaObject::invokeMethod(pt_opencvProcessor, "setMediaClockInterval", Qt::QueuedConnection, Q_ARG(int, m_offlineFlag ? m_settingsDialog.get_timerValue() : 0)); // before the first frame of the session
 
-        connect(pt_opencvProcessor, SIGNAL(dataCollected(ulong,ulong,ulong,ulong,double)), pt_harmonicProcessor, SLOT(EnrollData(ulong,ulong,ulong,ulong,double)));
+        connect(pt_opencvProcessor, SIGNAL(dataCollected(quint64,quint64,quint64,quint64,double)), pt_harmonicProcessor, SLOT(EnrollData(quint64,quint64,quint64,quint64,double)));
         connect(pt_harmonicProcessor, SIGNAL(heartTooNoisy(qreal)), pt_display, SLOT(clearFrequencyString(qreal)));
         connect(pt_harmonicProcessor, SIGNAL(heartRateUpdated(qreal,qreal,bool)), pt_display, SLOT(updateValues(qreal,qreal,bool)));
         connect(pt_harmonicProcessor, SIGNAL(breathRateUpdated(qreal,qreal)), pt_display, SLOT(updateBreathStrings(qreal,qreal)));
@@ -592,6 +861,7 @@ void MainWindow::configure_and_start_session()
         connect(pt_harmonicProcessor, SIGNAL(spO2Updated(qreal)), pt_display, SLOT(updateSPO2(qreal)));
         connect(pt_colorMapper, SIGNAL(mapped(int)), pt_harmonicProcessor, SLOT(switchColorMode(int)));
         connect(pt_pcaAct, SIGNAL(triggered(bool)), pt_harmonicProcessor, SLOT(setPCAMode(bool)));
+        connect(pt_sdftAct, SIGNAL(triggered(bool)), pt_harmonicProcessor, SLOT(setSlidingDFT(bool)));
         connect(pt_prunAct, SIGNAL(triggered(bool)), pt_harmonicProcessor, SLOT(setPruning(bool)));
         connect(pt_harmonicProcessor, SIGNAL(CurrentValues(qreal,qreal,qreal,qreal)), this, SLOT(make_record_to_file(qreal,qreal,qreal,qreal)));
         pt_harmonicThread->start();
@@ -600,7 +870,9 @@ void MainWindow::configure_and_start_session()
         pt_greenAct->trigger(); // because green channel is default in QHarmonicProcessor
         pt_prunAct->setChecked(false);
         pt_pcaAct->setChecked(false);
+        pt_sdftAct->setChecked(false);
         pt_opencvProcessor->resetFaceRect();
+        QMetaObject::invokeMethod(pt_detectionStage, "resetFaceRect", Qt::QueuedConnection);
         if(m_sessionsCounter == 0)
         {
             pt_optionsMenu->setEnabled(true);
@@ -874,8 +1146,8 @@ void MainWindow::openMapDialog()
             //--------Clean memory and resources------
             if(pt_map)
             {
-                disconnect(pt_videoCapture, SIGNAL(frame_was_captured(cv::Mat)), pt_opencvProcessor, SLOT(mapProcess(cv::Mat)));
-                disconnect(&m_timer, SIGNAL(timeout()), pt_map, SIGNAL(updateMap()));
+                disconnectFrameSource(SLOT(mapProcess(cv::Mat,double)));
+                disconnectClock(pt_map, SIGNAL(updateMap()));
                 disconnect(pt_map, SIGNAL(mapUpdated(const qreal*,quint32,quint32,qreal,qreal)), pt_display, SLOT(updateMap(const qreal*,quint32,quint32,qreal,qreal)));
                 pt_display->clearMap();
                 if(pt_map)
@@ -897,16 +1169,17 @@ void MainWindow::openMapDialog()
                 if(dialog.exec() == QDialog::Accepted)
                 {
                     pt_opencvProcessor->setMapCellSize(dialog.getCellSize(), dialog.getCellSize());
-                    pt_opencvProcessor->setMapRegion(cv::Rect(tempRect.x,tempRect.y,dialog.getCellSize()*dialog.getMapWidth(),dialog.getCellSize()*dialog.getMapHeight()));
+                    pt_opencvProcessor->setMapCellStride(dialog.getCellStride(), dialog.getCellStride());
+                    pt_opencvProcessor->setMapRegion(cv::Rect(tempRect.x,tempRect.y,dialog.getCellStride()*(dialog.getMapWidth()-1)+dialog.getCellSize(),dialog.getCellStride()*(dialog.getMapHeight()-1)+dialog.getCellSize()));
 
                     pt_mapThread = new QThread(this);
                     pt_map = new QHarmonicProcessorMap(NULL, dialog.getMapWidth(), dialog.getMapHeight());
                     pt_map->setMapType(dialog.getMapType(), dialog.getSNRControl());
                     pt_map->moveToThread(pt_mapThread);
-                    connect(pt_opencvProcessor, SIGNAL(mapCellProcessed(ulong,ulong,ulong,ulong,double)), pt_map, SLOT(updateHarmonicProcessor(ulong,ulong,ulong,ulong,double)), Qt::BlockingQueuedConnection);
-                    connect(&m_timer, SIGNAL(timeout()), pt_map, SIGNAL(updateMap()));
+                    connect(pt_opencvProcessor, SIGNAL(mapFrameProcessed(const QMapFrame*)), pt_map, SLOT(updateHarmonicProcessors(const QMapFrame*)), Qt::BlockingQueuedConnection);
+                    connectClock(pt_map, SIGNAL(updateMap()));
                     connect(pt_map, SIGNAL(mapUpdated(const qreal*,quint32,quint32,qreal,qreal)), pt_display, SLOT(updateMap(const qreal*,quint32,quint32,qreal,qreal)));
-                    connect(pt_videoCapture, SIGNAL(frame_was_captured(cv::Mat)), pt_opencvProcessor, SLOT(mapProcess(cv::Mat)), Qt::BlockingQueuedConnection);
+                    connectFrameSource(SLOT(mapProcess(cv::Mat,double)));
                     connect(pt_pcaAct, SIGNAL(triggered(bool)), pt_map, SIGNAL(updatePCAMode(bool)));
                     connect(pt_colorMapper, SIGNAL(mapped(int)), pt_map, SIGNAL(changeColorChannel(int)));
                     connect(pt_mapThread, SIGNAL(finished()), pt_mapThread, SLOT(deleteLater()));
@@ -929,6 +1202,10 @@ void MainWindow::openProcessingDialog()
         dialog->setLimits(pt_harmonicProcessor->getDataLength());
         dialog->setValues(pt_harmonicProcessor->getEstimationInterval(), pt_harmonicProcessor->getBreathStrobe(), pt_harmonicProcessor->getBreathAverage(), pt_harmonicProcessor->getBreathCNInterval());
         connect(dialog, &QProcessingDialog::timerValueUpdated, &m_timer, &QTimer::setInterval);
+        if(m_offlineFlag)
+        {
+            connect(dialog, SIGNAL(timerValueUpdated(int)), pt_opencvProcessor, SLOT(setMediaClockInterval(int)));
+        }
         connect(dialog, SIGNAL(intervalValueUpdated(int)), pt_harmonicProcessor, SLOT(setEstiamtionInterval(int)));
         connect(dialog, SIGNAL(breathStrobeUpdated(int)), pt_harmonicProcessor, SLOT(setBreathStrobe(int)));
         connect(dialog, SIGNAL(breathAverageUpdated(int)), pt_harmonicProcessor, SLOT(setBreathAverage(int)));
@@ -1018,3 +1295,28 @@ void MainWindow::keyPressEvent(QKeyEvent *event)
     }
 }
 
+//------------------------------------------------------------------------------------
+
+void MainWindow::openSkinModel()
+{
+    QString fileName = QFileDialog::getOpenFileName(this, tr("Open skin model"), "skinmodels/", tr("Skin model (*.lut)"));
+    if(!fileName.isEmpty()) // processor owns the model and it lives in the other thread, so the call is queued
+        QMetaObject::invokeMethod(pt_opencvProcessor, "loadSkinModel", Qt::QueuedConnection, Q_ARG(QString, fileName));
+}
+
+//------------------------------------------------------------------------------------
+
+void MainWindow::saveSkinModel()
+{
+    QString fileName = QFileDialog::getSaveFileName(this, tr("Save skin model"), "skinmodels/ID" + QString::number(m_sessionsCounter) + ".lut", tr("Skin model (*.lut)"));
+    if(!fileName.isEmpty())
+        QMetaObject::invokeMethod(pt_opencvProcessor, "saveSkinModel", Qt::QueuedConnection, Q_ARG(QString, fileName));
+}
+
+//------------------------------------------------------------------------------------
+
+void MainWindow::clearRegions()
+{
+    QMetaObject::invokeMethod(pt_opencvProcessor, "clearRegions", Qt::QueuedConnection); // pool drops processors of absent regions on the next frame
+    pt_display->clearRegionValues();
+}
@@ -23,9 +23,11 @@
 #include "qimagewidget.h"
 #include "qopencvprocessor.h"
 #include "qvideocapture.h"
+#include "qdetectionstage.h"
 #include "about.h"
 #include "qharmonicprocessor.h"
 #include "qharmonicmap.h"
+#include "qharmonicpool.h"
 #include "qsettingsdialog.h"
 #include "qeasyplot.h"
 #include "qbackgroundwidget.h"
@@ -70,12 +72,21 @@ public slots:
     void startMeasurementsRecord();
     void openMapDialog();
     void openProcessingDialog();
+    void openSkinModel();   // loads skin model from file, processor uses it instead of the rule-based skin test
+    void saveSkinModel();   // saves the skin model trained by calibration
+    void clearRegions();    // removes all user regions of multiple regions mode
 
 private:
     void createActions();
     void createMenus();
     void createTimers();
     void createThreads();
+    void connectFrameSource(const char *processSlot);    // connects frames source (capture timer or frame ring) to pt_opencvProcessor's slot, depends on pt_videoCapture grab mode
+    void disconnectFrameSource(const char *processSlot);
+    void connectClock(const QObject *receiver, const char *method);     // connects measurements clock (m_timer or media clock of pt_harmonicProcessor in offline mode) to receiver's method
+    void disconnectClock(const QObject *receiver, const char *method);
+    void createRegionPool();            // pt_regionPool on its own thread, it takes QRegionFrame records of pt_opencvProcessor
+    void setupPipeline(bool value);     // true - capture, detection, accumulation and display stages run on their own threads, false - detection and accumulation are done in one call, display blocks processing
     QImageWidget *pt_display;
     QVBoxLayout *pt_mainLayout;
     QBackgroundWidget *pt_centralWidget;
@@ -99,12 +110,21 @@ private:
     QAction *pt_mapAct;
     QAction *pt_selectAllAct;
     QAction *pt_skinAct;
+    QAction *pt_lowResMaskAct;
     QAction *pt_adjustAct;
     QAction *pt_imageAct;
     QAction *pt_calibAct;
+    QAction *pt_openSkinModelAct;
+    QAction *pt_saveSkinModelAct;
     QAction *pt_measRecAct;
     QAction *pt_prunAct;
     QAction *pt_fillAct;
+    QAction *pt_grabAct;
+    QAction *pt_offlineAct;
+    QAction *pt_pipelineAct;
+    QAction *pt_rawAct;
+    QAction *pt_regionsAct;
+    QAction *pt_clearRegionsAct;
     QMenu *pt_RecordsMenu;
     QMenu *pt_fileMenu;
     QMenu *pt_optionsMenu;
@@ -119,6 +139,9 @@ private:
     QThread *pt_harmonicThread;
     QThread *pt_videoThread;
     QThread *pt_mapThread;
+    QThread *pt_detectThread;
+    QThread *pt_regionThread;
+    QDetectionStage *pt_detectionStage;
     QHarmonicProcessor *pt_harmonicProcessor;
     QTimer m_timer;
     QDialog *pt_dialogSet[LIMIT_OF_DIALOGS_NUMBER];
@@ -136,12 +159,23 @@ private:
     QAction *pt_greenAct;
     QAction *pt_allAct;
     QAction *pt_pcaAct;
+    QAction *pt_sdftAct;
     QAction *pt_experimentalAct;
+    QActionGroup *pt_detectionActGroup;
+    QSignalMapper *pt_detectionMapper;
+    QActionGroup *pt_downscaleActGroup;
+    QSignalMapper *pt_downscaleMapper;
+    QActionGroup *pt_patchActGroup;
+    QSignalMapper *pt_patchMapper;
+    QMenu *pt_detectionMenu;
 
     QHarmonicProcessorMap *pt_map;
+    QHarmonicProcessorPool *pt_regionPool; // processors of user regions in multiple regions mode
     QSettingsDialog m_settingsDialog;
 
     quint16 m_sessionsCounter;
+    bool m_offlineFlag; // video file is processed as fast as possible, measurements are clocked by media time
+    bool m_pipelineFlag; // pipeline mode of the current session, see setupPipeline()
 
 protected:
     void keyPressEvent(QKeyEvent *event);
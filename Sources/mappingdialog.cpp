@@ -7,6 +7,9 @@ mappingdialog::mappingdialog(QWidget *parent) :
     QDialog(parent),
     ui(new Ui::mappingdialog)
 {
+    m_cellSize = DEFAULT_CELL_SIZE;
+    m_width = 0;
+    m_height = 0;
     ui->setupUi(this);
     ui->sliderCell->setValue(DEFAULT_CELL_SIZE);
 }
@@ -18,7 +21,7 @@ mappingdialog::~mappingdialog()
 
 void mappingdialog::on_buttonAccept_clicked()
 {
-    if((m_width/m_cellSize == 0) || (m_height/m_cellSize == 0))
+    if((getMapWidth() == 0) || (getMapHeight() == 0))
         this->reject();
     else
         this->accept();
@@ -33,33 +36,49 @@ void mappingdialog::setImageHeight(int value)
 {
     m_height = value;
     ui->editHeightImage->setText(QString::number(value));
-    ui->editHeightMap->setText(QString::number(m_height/m_cellSize));
+    updateMapSize();
 }
 
 void mappingdialog::setImageWidth(int value)
 {
     m_width = value;
     ui->editWidthImage->setText(QString::number(value));
-    ui->editWidthMap->setText(QString::number(m_width/m_cellSize));
+    updateMapSize();
 }
 
 void mappingdialog::on_sliderCell_valueChanged(int value)
 {
     m_cellSize = value;
     ui->editCell->setText(QString::number(value));
-    ui->editWidthMap->setText(QString::number(m_width/m_cellSize));
-    ui->editHeightMap->setText(QString::number(m_height/m_cellSize));
+    updateMapSize();
+}
+
+void mappingdialog::on_cbOverlap_toggled(bool)
+{
+    updateMapSize();
+}
+
+void mappingdialog::updateMapSize()
+{
+    ui->editWidthMap->setText(QString::number(getMapWidth()));
+    ui->editHeightMap->setText(QString::number(getMapHeight()));
+}
+
+quint16 mappingdialog::getCellsNumber(quint16 length) const
+{
+    if(length < m_cellSize)
+        return 0;
+    return (length - m_cellSize)/getCellStride() + 1;
 }
 
 quint16 mappingdialog::getMapWidth() const
 {
-    return m_width/m_cellSize;
+    return getCellsNumber(m_width);
 }
 
 quint16 mappingdialog::getMapHeight() const
 {
-    return m_height/m_cellSize;
-
+    return getCellsNumber(m_height);
 }
 
 quint16 mappingdialog::getCellSize() const
@@ -67,6 +86,13 @@ quint16 mappingdialog::getCellSize() const
     return m_cellSize;
 }
 
+quint16 mappingdialog::getCellStride() const
+{
+    if(ui->cbOverlap->isChecked())
+        return qMax(m_cellSize/2, 1);
+    return m_cellSize;
+}
+
 QHarmonicProcessorMap::MapType mappingdialog::getMapType() const
 {
     return (QHarmonicProcessorMap::MapType)ui->CBType->currentIndex();
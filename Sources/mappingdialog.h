@@ -22,6 +22,7 @@ public slots:
     quint16 getMapWidth() const;
     quint16 getMapHeight() const;
     quint16 getCellSize() const;
+    quint16 getCellStride() const; // distance between neighbour cells, less than cell size if cells overlap
     QHarmonicProcessorMap::MapType getMapType() const;
     bool getSNRControl() const;
 
@@ -29,12 +30,16 @@ private slots:
     void on_buttonAccept_clicked();
     void on_buttonReject_clicked();
     void on_sliderCell_valueChanged(int value);
+    void on_cbOverlap_toggled(bool value);
 
 private:
     Ui::mappingdialog *ui;
     quint16 m_cellSize;
     quint16 m_width;
     quint16 m_height;
+
+    void updateMapSize();
+    quint16 getCellsNumber(quint16 length) const;
 };
 
 #endif // MAPPINGDIALOG_H
@@ -0,0 +1,187 @@
+/*------------------------------------------------------------------------------------------------------
+Taranov Alex, 2015									     SOURCE FILE
+PatchFusion merges sums of face sub-patches into one sample of R, G, B sums for QHarmonicProcessor.
+Every patch keeps a short history of its green mean, heart band SNR of the history is estimated by
+Goertzel filters on the in-band bins only, every PATCH_SNR_STRIDE samples. Patch means are normalized
+by their running averages, so patches of different brightness could be mixed and weights could change
+without steps in the output, normalized means are averaged with SNR weights and scaled back by the mean
+of the whole face. Patches with shadow or motion get low SNR and do not spoil the result.
+------------------------------------------------------------------------------------------------------*/
+
+#include "patchfusion.h"
+
+#include <cmath>
+#include <QtGlobal>
+
+static const double PATCH_PI = 3.14159265358979323846; // M_PI is not standard
+
+//------------------------------------------------------------------------------------------------------
+
+PatchFusion::PatchFusion()
+{
+    setCount(1);
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void PatchFusion::setCount(int count)
+{
+    if( (count < 1) || (count > MAX_PATCHES) )
+        return;
+    v_patches.resize(count);
+    v_history.resize(count * PATCH_WINDOW);
+    v_periods.resize(PATCH_WINDOW);
+    reset();
+}
+
+//------------------------------------------------------------------------------------------------------
+
+int PatchFusion::getCount() const
+{
+    return (int)v_patches.size();
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void PatchFusion::reset()
+{
+    for(size_t i = 0; i < v_patches.size(); i++)
+    {
+        v_patches[i].started = false;
+        v_patches[i].weight = 1.0 / v_patches.size(); // equal weights until the first estimation
+    }
+    std::fill(v_history.begin(), v_history.end(), 0.0);
+    std::fill(v_periods.begin(), v_periods.end(), 0.0);
+    m_pos = 0;
+    m_samples = 0;
+    m_periodSum = 0.0;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+double PatchFusion::getWeight(int patch) const
+{
+    return v_patches[patch].weight;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+ROISums PatchFusion::fuse(const ROISums *sums, double period)
+{
+    const int count = (int)v_patches.size();
+    ROISums total = {0, 0, 0, 0};
+    for(int i = 0; i < count; i++)
+    {
+        total.red += sums[i].red;
+        total.green += sums[i].green;
+        total.blue += sums[i].blue;
+        total.area += sums[i].area;
+    }
+    if(total.area == 0)
+        return total;
+
+    double fused[3] = {0.0, 0.0, 0.0};
+    double weights = 0.0;
+    for(int i = 0; i < count; i++)
+    {
+        Patch &patch = v_patches[i];
+        double *history = &v_history[i * PATCH_WINDOW];
+        if(sums[i].area == 0) // patch is out of frame or has no skin, its last mean is repeated in the history
+        {
+            history[m_pos] = history[(m_pos + PATCH_WINDOW - 1) % PATCH_WINDOW];
+            continue;
+        }
+        const double mean[3] = { (double)sums[i].red / sums[i].area, (double)sums[i].green / sums[i].area, (double)sums[i].blue / sums[i].area };
+        for(int c = 0; c < 3; c++)
+        {
+            if(patch.started)
+                patch.average[c] += (mean[c] - patch.average[c]) / PATCH_WINDOW;
+            else
+                patch.average[c] = mean[c];
+        }
+        patch.started = true;
+        history[m_pos] = mean[1];
+        for(int c = 0; c < 3; c++)
+            if(patch.average[c] > 0.0)
+                fused[c] += patch.weight * mean[c] / patch.average[c];
+        weights += patch.weight;
+    }
+
+    m_periodSum += period - v_periods[m_pos];
+    v_periods[m_pos] = period;
+    m_pos = (m_pos + 1) % PATCH_WINDOW;
+    m_samples++;
+    if( (m_samples >= PATCH_WINDOW) && ((m_samples % PATCH_SNR_STRIDE) == 0) )
+        updateWeights();
+
+    if(weights <= 0.0)
+        return total;
+    const double scale = (double)total.area / weights; // normalized means are brought back to the level of the whole face
+    const double level[3] = { (double)total.red / total.area, (double)total.green / total.area, (double)total.blue / total.area };
+    ROISums output;
+    output.red = (quint64)(fused[0] * level[0] * scale + 0.5);
+    output.green = (quint64)(fused[1] * level[1] * scale + 0.5);
+    output.blue = (quint64)(fused[2] * level[2] * scale + 0.5);
+    output.area = total.area;
+    return output;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void PatchFusion::updateWeights()
+{
+    const int count = (int)v_patches.size();
+    double sum = 0.0;
+    for(int i = 0; i < count; i++)
+    {
+        v_patches[i].weight = estimateSNR(&v_history[i * PATCH_WINDOW]);
+        sum += v_patches[i].weight;
+    }
+    for(int i = 0; i < count; i++)
+        v_patches[i].weight = sum > 0.0 ? v_patches[i].weight / sum : 1.0 / count;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+double PatchFusion::estimateSNR(const double *history) const
+{
+    if(m_periodSum <= 0.0)
+        return 0.0;
+    const double frequency = 1000.0 * PATCH_WINDOW / m_periodSum; // mean sampling frequency, s^-1
+    const int bottom = qMax(1, (int)std::ceil(PATCH_BAND_BOTTOM * PATCH_WINDOW / frequency));
+    const int top = qMin(PATCH_WINDOW / 2, (int)std::floor(PATCH_BAND_TOP * PATCH_WINDOW / frequency));
+    if(top - bottom < 2)
+        return 0.0;
+
+    double mean = 0.0;
+    for(int j = 0; j < PATCH_WINDOW; j++)
+        mean += history[j];
+    mean /= PATCH_WINDOW;
+
+    double power[PATCH_WINDOW / 2 + 1];
+    double band = 0.0;
+    int peak = bottom;
+    for(int k = bottom; k <= top; k++) // Goertzel filter per bin, order of samples in the ring does not change the power
+    {
+        const double coeff = 2.0 * std::cos(2.0 * PATCH_PI * k / PATCH_WINDOW);
+        double s1 = 0.0;
+        double s2 = 0.0;
+        for(int j = 0; j < PATCH_WINDOW; j++)
+        {
+            const double s0 = history[j] - mean + coeff * s1 - s2;
+            s2 = s1;
+            s1 = s0;
+        }
+        power[k] = s1 * s1 + s2 * s2 - coeff * s1 * s2;
+        band += power[k];
+        if(power[k] > power[peak])
+            peak = k;
+    }
+    double signal = power[peak];
+    if(peak > bottom)
+        signal += power[peak - 1];
+    if(peak < top)
+        signal += power[peak + 1];
+    const double noise = band - signal;
+    return noise > 0.0 ? signal / noise : signal > 0.0 ? PATCH_WINDOW : 0.0;
+}
@@ -0,0 +1,58 @@
+/*------------------------------------------------------------------------------------------------------
+Taranov Alex, 2015									     HEADER FILE
+PatchFusion merges sums of face sub-patches into one sample of R, G, B sums for QHarmonicProcessor.
+Every patch keeps a short history of its green mean, heart band SNR of the history is estimated by
+Goertzel filters on the in-band bins only, every PATCH_SNR_STRIDE samples. Patch means are normalized
+by their running averages, so patches of different brightness could be mixed and weights could change
+without steps in the output, normalized means are averaged with SNR weights and scaled back by the mean
+of the whole face. Patches with shadow or motion get low SNR and do not spoil the result.
+------------------------------------------------------------------------------------------------------*/
+
+#ifndef PATCHFUSION_H
+#define PATCHFUSION_H
+//------------------------------------------------------------------------------------------------------
+
+#include <vector>
+
+#include "roikernels.h"
+
+#define MAX_PATCHES 16
+#define PATCH_WINDOW 64         // in samples, history of SNR estimation
+#define PATCH_SNR_STRIDE 8      // in samples, SNR and weights are updated this often
+#define PATCH_BAND_BOTTOM 0.8   // in s^-1, as BOTTOM_LIMIT of QHarmonicProcessor
+#define PATCH_BAND_TOP 3.5      // in s^-1, as TOP_LIMIT of QHarmonicProcessor
+
+//------------------------------------------------------------------------------------------------------
+
+class PatchFusion
+{
+public:
+    PatchFusion();
+
+    void setCount(int count);   // 1 <= count <= MAX_PATCHES, drops the history
+    int getCount() const;
+    void reset();
+    ROISums fuse(const ROISums *sums, double period); // sums[i] of patch i, period of the frame in ms, returns sums of the whole face area
+    double getWeight(int patch) const; // normalized, sum of weights is 1
+
+private:
+    struct Patch
+    {
+        double average[3];      // running averages of red, green and blue means
+        bool started;
+        double weight;
+    };
+
+    std::vector<Patch> v_patches;
+    std::vector<double> v_history;  // PATCH_WINDOW green means of every patch, patch after patch
+    int m_pos;
+    int m_samples;
+    double m_periodSum;             // of the last PATCH_WINDOW frames
+    std::vector<double> v_periods;
+
+    void updateWeights();
+    double estimateSNR(const double *history) const; // peak of in-band power over the rest of in-band power
+};
+
+//------------------------------------------------------------------------------------------------------
+#endif // PATCHFUSION_H
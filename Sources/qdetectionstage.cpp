@@ -0,0 +1,104 @@
+/*------------------------------------------------------------------------------------------------------
+Taranov Alex, 2015									     SOURCE FILE
+QDetectionStage runs face detection on its own thread between capture and processing stages.
+It drains frames from the capture ring, stores found face into QCapturedFrame::roi and pushes
+the frame into its output ring in the same order, so detection of the next frame overlaps
+accumulation of the previous one in QOpencvProcessor::faceRegionProcess(...).
+------------------------------------------------------------------------------------------------------*/
+
+#include "qdetectionstage.h"
+
+//------------------------------------------------------------------------------------------------------
+
+QDetectionStage::QDetectionStage(QObject *parent) :
+    QObject(parent),
+    pt_inputRing(NULL),
+    pt_framePool(NULL),
+    m_outputRing(DEFAULT_FRAME_POOL_SIZE, QFrameRing::DropOldest),
+    m_pixelFormat(YUVInput::BGR)
+{
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void QDetectionStage::setFrameRing(QFrameRing *ring, QFramePool *pool)
+{
+    pt_inputRing = ring;
+    pt_framePool = pool;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void QDetectionStage::drainFrameRing()
+{
+    if(pt_inputRing)
+    {
+        pt_inputRing->acknowledgeNotification(); // should be called before pop(), otherwise the last notification could be lost
+        QCapturedFrame *frame;
+        QCapturedFrame *evicted;
+        while((frame = pt_inputRing->pop()) != NULL)
+        {
+            frame->roi = m_faceDetector.detect(YUVInput::getImageView(frame->image, m_pixelFormat));
+            if(!m_outputRing.push(frame, &evicted))
+                pt_framePool->release(frame);
+            pt_framePool->release(evicted);
+            if(m_outputRing.requestNotification())
+                emit framesAvailable();
+        }
+    }
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void QDetectionStage::flushFrameRing()
+{
+    if(pt_framePool)
+    {
+        QCapturedFrame *frame;
+        while((frame = m_outputRing.pop()) != NULL) // pop() is safe against the concurrent pop() of the consumer
+            pt_framePool->release(frame);
+    }
+}
+
+//------------------------------------------------------------------------------------------------------
+
+bool QDetectionStage::loadClassifier(const std::string &filename)
+{
+    return m_faceDetector.loadClassifier(filename);
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void QDetectionStage::resetFaceRect()
+{
+    m_faceDetector.reset();
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void QDetectionStage::setDetectionPeriod(int value)
+{
+    m_faceDetector.setDetectionPeriod(value);
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void QDetectionStage::setDetectionDownscale(int value)
+{
+    if(value > 0)
+        m_faceDetector.setDetectionScale(1.0 / value);
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void QDetectionStage::setPixelFormat(int value)
+{
+    m_pixelFormat = (YUVInput::PixelFormat)value;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+QFrameRing *QDetectionStage::getOutputRing()
+{
+    return &m_outputRing;
+}
@@ -0,0 +1,51 @@
+/*------------------------------------------------------------------------------------------------------
+Taranov Alex, 2015									     HEADER FILE
+QDetectionStage runs face detection on its own thread between capture and processing stages.
+It drains frames from the capture ring, stores found face into QCapturedFrame::roi and pushes
+the frame into its output ring in the same order, so detection of the next frame overlaps
+accumulation of the previous one in QOpencvProcessor::faceRegionProcess(...).
+------------------------------------------------------------------------------------------------------*/
+
+#ifndef QDETECTIONSTAGE_H
+#define QDETECTIONSTAGE_H
+//------------------------------------------------------------------------------------------------------
+
+#include <QObject>
+
+#include "qframering.h"
+#include "qframepool.h"
+#include "qfacedetector.h"
+#include "yuvinput.h"
+
+//------------------------------------------------------------------------------------------------------
+
+class QDetectionStage : public QObject
+{
+    Q_OBJECT
+public:
+    explicit QDetectionStage(QObject *parent = 0);
+
+signals:
+    void framesAvailable(); // emitted when consumer should drain output ring
+
+public slots:
+    void setFrameRing(QFrameRing *ring, QFramePool *pool); // sets the input ring and the pool where frames are released if they can not be passed further
+    void drainFrameRing();                      // pops all frames from input ring, detects faces and pushes frames into output ring
+    void flushFrameRing();                      // releases frames left in output ring, they are stale when capture has been stopped
+    bool loadClassifier(const std::string &filename);
+    void resetFaceRect();
+    void setDetectionPeriod(int value);         // cascade runs every value frames, face is tracked on the rest
+    void setDetectionDownscale(int value);      // cascade input is downscaled value times
+    void setPixelFormat(int value);             // YUVInput::PixelFormat of the incoming frames, cascade takes their luma
+    QFrameRing *getOutputRing();                // consumer should pop frames from here
+
+private:
+    QFaceDetector m_faceDetector;
+    QFrameRing *pt_inputRing;
+    QFramePool *pt_framePool;
+    QFrameRing m_outputRing; // could hold the whole pool, so frames are never dropped between detection and accumulation
+    YUVInput::PixelFormat m_pixelFormat;
+};
+
+//------------------------------------------------------------------------------------------------------
+#endif // QDETECTIONSTAGE_H
@@ -0,0 +1,258 @@
+/*------------------------------------------------------------------------------------------------------
+Taranov Alex, 2015									     SOURCE FILE
+QFaceDetector wraps opencv's CascadeClassifier and smooths found face rects over the last frames.
+Cascade could be run only every Nth frame, then face is tracked between detections by template
+matching on a downscaled search window around the previous rect, weak match forces detection.
+Cascade itself runs on a downscaled copy of the image and, while the face is not lost, only inside
+a window around the last found rect; full frame is scanned after FRAMES_WITHOUT_FACE_TRESHOLD misses.
+It is not a QObject, so the same code is used inline by QOpencvProcessor::faceProcess(...)
+and by QDetectionStage when detection runs on its own thread.
+------------------------------------------------------------------------------------------------------*/
+
+#include "qfacedetector.h"
+
+//------------------------------------------------------------------------------------------------------
+
+QFaceDetector::QFaceDetector():
+    m_emptyFrames(0),
+    m_facePos(0),
+    m_detectionPeriod(DEFAULT_DETECTION_PERIOD),
+    m_framesSinceDetection(0),
+    m_detectionScale(DEFAULT_DETECTION_SCALE),
+    m_trackFlag(false),
+    m_trackScale(1.0)
+{
+}
+
+//------------------------------------------------------------------------------------------------------
+
+bool QFaceDetector::loadClassifier(const std::string &filename)
+{
+    return m_classifier.load( filename );
+}
+
+//------------------------------------------------------------------------------------------------------
+
+bool QFaceDetector::empty() const
+{
+    return m_classifier.empty();
+}
+
+//------------------------------------------------------------------------------------------------------
+
+cv::Rect QFaceDetector::detect(const cv::Mat &input)
+{
+    cv::Rect rect;
+    bool found = false;
+    if(m_trackFlag && (++m_framesSinceDetection < m_detectionPeriod))
+        found = track(input, rect);
+    if(!found) // time to detect or tracking has lost the face
+    {
+        m_framesSinceDetection = 0;
+        found = runCascade(input, rect);
+        if(found)
+            updateTemplate(input, rect);
+        else
+            m_trackFlag = false;
+    }
+
+    if(!found) {
+        m_emptyFrames++;
+        if(m_emptyFrames > FRAMES_WITHOUT_FACE_TRESHOLD)
+            setAverageFaceRect(0, 0, 0, 0);
+    } else {
+        m_emptyFrames = 0;
+        m_lastRect = rect;
+        enrollFaceRect(rect);
+    }
+    return getAverageFaceRect();
+}
+
+//------------------------------------------------------------------------------------------------------
+
+bool QFaceDetector::runCascade(const cv::Mat &input, cv::Rect &rect)
+{
+    cv::Rect window(0, 0, input.cols, input.rows);
+    if( (m_emptyFrames <= FRAMES_WITHOUT_FACE_TRESHOLD) && (m_lastRect.area() > 0) ) // face has not been lost yet, so it is searched near the last place
+    {
+        const int dX = m_lastRect.width / DETECTION_WINDOW_DIVIDER;
+        const int dY = m_lastRect.height / DETECTION_WINDOW_DIVIDER;
+        window &= cv::Rect(m_lastRect.x - dX, m_lastRect.y - dY, m_lastRect.width + 2 * dX, m_lastRect.height + 2 * dY);
+    }
+
+    toGray(cv::Mat(input, window), m_detectionGray);
+    if(m_detectionScale < 1.0)
+        cv::resize(m_detectionGray, m_grayFrame, cv::Size(), m_detectionScale, m_detectionScale, cv::INTER_AREA);
+    else
+        m_detectionGray.copyTo(m_grayFrame);
+    cv::equalizeHist(m_grayFrame, m_grayFrame);
+    std::vector<cv::Rect> faces_vector;
+
+    const int minsize = cvRound(OBJECT_MINSIZE * m_detectionScale);
+    m_classifier.detectMultiScale(m_grayFrame, faces_vector, 1.1, 7, cv::CASCADE_FIND_BIGGEST_OBJECT, cv::Size(minsize, minsize)); // Detect faces (list of flags CASCADE_DO_CANNY_PRUNING, CASCADE_DO_ROUGH_SEARCH, CASCADE_FIND_BIGGEST_OBJECT, CASCADE_SCALE_IMAGE )
+
+    if(faces_vector.size() == 0)
+        return false;
+    // back to full resolution coordinates
+    rect.x = window.x + cvRound(faces_vector[0].x / m_detectionScale);
+    rect.y = window.y + cvRound(faces_vector[0].y / m_detectionScale);
+    rect.width = cvRound(faces_vector[0].width / m_detectionScale);
+    rect.height = cvRound(faces_vector[0].height / m_detectionScale);
+    rect &= cv::Rect(0, 0, input.cols, input.rows);
+    return true;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+int QFaceDetector::detectAll(const cv::Mat &input, std::vector<cv::Rect> &faces)
+{
+    toGray(input, m_detectionGray);
+    if(m_detectionScale < 1.0)
+        cv::resize(m_detectionGray, m_grayFrame, cv::Size(), m_detectionScale, m_detectionScale, cv::INTER_AREA);
+    else
+        m_detectionGray.copyTo(m_grayFrame);
+    cv::equalizeHist(m_grayFrame, m_grayFrame);
+
+    const int minsize = cvRound(OBJECT_MINSIZE * m_detectionScale);
+    m_classifier.detectMultiScale(m_grayFrame, faces, 1.1, 7, 0, cv::Size(minsize, minsize)); // no CASCADE_FIND_BIGGEST_OBJECT, every subject is needed
+    const cv::Rect bounds(0, 0, input.cols, input.rows);
+    for(size_t i = 0; i < faces.size(); i++)
+    {
+        faces[i].x = cvRound(faces[i].x / m_detectionScale);
+        faces[i].y = cvRound(faces[i].y / m_detectionScale);
+        faces[i].width = cvRound(faces[i].width / m_detectionScale);
+        faces[i].height = cvRound(faces[i].height / m_detectionScale);
+        faces[i] &= bounds;
+    }
+    return (int)faces.size();
+}
+
+//------------------------------------------------------------------------------------------------------
+
+bool QFaceDetector::track(const cv::Mat &input, cv::Rect &rect)
+{
+    const int dX = m_lastRect.width / TRACK_WINDOW_DIVIDER;
+    const int dY = m_lastRect.height / TRACK_WINDOW_DIVIDER;
+    cv::Rect window(m_lastRect.x - dX, m_lastRect.y - dY, m_lastRect.width + 2 * dX, m_lastRect.height + 2 * dY);
+    window &= cv::Rect(0, 0, input.cols, input.rows);
+    if( (window.width < m_lastRect.width) || (window.height < m_lastRect.height) ) // face is leaving the frame, let the cascade decide
+        return false;
+
+    toGray(cv::Mat(input, window), m_searchGray);
+    cv::resize(m_searchGray, m_searchSmall, cv::Size(), m_trackScale, m_trackScale, cv::INTER_AREA);
+    if( (m_searchSmall.cols < m_template.cols) || (m_searchSmall.rows < m_template.rows) )
+        return false;
+    cv::matchTemplate(m_searchSmall, m_template, m_matchResult, CV_TM_CCOEFF_NORMED);
+    double maxValue;
+    cv::Point maxLocation;
+    cv::minMaxLoc(m_matchResult, NULL, &maxValue, NULL, &maxLocation);
+    if(maxValue < TRACK_CONFIDENCE_TRESHOLD)
+        return false;
+
+    rect = cv::Rect(window.x + cvRound(maxLocation.x / m_trackScale), window.y + cvRound(maxLocation.y / m_trackScale), m_lastRect.width, m_lastRect.height);
+    return true;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void QFaceDetector::updateTemplate(const cv::Mat &input, const cv::Rect &rect)
+{
+    m_trackScale = rect.width > TRACK_TEMPLATE_SIZE ? (double)TRACK_TEMPLATE_SIZE / rect.width : 1.0;
+    toGray(cv::Mat(input, rect), m_searchGray);
+    cv::resize(m_searchGray, m_template, cv::Size(), m_trackScale, m_trackScale, cv::INTER_AREA); // template is taken from not equalized image, as the search window is
+    m_trackFlag = true;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void QFaceDetector::toGray(const cv::Mat &input, cv::Mat &output) const
+{
+    if(input.channels() == 3)
+        cv::cvtColor(input, output, CV_BGR2GRAY);
+    else if(input.channels() == 2)
+        cv::extractChannel(input, output, 0); // raw YUYV, luma is the gray image
+    else
+        input.copyTo(output);
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void QFaceDetector::reset()
+{
+    m_emptyFrames = 0;
+    m_framesSinceDetection = 0;
+    m_trackFlag = false;
+    m_lastRect = cv::Rect();
+    setAverageFaceRect(0, 0, 0, 0);
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void QFaceDetector::setDetectionPeriod(int value)
+{
+    if(value > 0)
+        m_detectionPeriod = value;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+int QFaceDetector::getDetectionPeriod() const
+{
+    return m_detectionPeriod;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+cv::Rect QFaceDetector::getAverageFaceRect() const
+{
+    qreal x = 0.0;
+    qreal y = 0.0;
+    qreal w = 0.0;
+    qreal h = 0.0;
+    for(quint8 i = 0; i < FACE_RECT_VECTOR_LENGTH; i++) {
+        x += v_faceRect[i].x;
+        y += v_faceRect[i].y;
+        w += v_faceRect[i].width;
+        h += v_faceRect[i].height;
+    }
+    x /= FACE_RECT_VECTOR_LENGTH;
+    y /= FACE_RECT_VECTOR_LENGTH;
+    w /= FACE_RECT_VECTOR_LENGTH;
+    h /= FACE_RECT_VECTOR_LENGTH;
+    return cv::Rect(x, y, w, h);
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void QFaceDetector::enrollFaceRect(const cv::Rect &rect)
+{
+    v_faceRect[m_facePos] = rect;
+    m_facePos = (m_facePos + 1) % FACE_RECT_VECTOR_LENGTH;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void QFaceDetector::setAverageFaceRect(int x, int y, int w, int h)
+{
+    for(quint8 i = 0; i < FACE_RECT_VECTOR_LENGTH; i++) {
+        v_faceRect[i].x = x;
+        v_faceRect[i].y = y;
+        v_faceRect[i].width = w;
+        v_faceRect[i].height = h;
+    }
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void QFaceDetector::setDetectionScale(double value)
+{
+    if( (value > 0.0) && (value <= 1.0) )
+        m_detectionScale = value;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+double QFaceDetector::getDetectionScale() const
+{
+    return m_detectionScale;
+}
@@ -0,0 +1,76 @@
+/*------------------------------------------------------------------------------------------------------
+Taranov Alex, 2015									     HEADER FILE
+QFaceDetector wraps opencv's CascadeClassifier and smooths found face rects over the last frames.
+Cascade could be run only every Nth frame, then face is tracked between detections by template
+matching on a downscaled search window around the previous rect, weak match forces detection.
+Cascade itself runs on a downscaled copy of the image and, while the face is not lost, only inside
+a window around the last found rect; full frame is scanned after FRAMES_WITHOUT_FACE_TRESHOLD misses.
+It is not a QObject, so the same code is used inline by QOpencvProcessor::faceProcess(...)
+and by QDetectionStage when detection runs on its own thread.
+------------------------------------------------------------------------------------------------------*/
+
+#ifndef QFACEDETECTOR_H
+#define QFACEDETECTOR_H
+//------------------------------------------------------------------------------------------------------
+
+#include <QtGlobal>
+#include <opencv2/opencv.hpp>
+
+#define OBJECT_MINSIZE 128
+#define FACE_RECT_VECTOR_LENGTH 16
+#define FRAMES_WITHOUT_FACE_TRESHOLD 16
+
+#define DEFAULT_DETECTION_PERIOD 1         // in frames, 1 means that cascade runs on every frame
+#define TRACK_TEMPLATE_SIZE 32             // in pixels, face template is downscaled to this width for tracking
+#define TRACK_WINDOW_DIVIDER 4             // search window is wider than the previous rect by width/TRACK_WINDOW_DIVIDER on each side
+#define TRACK_CONFIDENCE_TRESHOLD 0.6      // minimum of normalized correlation coefficient, below it the cascade is run
+
+#define DEFAULT_DETECTION_SCALE 0.5        // cascade input is downscaled by this factor, OBJECT_MINSIZE is scaled accordingly
+#define DETECTION_WINDOW_DIVIDER 2         // detection window is wider than the last rect by width/DETECTION_WINDOW_DIVIDER on each side
+
+//------------------------------------------------------------------------------------------------------
+
+class QFaceDetector
+{
+public:
+    QFaceDetector();
+
+    bool loadClassifier(const std::string &filename); // an interface to CascadeClassifier::load(...) function
+    bool empty() const;                 // returns true if no classifier has been loaded
+    cv::Rect detect(const cv::Mat &input); // runs the cascade on BGR input and returns face rect averaged over the last FACE_RECT_VECTOR_LENGTH detections
+    int detectAll(const cv::Mat &input, std::vector<cv::Rect> &faces); // runs the cascade on the whole frame and returns all faces as they are found, without smoothing and tracking
+    void reset();                       // forgets all previous detections
+    void setDetectionPeriod(int value); // cascade runs every value frames, face is tracked on the rest
+    int getDetectionPeriod() const;
+    void setDetectionScale(double value);   // 0 < value <= 1.0
+    double getDetectionScale() const;
+
+private:
+    cv::CascadeClassifier m_classifier; // object that manages opencv's image recognition functions
+    cv::Mat m_grayFrame;                // reusable buffer for the classifier input
+    quint16 m_emptyFrames;
+    cv::Rect v_faceRect[FACE_RECT_VECTOR_LENGTH];
+    quint8 m_facePos;
+    int m_detectionPeriod;
+    int m_framesSinceDetection;
+    double m_detectionScale;
+    cv::Mat m_detectionGray;            // window of the frame in gray before downscale
+    bool m_trackFlag;                   // m_template is valid
+    cv::Rect m_lastRect;                // the last found rect before smoothing
+    double m_trackScale;                // downscale factor of m_template
+    cv::Mat m_template;
+    cv::Mat m_searchGray;
+    cv::Mat m_searchSmall;
+    cv::Mat m_matchResult;
+
+    bool runCascade(const cv::Mat &input, cv::Rect &rect);
+    bool track(const cv::Mat &input, cv::Rect &rect);
+    void updateTemplate(const cv::Mat &input, const cv::Rect &rect);
+    void toGray(const cv::Mat &input, cv::Mat &output) const;
+    cv::Rect getAverageFaceRect() const;
+    void enrollFaceRect(const cv::Rect &rect);
+    void setAverageFaceRect(int x, int y, int w, int h);
+};
+
+//------------------------------------------------------------------------------------------------------
+#endif // QFACEDETECTOR_H
@@ -0,0 +1,134 @@
+/*------------------------------------------------------------------------------------------------------
+Taranov Alex, 2015									     SOURCE FILE
+QFaceTracker keeps all faces found by QFaceDetector::detectAll(...) as tracks with persistent ids.
+Faces of a new detection are matched to tracks by the overlap of rects, the best overlaps are taken first,
+unmatched faces start new tracks, tracks that have not been matched for FRAMES_WITHOUT_FACE_TRESHOLD
+frames are dropped. Every track smooths its rect over the last FACE_RECT_VECTOR_LENGTH detections,
+as QFaceDetector does for the single face. Cascade runs every detection period frames of the detector,
+tracks keep their rects in between. It is not a QObject, QOpencvProcessor::facesProcess(...) uses it inline.
+------------------------------------------------------------------------------------------------------*/
+
+#include "qfacetracker.h"
+
+//------------------------------------------------------------------------------------------------------
+
+QFaceTracker::QFaceTracker():
+    m_idCounter(0),
+    m_frameCounter(0),
+    m_framesSinceDetection(0)
+{
+}
+
+//------------------------------------------------------------------------------------------------------
+
+const std::vector<QFaceTracker::Track> &QFaceTracker::update(QFaceDetector &detector, const cv::Mat &input)
+{
+    m_frameCounter++;
+    if( v_tracks.empty() || (++m_framesSinceDetection >= detector.getDetectionPeriod()) )
+    {
+        m_framesSinceDetection = 0;
+        detector.detectAll(input, v_faces);
+        match();
+    }
+    return v_tracks;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void QFaceTracker::match()
+{
+    v_faceMatched.assign(v_faces.size(), false);
+    v_trackMatched.assign(v_tracks.size(), false);
+    while(true) // greedy, the best overlapped pair first, counts are small
+    {
+        double best = TRACK_MIN_OVERLAP;
+        int bestFace = -1;
+        int bestTrack = -1;
+        for(size_t i = 0; i < v_faces.size(); i++)
+        {
+            if(v_faceMatched[i])
+                continue;
+            for(size_t j = 0; j < v_tracks.size(); j++)
+            {
+                if(v_trackMatched[j])
+                    continue;
+                const double value = overlap(v_faces[i], v_tracks[j].lastRect);
+                if(value > best)
+                {
+                    best = value;
+                    bestFace = (int)i;
+                    bestTrack = (int)j;
+                }
+            }
+        }
+        if(bestFace < 0)
+            break;
+        v_faceMatched[bestFace] = true;
+        v_trackMatched[bestTrack] = true;
+        enroll(v_tracks[bestTrack], v_faces[bestFace]);
+        v_tracks[bestTrack].lastFrame = m_frameCounter;
+    }
+
+    for(size_t j = v_tracks.size(); j > 0; j--) // lost tracks, from the end to keep indexes of the rest
+        if(m_frameCounter - v_tracks[j-1].lastFrame > FRAMES_WITHOUT_FACE_TRESHOLD)
+            v_tracks.erase(v_tracks.begin() + (j-1));
+
+    for(size_t i = 0; i < v_faces.size(); i++)
+    {
+        if(v_faceMatched[i] || (v_tracks.size() >= MAX_FACE_TRACKS))
+            continue;
+        Track track;
+        track.id = ++m_idCounter;
+        track.lastFrame = m_frameCounter;
+        for(quint8 k = 0; k < FACE_RECT_VECTOR_LENGTH; k++) // new track starts from its first rect, not from zero rect
+            track.history[k] = v_faces[i];
+        track.pos = 0;
+        track.rect = v_faces[i];
+        track.lastRect = v_faces[i];
+        v_tracks.push_back(track);
+    }
+}
+
+//------------------------------------------------------------------------------------------------------
+
+double QFaceTracker::overlap(const cv::Rect &a, const cv::Rect &b)
+{
+    const double intersection = (a & b).area();
+    const double united = a.area() + b.area() - intersection;
+    return united > 0.0 ? intersection / united : 0.0;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void QFaceTracker::enroll(Track &track, const cv::Rect &rect)
+{
+    track.lastRect = rect;
+    track.history[track.pos] = rect;
+    track.pos = (track.pos + 1) % FACE_RECT_VECTOR_LENGTH;
+    qreal x = 0.0;
+    qreal y = 0.0;
+    qreal w = 0.0;
+    qreal h = 0.0;
+    for(quint8 i = 0; i < FACE_RECT_VECTOR_LENGTH; i++) {
+        x += track.history[i].x;
+        y += track.history[i].y;
+        w += track.history[i].width;
+        h += track.history[i].height;
+    }
+    track.rect = cv::Rect(x / FACE_RECT_VECTOR_LENGTH, y / FACE_RECT_VECTOR_LENGTH, w / FACE_RECT_VECTOR_LENGTH, h / FACE_RECT_VECTOR_LENGTH);
+}
+
+//------------------------------------------------------------------------------------------------------
+
+const std::vector<QFaceTracker::Track> &QFaceTracker::getTracks() const
+{
+    return v_tracks;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void QFaceTracker::reset()
+{
+    v_tracks.clear();
+    m_framesSinceDetection = 0;
+}
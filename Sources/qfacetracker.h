@@ -0,0 +1,60 @@
+/*------------------------------------------------------------------------------------------------------
+Taranov Alex, 2015									     HEADER FILE
+QFaceTracker keeps all faces found by QFaceDetector::detectAll(...) as tracks with persistent ids.
+Faces of a new detection are matched to tracks by the overlap of rects, the best overlaps are taken first,
+unmatched faces start new tracks, tracks that have not been matched for FRAMES_WITHOUT_FACE_TRESHOLD
+frames are dropped. Every track smooths its rect over the last FACE_RECT_VECTOR_LENGTH detections,
+as QFaceDetector does for the single face. Cascade runs every detection period frames of the detector,
+tracks keep their rects in between. It is not a QObject, QOpencvProcessor::facesProcess(...) uses it inline.
+------------------------------------------------------------------------------------------------------*/
+
+#ifndef QFACETRACKER_H
+#define QFACETRACKER_H
+//------------------------------------------------------------------------------------------------------
+
+#include <vector>
+#include <QtGlobal>
+#include <opencv2/opencv.hpp>
+
+#include "qfacedetector.h"
+
+#define MAX_FACE_TRACKS 8           // faces above this count are not tracked
+#define TRACK_MIN_OVERLAP 0.3       // minimum of intersection over union of face and track rects to match them
+
+//------------------------------------------------------------------------------------------------------
+
+class QFaceTracker
+{
+public:
+    struct Track
+    {
+        quint32 id;             // starts from 1 and is never given twice during tracker life
+        cv::Rect rect;          // averaged rect
+        cv::Rect lastRect;      // the last matched face before smoothing
+        quint32 lastFrame;      // frame number of the last match
+        cv::Rect history[FACE_RECT_VECTOR_LENGTH];
+        quint8 pos;
+    };
+
+    QFaceTracker();
+
+    const std::vector<Track> &update(QFaceDetector &detector, const cv::Mat &input); // input is BGR image or luma plane
+    const std::vector<Track> &getTracks() const;
+    void reset();               // drops all tracks, ids are not reused
+
+private:
+    std::vector<Track> v_tracks;
+    std::vector<cv::Rect> v_faces;  // reusable buffer of detectAll(...) results
+    std::vector<bool> v_faceMatched;
+    std::vector<bool> v_trackMatched;
+    quint32 m_idCounter;
+    quint32 m_frameCounter;
+    int m_framesSinceDetection;
+
+    void match();
+    static double overlap(const cv::Rect &a, const cv::Rect &b);
+    static void enroll(Track &track, const cv::Rect &rect);
+};
+
+//------------------------------------------------------------------------------------------------------
+#endif // QFACETRACKER_H
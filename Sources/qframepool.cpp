@@ -0,0 +1,129 @@
+/*------------------------------------------------------------------------------------------------------
+Taranov Alex, 2015									     SOURCE FILE
+QFramePool is a fixed set of preallocated QCapturedFrame instances that are recycled between
+capture, processing and display stages. Whoever acquire() a frame owns it, ownership is handed over
+through QFrameRing and extra owners could retain() the frame. When the last owner calls release(),
+frame returns to the pool and its image buffer is reused by the next acquire(), so no heap
+allocation happens per frame in steady state.
+------------------------------------------------------------------------------------------------------*/
+
+#include "qframepool.h"
+
+//------------------------------------------------------------------------------------------------------
+
+QFramePool::QFramePool(quint32 size):
+    m_size(size),
+    m_free(size),
+    m_misses(0),
+    m_detaches(0)
+{
+    v_frames = new QCapturedFrame[m_size];
+    v_free = new QCapturedFrame*[m_size];
+    for(quint32 i = 0; i < m_size; i++)
+    {
+        v_frames[i].timestamp = -1.0;
+        v_frames[i].number = 0;
+        v_frames[i].owners.store(0);
+        v_free[i] = &v_frames[i];
+    }
+}
+
+//------------------------------------------------------------------------------------------------------
+
+QFramePool::~QFramePool()
+{
+    delete[] v_free;
+    delete[] v_frames;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void QFramePool::reserve(int rows, int cols, int type)
+{
+    QMutexLocker locker(&m_mutex);
+    for(quint32 i = 0; i < m_free; i++)
+        v_free[i]->image.create(rows, cols, type); // does nothing if buffer already has the same size and type, cv::Mat data is aligned by cv::fastMalloc
+}
+
+//------------------------------------------------------------------------------------------------------
+
+QCapturedFrame *QFramePool::acquire()
+{
+    QCapturedFrame *frame = NULL;
+    m_mutex.lock();
+    if(m_free > 0)
+        frame = v_free[--m_free];
+    m_mutex.unlock();
+
+    if(frame == NULL)
+    {
+        m_misses.ref();
+        return NULL;
+    }
+    // Some stage could keep a cv::Mat header of the previous frame (for instance, queued signal argument),
+    // writing into the shared buffer would spoil its data, so buffer is detached and allocated anew
+    if(frame->image.u && (CV_XADD(&frame->image.u->refcount, 0) > 1)) // atomic read, other owner can release it concurrently
+    {
+        const int rows = frame->image.rows, cols = frame->image.cols, type = frame->image.type();
+        frame->image.release();
+        frame->image.create(rows, cols, type);
+        m_detaches.ref();
+    }
+    frame->owners.store(1);
+    return frame;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void QFramePool::retain(QCapturedFrame *frame)
+{
+    frame->owners.ref();
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void QFramePool::release(QCapturedFrame *frame)
+{
+    if(frame && !frame->owners.deref())
+    {
+        QMutexLocker locker(&m_mutex);
+        v_free[m_free++] = frame;
+    }
+}
+
+//------------------------------------------------------------------------------------------------------
+
+quint32 QFramePool::getSize() const
+{
+    return m_size;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+quint32 QFramePool::getAvailable()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_free;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+quint32 QFramePool::getMisses() const
+{
+    return (quint32)m_misses.load();
+}
+
+//------------------------------------------------------------------------------------------------------
+
+quint32 QFramePool::getDetaches() const
+{
+    return (quint32)m_detaches.load();
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void QFramePool::resetCounters()
+{
+    m_misses.store(0);
+    m_detaches.store(0);
+}
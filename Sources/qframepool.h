@@ -0,0 +1,54 @@
+/*------------------------------------------------------------------------------------------------------
+Taranov Alex, 2015									     HEADER FILE
+QFramePool is a fixed set of preallocated QCapturedFrame instances that are recycled between
+capture, processing and display stages. Whoever acquire() a frame owns it, ownership is handed over
+through QFrameRing and extra owners could retain() the frame. When the last owner calls release(),
+frame returns to the pool and its image buffer is reused by the next acquire(), so no heap
+allocation happens per frame in steady state.
+------------------------------------------------------------------------------------------------------*/
+
+#ifndef QFRAMEPOOL_H
+#define QFRAMEPOOL_H
+//------------------------------------------------------------------------------------------------------
+
+#include <QMutex>
+#include <QAtomicInt>
+
+#include "qframering.h"
+
+#define DEFAULT_FRAME_POOL_SIZE (DEFAULT_FRAME_RING_CAPACITY + 3) // ring capacity + one frame in producer + one in consumer + one in display
+
+//------------------------------------------------------------------------------------------------------
+
+class QFramePool
+{
+public:
+    explicit QFramePool(quint32 size = DEFAULT_FRAME_POOL_SIZE);
+    ~QFramePool();
+
+    void reserve(int rows, int cols, int type); // preallocates image buffers of all free frames, call it when frame size is known
+    QCapturedFrame *acquire();                  // returns frame with one owner and exclusively owned image buffer, NULL when pool is exhausted
+    void retain(QCapturedFrame *frame);         // adds one owner
+    void release(QCapturedFrame *frame);        // removes one owner, the last one returns frame to the pool
+
+    quint32 getSize() const;
+    quint32 getAvailable();
+    quint32 getMisses() const;  // the number of acquire() calls that found the pool empty
+    quint32 getDetaches() const;// the number of image buffers that were still referenced outside of the pool on acquire() and had to be replaced
+    void resetCounters();
+
+private:
+    QCapturedFrame *v_frames;   // storage of all frames
+    QCapturedFrame **v_free;    // stack of free frames
+    quint32 m_size;
+    quint32 m_free;
+    QMutex m_mutex;             // guards v_free and m_free only, so the critical section is a couple of instructions long
+    QAtomicInt m_misses;
+    QAtomicInt m_detaches;
+
+    QFramePool(const QFramePool &);
+    QFramePool& operator=(const QFramePool &);
+};
+
+//------------------------------------------------------------------------------------------------------
+#endif // QFRAMEPOOL_H
@@ -0,0 +1,150 @@
+/*------------------------------------------------------------------------------------------------------
+Taranov Alex, 2015									     SOURCE FILE
+QFrameRing is a fixed-capacity single-producer/single-consumer ring of captured frames.
+Producer (capture thread) calls push(...), consumer (processing thread) calls pop().
+When the ring is full, push(...) either drops the oldest queued frame or refuses the new one,
+in accordance with the DropPolicy. Only atomic operations are used, so neither side ever blocks.
+Ring does not own frames, they belong to QFramePool and ownership is handed over by push/pop.
+------------------------------------------------------------------------------------------------------*/
+
+#include "qframering.h"
+
+//------------------------------------------------------------------------------------------------------
+
+QFrameRing::QFrameRing(quint32 capacity, DropPolicy policy):
+    m_read(0),
+    m_write(0),
+    m_policy(policy),
+    m_drops(0),
+    m_maxDepth(0),
+    m_notified(0)
+{
+    m_capacity = 1;
+    while(m_capacity < capacity)
+        m_capacity <<= 1;
+    m_mask = m_capacity - 1;
+    v_slots = new QAtomicPointer<QCapturedFrame>[m_capacity];
+    for(quint32 i = 0; i < m_capacity; i++)
+        v_slots[i].store(NULL);
+}
+
+//------------------------------------------------------------------------------------------------------
+
+QFrameRing::~QFrameRing()
+{
+    delete[] v_slots;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+bool QFrameRing::push(QCapturedFrame *frame, QCapturedFrame **evicted)
+{
+    *evicted = NULL;
+    const int w = m_write.load();
+    int r = m_read.loadAcquire();
+    while((quint32)(w - r) >= m_capacity)
+    {
+        if(m_policy.load() == DropNewest)
+        {
+            m_drops.ref();
+            return false;
+        }
+        // Consumer could take the same frame concurrently, so the oldest slot is claimed by CAS on read index
+        QCapturedFrame *oldest = v_slots[(quint32)r & m_mask].loadAcquire();
+        if(m_read.testAndSetOrdered(r, r + 1))
+        {
+            *evicted = oldest;
+            m_drops.ref();
+            break;
+        }
+        r = m_read.loadAcquire();
+    }
+    // Slot (w & m_mask) is free here, consumer can not reach it until m_write is updated
+    v_slots[(quint32)w & m_mask].storeRelease(frame);
+    m_write.storeRelease(w + 1);
+
+    const int depth = (int)((quint32)(w + 1 - m_read.loadAcquire()));
+    if(depth > m_maxDepth.load())
+        m_maxDepth.store(depth);
+    return true;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+QCapturedFrame *QFrameRing::pop()
+{
+    for(;;)
+    {
+        const int r = m_read.loadAcquire();
+        if(r == m_write.loadAcquire())
+            return NULL;
+        // Producer writes slot (r & m_mask) again only after read index has been moved from r, then CAS below fails
+        QCapturedFrame *frame = v_slots[(quint32)r & m_mask].loadAcquire();
+        if(m_read.testAndSetOrdered(r, r + 1))
+            return frame;
+    }
+}
+
+//------------------------------------------------------------------------------------------------------
+
+bool QFrameRing::requestNotification()
+{
+    return m_notified.testAndSetOrdered(0, 1);
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void QFrameRing::acknowledgeNotification()
+{
+    m_notified.storeRelease(0);
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void QFrameRing::setDropPolicy(DropPolicy policy)
+{
+    m_policy.store(policy);
+}
+
+//------------------------------------------------------------------------------------------------------
+
+QFrameRing::DropPolicy QFrameRing::getDropPolicy() const
+{
+    return (DropPolicy)m_policy.load();
+}
+
+//------------------------------------------------------------------------------------------------------
+
+quint32 QFrameRing::getCapacity() const
+{
+    return m_capacity;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+quint32 QFrameRing::getDepth() const
+{
+    return (quint32)(m_write.loadAcquire() - m_read.loadAcquire());
+}
+
+//------------------------------------------------------------------------------------------------------
+
+quint32 QFrameRing::getMaxDepth() const
+{
+    return (quint32)m_maxDepth.load();
+}
+
+//------------------------------------------------------------------------------------------------------
+
+quint32 QFrameRing::getDrops() const
+{
+    return (quint32)m_drops.load();
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void QFrameRing::resetCounters()
+{
+    m_drops.store(0);
+    m_maxDepth.store(0);
+}
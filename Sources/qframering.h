@@ -0,0 +1,77 @@
+/*------------------------------------------------------------------------------------------------------
+Taranov Alex, 2015									     HEADER FILE
+QFrameRing is a fixed-capacity single-producer/single-consumer ring of captured frames.
+Producer (capture thread) calls push(...), consumer (processing thread) calls pop().
+When the ring is full, push(...) either drops the oldest queued frame or refuses the new one,
+in accordance with the DropPolicy. Only atomic operations are used, so neither side ever blocks.
+Ring does not own frames, they belong to QFramePool and ownership is handed over by push/pop.
+------------------------------------------------------------------------------------------------------*/
+
+#ifndef QFRAMERING_H
+#define QFRAMERING_H
+//------------------------------------------------------------------------------------------------------
+
+#include <QAtomicInt>
+#include <QAtomicPointer>
+#include <opencv2/opencv.hpp>
+
+#define DEFAULT_FRAME_RING_CAPACITY 4 // in frames, will be rounded up to power of two
+
+//------------------------------------------------------------------------------------------------------
+
+struct QCapturedFrame
+{
+    cv::Mat image;      // frame data
+    double timestamp;   // time of capture in ms
+    quint32 number;     // sequential number of the frame since capture start
+    cv::Rect roi;       // region of interest found by detection stage, empty if detection stage is not used
+    QAtomicInt owners;  // the number of stages that hold the frame, see QFramePool
+};
+
+//------------------------------------------------------------------------------------------------------
+
+inline double getTimestamp() // returns tick based time in ms, the same clock is used for all frames captured from devices
+{
+    return cv::getTickCount() * 1000.0 / cv::getTickFrequency();
+}
+
+//------------------------------------------------------------------------------------------------------
+
+class QFrameRing
+{
+public:
+    enum DropPolicy { DropOldest, DropNewest };
+
+    explicit QFrameRing(quint32 capacity = DEFAULT_FRAME_RING_CAPACITY, DropPolicy policy = DropOldest);
+    ~QFrameRing();                                              // frames left in the ring are not released, drain it with pop() beforehand
+
+    bool push(QCapturedFrame *frame, QCapturedFrame **evicted); // producer side, returns false if frame was refused (DropNewest on full ring), evicted frame (DropOldest on full ring) is returned back to the caller
+    QCapturedFrame *pop();                                      // consumer side, returns NULL when ring is empty
+    bool requestNotification();                                 // producer side, returns true if the consumer should be woken up
+    void acknowledgeNotification();                             // consumer side, call it before draining
+
+    void setDropPolicy(DropPolicy policy);
+    DropPolicy getDropPolicy() const;
+    quint32 getCapacity() const;
+    quint32 getDepth() const;       // the number of frames that are waiting for consumer at the moment
+    quint32 getMaxDepth() const;    // the maximum depth observed by producer
+    quint32 getDrops() const;       // the number of frames dropped since construction or resetCounters()
+    void resetCounters();
+
+private:
+    QAtomicPointer<QCapturedFrame> *v_slots;
+    quint32 m_capacity;
+    quint32 m_mask;
+    QAtomicInt m_read;      // monotonic index of the next frame to pop, could be advanced by both sides
+    QAtomicInt m_write;     // monotonic index of the next frame to push, advanced by producer only
+    QAtomicInt m_policy;
+    QAtomicInt m_drops;
+    QAtomicInt m_maxDepth;
+    QAtomicInt m_notified;
+
+    QFrameRing(const QFrameRing &);
+    QFrameRing& operator=(const QFrameRing &);
+};
+
+//------------------------------------------------------------------------------------------------------
+#endif // QFRAMERING_H
@@ -11,57 +11,65 @@ QHarmonicProcessorMap::QHarmonicProcessorMap(QObject *parent, quint32 width, qui
     m_updations(0),
     m_min(DEFAULT_MIN),
     m_max(DEFAULT_MAX),
-    m_cell(0),
     m_type(VPGMap)
 {
     v_map = new qreal[m_length]; // 0...width*height-1
     v_outputmap = new qreal[m_length];
     v_processors = new QHarmonicProcessor[m_length]; // 0...width*height-1
 
-    qWarning("idealThreadCount() for system return %d", QThread::idealThreadCount());
-    m_threadCount = QThread::idealThreadCount();
-    v_threads = new QThread[m_threadCount];
+    m_bufferLength = v_processors[0].getBufferLength();
+    m_bins = m_bufferLength/2 + 1;
+    m_batchPlan = FFTPlanCache::getRealBatchPlan(m_bufferLength, m_length);
+    v_windows = (qreal*) fftw_malloc(sizeof(qreal) * m_bufferLength * m_length);
+    v_spectra = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * m_bins * m_length);
+    v_power = new qreal[m_bins * m_length];
+    v_duration = new qreal[m_length];
+    v_bottom = new int[m_length];
+    v_top = new int[m_length];
+    v_maxIndex = new int[m_length];
+    v_maxPower = new qreal[m_length];
+    v_totalPower = new qreal[m_length];
+    v_signalPower = new qreal[m_length];
+    v_noisePower = new qreal[m_length];
+    v_powerIndex = new qreal[m_length];
+    for(quint32 i = 0; i < m_bufferLength * m_length; i++)
+        v_windows[i] = 0.0; // rows of PCA mode keep old counts when PCA fails, as v_HeartForFFT of a processor does
+    connect(this, SIGNAL(updateMap()), this, SLOT(computeHeartRates())); // updateMap() is emitted by the clock, so the call is queued to the thread of the map, where cells are enrolled
 
     for(quint32 i = 0; i < m_length; i++)
     {
         v_processors[i].setID(i); // needs for control in whitch cell of the map write particular snr value
-        v_processors[i].moveToThread(&v_threads[ i % m_threadCount ]);
-        connect(this, SIGNAL(updateMap()), &v_processors[i], SLOT(computeHeartRate()));
+        v_processors[i].setParent(this); // moveToThread(...) of the map moves them too, so setters are direct calls between computeHeartRates() and EnrollData(...)
         connect(this, SIGNAL(setEstimationInterval(int)), &v_processors[i], SLOT(setEstiamtionInterval(int)));
         connect(this, SIGNAL(changeColorChannel(int)), &v_processors[i], SLOT(switchColorMode(int)));
         connect(this, SIGNAL(updatePCAMode(bool)), &v_processors[i], SLOT(setPCAMode(bool)));
     }
-    for(quint16 i = 0; i < m_threadCount ; i++)
-    {
-        v_threads[i].start();
-    }
 }
 
 QHarmonicProcessorMap::~QHarmonicProcessorMap()
 {
-    for(quint16 i = 0; i < m_threadCount; i++)
-    {
-        v_threads[i].quit();
-    }
-    for(quint16 i = 0; i < m_threadCount; i++)
-    {
-        v_threads[i].wait();
-    }
     delete[] v_map;
     delete[] v_outputmap;
-    delete[] v_processors;
-    delete[] v_threads;
+    delete[] v_processors; // every processor removes itself from children of the map
+    fftw_free(v_windows);
+    fftw_free(v_spectra);
+    delete[] v_power;
+    delete[] v_duration;
+    delete[] v_bottom;
+    delete[] v_top;
+    delete[] v_maxIndex;
+    delete[] v_maxPower;
+    delete[] v_totalPower;
+    delete[] v_signalPower;
+    delete[] v_noisePower;
+    delete[] v_powerIndex;
 }
 
-void QHarmonicProcessorMap::updateHarmonicProcessor(unsigned long red, unsigned long green, unsigned long blue, unsigned long area, double period)
+void QHarmonicProcessorMap::updateHarmonicProcessors(const QMapFrame *frame)
 {
-    v_processors[m_cell].EnrollData(red,green,blue,area,period);
-    /*
-      connect(this, SIGNAL(dataArrived(ulong,ulong,ulong,ulong,double)), &v_processors[m_cell], SLOT(EnrollData(ulong,ulong,ulong,ulong,double)));
-      emit dataArrived(red,green,blue,area,period);
-      disconnect(this, SIGNAL(dataArrived(ulong,ulong,ulong,ulong,double)), &v_processors[m_cell], SLOT(EnrollData(ulong,ulong,ulong,ulong,double)));
-    */
-    m_cell = (++m_cell) % m_length;
+    const quint32 count = qMin(frame->getCount(), m_length);
+    for(quint32 i = 0; i < count; i++)
+        v_processors[i].EnrollData(frame->red[i], frame->green[i], frame->blue[i], frame->area, frame->period);
 }
 
 void QHarmonicProcessorMap::updateCell(quint32 id, qreal value)
@@ -128,4 +136,88 @@ void QHarmonicProcessorMap::setMapType(MapType type_id, bool snrControl)
 
 }
 
+void QHarmonicProcessorMap::computeHeartRates()
+{
+    cv::parallel_for_(cv::Range(0, (int)m_length), WindowBody(this)); // PCA basis of every cell is the costly part in PCA mode
+
+    int bottom = m_bufferLength; // union of bands of all cells
+    int top = 0;
+    for(quint32 i = 0; i < m_length; i++)
+    {
+        bottom = qMin(bottom, v_bottom[i]);
+        top = qMax(top, v_top[i]);
+        v_totalPower[i] = 0.0;
+        v_maxPower[i] = 0.0;
+        v_maxIndex[i] = 0;
+        v_signalPower[i] = 0.0;
+        v_noisePower[i] = 0.0;
+        v_powerIndex[i] = 0.0;
+    }
+
+    fftw_execute_dft_r2c(m_batchPlan, v_windows, v_spectra);
+
+    // loops over cells are branchless and contiguous, so the compiler could vectorize them
+    for(quint32 k = 0; k < m_bins; k++)
+    {
+        const fftw_complex *spectrum = v_spectra + k*m_length;
+        qreal *power = v_power + k*m_length;
+        for(quint32 i = 0; i < m_length; i++)
+        {
+            power[i] = spectrum[i][0]*spectrum[i][0] + spectrum[i][1]*spectrum[i][1];
+            v_totalPower[i] += power[i];
+        }
+    }
+    for(int k = bottom + HALF_INTERVAL; k < top - HALF_INTERVAL; k++) // the same search QHarmonicProcessor::computeHeartRate() makes
+    {
+        const qreal *power = v_power + k*m_length;
+        for(quint32 i = 0; i < m_length; i++)
+        {
+            const bool greater = (k >= v_bottom[i] + HALF_INTERVAL) && (k < v_top[i] - HALF_INTERVAL) && (power[i] > v_maxPower[i]);
+            v_maxPower[i] = greater ? power[i] : v_maxPower[i];
+            v_maxIndex[i] = greater ? k : v_maxIndex[i];
+        }
+    }
+    for(int k = bottom; k < top; k++)
+    {
+        const qreal *power = v_power + k*m_length;
+        for(quint32 i = 0; i < m_length; i++)
+        {
+            const bool band = (k >= v_bottom[i]) && (k < v_top[i]);
+            const bool peak = (k >= v_maxIndex[i] - HALF_INTERVAL) && (k <= v_maxIndex[i] + HALF_INTERVAL);
+            const qreal signal = (band && peak) ? power[i] : 0.0;
+            v_signalPower[i] += signal;
+            v_powerIndex[i] += k * signal;
+            v_noisePower[i] += (band && !peak) ? power[i] : 0.0;
+        }
+    }
+
+    for(quint32 i = 0; i < m_length; i++) // powers are normalized only here, the search does not depend on scale
+    {
+        const qreal norm = 1.0 / v_totalPower[i];
+        v_processors[i].applyHeartBand(v_duration[i], v_maxIndex[i], v_signalPower[i] * norm, v_noisePower[i] * norm, v_powerIndex[i] * norm);
+    }
+}
+
+//==========================================================================================================
+
+QHarmonicProcessorMap::WindowBody::WindowBody(QHarmonicProcessorMap *map):
+    pt_map(map)
+{
+}
+
+void QHarmonicProcessorMap::WindowBody::operator()(const cv::Range &range) const
+{
+    for(int i = range.start; i < range.end; i++)
+    {
+        QHarmonicProcessor &processor = pt_map->v_processors[i];
+        processor.prepareHeartWindow(pt_map->v_windows + i*pt_map->m_bufferLength);
+        pt_map->v_duration[i] = processor.getHeartBufferDuration();
+        quint16 bottom_bound;
+        quint16 top_bound;
+        processor.getHeartBand(pt_map->v_duration[i], bottom_bound, top_bound);
+        pt_map->v_bottom[i] = bottom_bound;
+        pt_map->v_top[i] = top_bound;
+    }
+}
+
 //==========================================================================================================
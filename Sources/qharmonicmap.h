@@ -2,9 +2,10 @@
 #define QHARMONICMAP_H
 
 #include <QObject>
-#include <QThread>
+#include <opencv2/opencv.hpp>
 
 #include "qharmonicprocessor.h"
+#include "qmapframe.h"
 
 class QHarmonicProcessorMap: public QObject
 {
@@ -18,14 +19,14 @@ public:
 signals:
     void updateMap();
     void mapUpdated(const qreal *pointer, quint32 width, quint32 height, qreal max, qreal min);
-    void dataArrived(unsigned long red, unsigned long green, unsigned long blue, unsigned long area, double period);
     void changeColorChannel(int value);
     void updatePCAMode(bool value);
     void setEstimationInterval(int value);
 
 public slots:
-    void updateHarmonicProcessor(unsigned long red, unsigned long green, unsigned long blue, unsigned long area, double period);
+    void updateHarmonicProcessors(const QMapFrame *frame); // enrolls all cells of the frame at once
     void setMapType(MapType type_id, bool snrControl);
+    void computeHeartRates(); // transforms windows of all cells by one batched FFT, then evaluates bands of all cells at once, it is connected to updateMap()
 
 private:
     quint32 m_cellNum;
@@ -34,15 +35,37 @@ private:
     quint32 m_length;
     qreal *v_map;
     qreal *v_outputmap;
-    QHarmonicProcessor *v_processors;
-    QThread *v_threads;
+    QHarmonicProcessor *v_processors; // children of the map, so they live in the thread of the map
     quint32 m_updations;
     qreal m_min;
     qreal m_max;
-    quint32 m_cell;
-    quint16 m_threadCount;
     MapType m_type;
 
+    quint32 m_bufferLength; // window length of processors
+    quint32 m_bins; // m_bufferLength/2 + 1
+    fftw_plan m_batchPlan; // owned by FFTPlanCache
+    qreal *v_windows; // m_length rows of m_bufferLength counts, fftw_malloc(...)
+    fftw_complex *v_spectra; // m_bins rows of m_length bins, bin-major, so loops over cells are contiguous
+    qreal *v_power; // the same layout as v_spectra
+    qreal *v_duration; // per cell arrays
+    int *v_bottom;
+    int *v_top;
+    int *v_maxIndex;
+    qreal *v_maxPower;
+    qreal *v_totalPower;
+    qreal *v_signalPower;
+    qreal *v_noisePower;
+    qreal *v_powerIndex;
+
+    class WindowBody : public cv::ParallelLoopBody
+    {
+    public:
+        WindowBody(QHarmonicProcessorMap *map);
+        void operator()(const cv::Range &range) const; // prepares windows and bands of the cells of range, cells are independent
+    private:
+        QHarmonicProcessorMap *pt_map;
+    };
+
 private slots:
     void updateCell(quint32 id, qreal value);
 };
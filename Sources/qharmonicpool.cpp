@@ -0,0 +1,161 @@
+/*------------------------------------------------------------------------------------------------------
+Taranov Alex, 2015									     SOURCE FILE
+QHarmonicProcessorPool keeps one QHarmonicProcessor for every region of QRegionFrame.
+Processor is created when a region id appears in the frame and is removed when the id disappears,
+removed processors are reset and kept for the next ids, so FFT plans and buffers are not reallocated
+when subjects come and go. Processors are spread over a fixed set of threads, so regions are analysed in parallel.
+Sums are passed to processors by queued calls, the pool thread never waits for them.
+------------------------------------------------------------------------------------------------------*/
+
+#include "qharmonicpool.h"
+
+//------------------------------------------------------------------------------------------------------
+
+QHarmonicProcessorPool::QHarmonicProcessorPool(QObject *parent, quint32 length_of_data, quint32 length_of_buffer):
+    QObject(parent),
+    m_nextThread(0),
+    m_dataLength(length_of_data),
+    m_bufferLength(length_of_buffer),
+    m_colorChannel(QHarmonicProcessor::Green),
+    m_pcaFlag(false),
+    m_slidingDFTFlag(false),
+    m_frameCounter(0)
+{
+    m_threadCount = qMax(QThread::idealThreadCount(), 1);
+    v_threads = new QThread[m_threadCount];
+    for(quint16 i = 0; i < m_threadCount; i++)
+    {
+        v_threads[i].start();
+    }
+}
+
+//------------------------------------------------------------------------------------------------------
+
+QHarmonicProcessorPool::~QHarmonicProcessorPool()
+{
+    for(quint16 i = 0; i < m_threadCount; i++)
+    {
+        v_threads[i].quit();
+    }
+    for(quint16 i = 0; i < m_threadCount; i++)
+    {
+        v_threads[i].wait();
+    }
+    qDeleteAll(m_processors); // threads have finished, so processors could be deleted from here
+    qDeleteAll(v_spare);
+    delete[] v_threads;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+QHarmonicProcessor *QHarmonicProcessorPool::createProcessor(quint32 id)
+{
+    QHarmonicProcessor *processor;
+    if(!v_spare.isEmpty()) // it lives on its thread already, calls are queued before the first EnrollData(...)
+    {
+        processor = v_spare.takeLast();
+        QMetaObject::invokeMethod(processor, "setID", Qt::QueuedConnection, Q_ARG(quint32, id));
+        QMetaObject::invokeMethod(processor, "switchColorMode", Qt::QueuedConnection, Q_ARG(int, m_colorChannel));
+        QMetaObject::invokeMethod(processor, "setPCAMode", Qt::QueuedConnection, Q_ARG(bool, m_pcaFlag));
+        QMetaObject::invokeMethod(processor, "setSlidingDFT", Qt::QueuedConnection, Q_ARG(bool, m_slidingDFTFlag));
+    }
+    else
+    {
+        processor = new QHarmonicProcessor(NULL, m_dataLength, m_bufferLength);
+        processor->setID(id);
+        processor->switchColorMode(m_colorChannel); // before moveToThread(...), so direct calls are safe
+        processor->setPCAMode(m_pcaFlag);
+        processor->setSlidingDFT(m_slidingDFTFlag);
+        processor->moveToThread(&v_threads[ m_nextThread++ % m_threadCount ]);
+    }
+    connect(this, SIGNAL(updateRates()), processor, SLOT(computeHeartRate()));
+    connect(this, SIGNAL(updateRates()), processor, SLOT(computeBreathRate()));
+    connect(this, SIGNAL(changeColorChannel(int)), processor, SLOT(switchColorMode(int)));
+    connect(this, SIGNAL(updatePCAMode(bool)), processor, SLOT(setPCAMode(bool)));
+    connect(this, SIGNAL(updateSlidingDFT(bool)), processor, SLOT(setSlidingDFT(bool)));
+    connect(processor, SIGNAL(heartRateMeasured(quint32,qreal,qreal,bool)), this, SIGNAL(heartRateUpdated(quint32,qreal,qreal,bool)));
+    m_processors.insert(id, processor);
+    return processor;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void QHarmonicProcessorPool::removeProcessor(quint32 id)
+{
+    QHarmonicProcessor *processor = m_processors.take(id);
+    if(processor)
+    {
+        disconnect(processor, 0, this, 0);
+        disconnect(this, 0, processor, 0);
+        if(v_spare.size() < MAX_SPARE_PROCESSORS)
+        {
+            QMetaObject::invokeMethod(processor, "reset", Qt::QueuedConnection); // after the calls that have been queued already
+            v_spare.append(processor);
+        }
+        else
+            processor->deleteLater(); // on its own thread, after the calls that have been queued already
+        m_lastSeen.remove(id);
+        emit processorRemoved(id);
+    }
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void QHarmonicProcessorPool::updateHarmonicProcessors(const QRegionFrame *frame)
+{
+    m_frameCounter++;
+    for(quint32 i = 0; i < frame->getCount(); i++)
+    {
+        const quint32 id = frame->id[i];
+        QHarmonicProcessor *processor = m_processors.value(id, NULL);
+        if(processor == NULL)
+            processor = createProcessor(id);
+        m_lastSeen.insert(id, m_frameCounter);
+        if(frame->area[i] > 0) // region could be out of frame or have no skin pixels for a while
+            QMetaObject::invokeMethod(processor, "EnrollData", Qt::QueuedConnection, Q_ARG(quint64, frame->red[i]), Q_ARG(quint64, frame->green[i]), Q_ARG(quint64, frame->blue[i]), Q_ARG(quint64, frame->area[i]), Q_ARG(double, frame->period));
+    }
+    QList<quint32> ids = m_lastSeen.keys();
+    for(int i = 0; i < ids.size(); i++)
+        if(m_lastSeen.value(ids[i]) != m_frameCounter) // region has been removed
+            removeProcessor(ids[i]);
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void QHarmonicProcessorPool::switchColorMode(int value)
+{
+    m_colorChannel = value;
+    emit changeColorChannel(value);
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void QHarmonicProcessorPool::setPCAMode(bool value)
+{
+    m_pcaFlag = value;
+    emit updatePCAMode(value);
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void QHarmonicProcessorPool::setSlidingDFT(bool value)
+{
+    m_slidingDFTFlag = value;
+    emit updateSlidingDFT(value);
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void QHarmonicProcessorPool::clear()
+{
+    QList<quint32> ids = m_processors.keys();
+    for(int i = 0; i < ids.size(); i++)
+        removeProcessor(ids[i]);
+}
+
+//------------------------------------------------------------------------------------------------------
+
+quint32 QHarmonicProcessorPool::getCount() const
+{
+    return (quint32)m_processors.size();
+}
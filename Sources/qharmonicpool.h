@@ -0,0 +1,68 @@
+/*------------------------------------------------------------------------------------------------------
+Taranov Alex, 2015									     HEADER FILE
+QHarmonicProcessorPool keeps one QHarmonicProcessor for every region of QRegionFrame.
+Processor is created when a region id appears in the frame and is removed when the id disappears,
+removed processors are reset and kept for the next ids, so FFT plans and buffers are not reallocated
+when subjects come and go. Processors are spread over a fixed set of threads, so regions are analysed in parallel.
+Sums are passed to processors by queued calls, the pool thread never waits for them.
+------------------------------------------------------------------------------------------------------*/
+
+#ifndef QHARMONICPOOL_H
+#define QHARMONICPOOL_H
+//------------------------------------------------------------------------------------------------------
+
+#include <QObject>
+#include <QThread>
+#include <QHash>
+#include <QList>
+
+#include "qharmonicprocessor.h"
+#include "qregionframe.h"
+
+#define MAX_SPARE_PROCESSORS 8
+
+//------------------------------------------------------------------------------------------------------
+
+class QHarmonicProcessorPool : public QObject
+{
+    Q_OBJECT
+public:
+    QHarmonicProcessorPool(QObject *parent = NULL, quint32 length_of_data = 256, quint32 length_of_buffer = 256);
+    ~QHarmonicProcessorPool();
+
+signals:
+    void updateRates();         // connect it to the clock, every processor computes heart and breath rates on its own thread
+    void heartRateUpdated(quint32 id, qreal freq_value, qreal snr_value, bool reliable_data_flag);
+    void processorRemoved(quint32 id);
+    void changeColorChannel(int value);
+    void updatePCAMode(bool value);
+    void updateSlidingDFT(bool value);
+
+public slots:
+    void updateHarmonicProcessors(const QRegionFrame *frame); // enrolls every region into the processor of its id
+    void switchColorMode(int value);    // applies to existing and future processors
+    void setPCAMode(bool value);
+    void setSlidingDFT(bool value);     // applies to existing and future processors
+    void clear();
+    quint32 getCount() const;
+
+private:
+    QHash<quint32, QHarmonicProcessor *> m_processors;
+    QList<QHarmonicProcessor *> v_spare;    // removed processors, they keep their threads
+    QThread *v_threads;
+    quint16 m_threadCount;
+    quint32 m_nextThread;       // processors are assigned to threads by turns
+    quint32 m_dataLength;
+    quint32 m_bufferLength;
+    int m_colorChannel;
+    bool m_pcaFlag;
+    bool m_slidingDFTFlag;
+    QHash<quint32, quint32> m_lastSeen; // frame number when the region was present last time
+    quint32 m_frameCounter;
+
+    QHarmonicProcessor *createProcessor(quint32 id);
+    void removeProcessor(quint32 id);
+};
+
+//------------------------------------------------------------------------------------------------------
+#endif // QHARMONICPOOL_H
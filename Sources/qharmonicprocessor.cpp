@@ -2,9 +2,10 @@
 #include <QXmlStreamReader>
 #include <QXmlStreamAttributes>
 #include <QFile>
+#include <algorithm>
 
 //----------------------------------------------------------------------------------------------------------
-QHarmonicProcessor::QHarmonicProcessor(QObject *parent, quint16 length_of_data, quint16 length_of_buffer) :
+QHarmonicProcessor::QHarmonicProcessor(QObject *parent, quint32 length_of_data, quint32 length_of_buffer) :
     QObject(parent),
     m_DataLength(length_of_data),
     m_BufferLength(length_of_buffer),
@@ -29,275 +30,283 @@ QHarmonicProcessor::QHarmonicProcessor(QObject *parent, quint16 length_of_data,
     m_BreathAverageInterval(DEFAULT_BREATH_AVERAGE),
     m_BreathCNInterval(DEFAULT_BREATH_NORMALIZATION_INTERVAL),
     m_pruningFlag(false),
-    m_SPO2(0.95)
+    m_SPO2(0.95),
+    m_slidingDFTFlag(false)
 {
+    m_RingLength = 1; // power of two, so ring indexes are masks and the second half of mirrored histories continues the first one
+    while(m_RingLength < m_DataLength)
+        m_RingLength <<= 1;
+    m_RingMask = m_RingLength - 1;
+    if(m_BufferLength > m_DataLength)
+        m_BufferLength = m_DataLength;
+
     // Memory allocation
-    v_RawCh1 = new qreal[m_DataLength];
-    v_RawCh2 = new qreal[m_DataLength];
-    v_HeartSignal = new qreal[m_DataLength];
-    v_HeartTime = new qreal[m_DataLength];
-    v_HeartCNSignal = new qreal[DIGITAL_FILTER_LENGTH];
-    v_HeartForFFT = new qreal[m_BufferLength];
+    v_RawCh1 = new qreal[m_RingLength];
+    v_RawCh2 = new qreal[m_RingLength];
+    v_HeartSignal = new qreal[2 * m_RingLength];
+    v_HeartTime = new qreal[2 * m_RingLength];
+    v_HeartCNSignal = new qreal[DIGITAL_FILTER_BUFFER];
+    m_FFTPlan = FFTPlanCache::getRealPlan(m_BufferLength);
+    v_HeartForFFT = (qreal*) fftw_malloc(sizeof(qreal) * m_BufferLength);
     v_HeartSpectrum = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * (m_BufferLength/2 + 1));
     v_HeartAmplitude = new qreal[m_BufferLength/2 + 1];
-    m_HeartPlan = fftw_plan_dft_r2c_1d(m_BufferLength, v_HeartForFFT, v_HeartSpectrum, FFTW_ESTIMATE);
-    v_BinaryOutput = new qreal[m_DataLength];
-    v_SmoothedSignal = new qreal[DIGITAL_FILTER_LENGTH];  
-
-    v_RawBreathSignal = new qreal[m_DataLength];
-    v_BreathSignal = new qreal[m_DataLength];
-    v_BreathTime = new qreal[m_DataLength];
-    v_BreathForFFT = new qreal[m_BufferLength];
+    v_BinaryOutput = new qreal[2 * m_RingLength];
+    v_SmoothedSignal = new qreal[DIGITAL_FILTER_BUFFER];
+    for(quint8 c = 0; c < 3; c++)
+        v_RawColor[c] = new qreal[2 * m_RingLength];
+
+    v_RawBreathSignal = new qreal[m_RingLength];
+    v_BreathSignal = new qreal[2 * m_RingLength];
+    v_BreathTime = new qreal[2 * m_RingLength];
+    v_BreathForFFT = (qreal*) fftw_malloc(sizeof(qreal) * m_BufferLength);
     v_BreathAmplitude = new qreal[m_BufferLength/2 + 1];
     v_BreathSpectrum = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * (m_BufferLength/2 + 1));
-    m_BreathPlan = fftw_plan_dft_r2c_1d(m_BufferLength, v_BreathForFFT, v_BreathSpectrum, FFTW_ESTIMATE);;
 
-    v_BlueForFFT = new qreal[m_BufferLength];
+    v_BlueForFFT = (qreal*) fftw_malloc(sizeof(qreal) * m_BufferLength);
     v_BlueSpectrum = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * (m_BufferLength/2 + 1));
-    m_BluePlan = fftw_plan_dft_r2c_1d(m_BufferLength, v_BlueForFFT, v_BlueSpectrum, FFTW_ESTIMATE);
-    v_RedForFFT = new qreal[m_BufferLength];
+    v_RedForFFT = (qreal*) fftw_malloc(sizeof(qreal) * m_BufferLength);
     v_RedSpectrum = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * (m_BufferLength/2 + 1));
-    m_RedPlan = fftw_plan_dft_r2c_1d(m_BufferLength, v_RedForFFT, v_RedSpectrum, FFTW_ESTIMATE);
-
-    // Vectors initialization
-    for (quint16 i = 0; i < m_DataLength; i++)
-    {
-        v_RawCh1[i] = 0.0; // it should be equal to zero at start
-        v_RawCh2[i] = 0.0; // it should be equal to zero at start
-        v_HeartTime[i] = 35.0; // just for ensure that at the begining there is not any "division by zero"
-        v_BreathTime[i] = 35.0;
-        v_RawBreathSignal[i]= 0.0;
-        v_BreathSignal[i] = 0.0;
-        v_HeartSignal[i] = 0.0;
-        if(i % 4)
-        {
-            v_BinaryOutput[i] = 1.0;
-        }
-        else
-        {
-            v_BinaryOutput[i] = -1.0;
-        }
-    }
-
-    for(quint16 i = 0; i < DIGITAL_FILTER_LENGTH; i++)
-    {
-        v_HeartCNSignal[i] = 0.0;
-    }
 
     // Memory allocation block for ALGLIB arrays
     PCA_RAW_RGB.setlength(m_BufferLength, 3); // 3 because RED, GREEN and BLUE colors represent 3 independent variables
     PCA_Variance.setlength(3);
     PCA_Basis.setlength(3, 3);
     PCA_Info = 0;
+
+    m_HeartDFT.setLength(m_BufferLength);
+    m_BreathDFT.setLength(m_BufferLength);
+
+    reset(); // vectors initialization
 }
 
 //----------------------------------------------------------------------------------------------------------
 
 QHarmonicProcessor::~QHarmonicProcessor()
 {
-    fftw_destroy_plan(m_HeartPlan);
     delete[] v_RawCh1;
     delete[] v_RawCh2;
     delete[] v_HeartSignal;
     delete[] v_HeartTime;
     delete[] v_HeartCNSignal;
-    delete[] v_HeartForFFT;
+    fftw_free(v_HeartForFFT);
     fftw_free(v_HeartSpectrum);
     delete[] v_HeartAmplitude;
     delete[] v_BinaryOutput;
-    delete[] v_SmoothedSignal;  
+    delete[] v_SmoothedSignal;
+    for(quint8 c = 0; c < 3; c++)
+        delete[] v_RawColor[c];
 
-    fftw_destroy_plan(m_BreathPlan);
     delete[] v_RawBreathSignal;
     delete[] v_BreathSignal;
     delete[] v_BreathTime;
-    delete[] v_BreathForFFT;
+    fftw_free(v_BreathForFFT);
     delete[] v_BreathAmplitude;
     fftw_free(v_BreathSpectrum);
 
-    delete[] v_BlueForFFT;
-    fftw_destroy_plan(m_BluePlan);
+    fftw_free(v_BlueForFFT);
     fftw_free(v_BlueSpectrum);
-    delete[] v_RedForFFT;
-    fftw_destroy_plan(m_RedPlan);
+    fftw_free(v_RedForFFT);
     fftw_free(v_RedSpectrum);
 }
 
 //----------------------------------------------------------------------------------------------------------
 
-void QHarmonicProcessor::EnrollData(unsigned long red, unsigned long green, unsigned long blue, unsigned long area, double time)
+void QHarmonicProcessor::reset()
+{
+    curpos = 0;
+    m_HeartSNR = -5.0;
+    m_HeartRate = 80.0;
+    m_BreathRate = 0.0;
+    m_BreathSNR = -5.0;
+    m_zerocrossing = 0;
+    m_PulseCounter = 4;
+    m_output = 1.0;
+    m_BreathStrobeCounter = 0;
+    m_BreathCurpos = 0;
+    m_SPO2 = 0.95;
+
+    for (quint32 i = 0; i < m_RingLength; i++)
+    {
+        v_RawCh1[i] = 0.0; // it should be equal to zero at start
+        v_RawCh2[i] = 0.0; // it should be equal to zero at start
+        writeMirrored(v_HeartTime, i, 35.0); // just for ensure that at the begining there is not any "division by zero"
+        writeMirrored(v_BreathTime, i, 35.0);
+        v_RawBreathSignal[i]= 0.0;
+        writeMirrored(v_BreathSignal, i, 0.0);
+        writeMirrored(v_HeartSignal, i, 0.0);
+        for(quint8 c = 0; c < 3; c++)
+            writeMirrored(v_RawColor[c], i, 0.0);
+        if(i % 4)
+        {
+            writeMirrored(v_BinaryOutput, i, 1.0);
+        }
+        else
+        {
+            writeMirrored(v_BinaryOutput, i, -1.0);
+        }
+    }
+
+    for(quint16 i = 0; i < DIGITAL_FILTER_BUFFER; i++)
+    {
+        v_HeartCNSignal[i] = 0.0;
+        v_SmoothedSignal[i] = 0.0;
+    }
+
+    rebuildStatistics();
+    rebuildBreathStatistics();
+    m_HeartDFT.clear(); // bands will be anchored on the next spectrum reading
+    m_BreathDFT.clear();
+}
+
+//----------------------------------------------------------------------------------------------------------
+
+void QHarmonicProcessor::rebuildStatistics()
 {
+    for(quint8 c = 0; c < 3; c++)
+    {
+        v_RawStats[c].clear();
+        for(quint16 i = m_estimationInterval; i > 0; i--)
+            v_RawStats[c].push(v_RawColor[c][loop(curpos - i)]);
+    }
+    m_Ch1Stats.clear();
+    m_Ch2Stats.clear();
+    for(quint16 i = m_estimationInterval; i > 0; i--)
+    {
+        m_Ch1Stats.push(v_RawCh1[loop(curpos - i)]);
+        m_Ch2Stats.push(v_RawCh2[loop(curpos - i)]);
+    }
+    m_BreathAverageStats.clear();
+    for(quint16 i = m_BreathAverageInterval; i > 0; i--)
+        m_BreathAverageStats.push(v_RawCh1[loop(curpos - i)]);
+}
 
-    const quint16 pos = loopBuffer(curpos);   //a variable for position storing
+//----------------------------------------------------------------------------------------------------------
+
+void QHarmonicProcessor::rebuildBreathStatistics()
+{
+    m_BreathCNStats.clear();
+    for(quint16 i = m_BreathCNInterval; i > 0; i--)
+        m_BreathCNStats.push(v_RawBreathSignal[loop(m_BreathCurpos - i)]);
+}
+
+//----------------------------------------------------------------------------------------------------------
+
+void QHarmonicProcessor::EnrollData(quint64 red, quint64 green, quint64 blue, quint64 area, double time)
+{
+
+    if(curpos == 0) // rounding errors of the sliding statistics are dropped once per turn of the buffers
+        rebuildStatistics();
+
+    qreal v_Color[3] = { (qreal)red / area, (qreal)green / area, (qreal)blue / area };
+    const qreal ch1Out = v_RawCh1[loop(curpos - m_estimationInterval)]; // counts that leave the windows are read before the new counts overwrite them
+    const qreal ch2Out = v_RawCh2[loop(curpos - m_estimationInterval)];
+    const qreal breathOut = v_RawCh1[loop(curpos - m_BreathAverageInterval)];
 
     qreal m_MeanCh1 = 0.0;    //a variable for mean value in channel1 storing
     qreal m_MeanCh2 = 0.0;    //a variable for mean value in channel2 storing
-    qreal m_MeanCh3 = 0.0;
-    quint16 temp_pos;
 
-    PCA_RAW_RGB(pos, 0) = (qreal)red / area;
-    PCA_RAW_RGB(pos, 1) = (qreal)green / area;
-    PCA_RAW_RGB(pos, 2) = (qreal)blue / area;
+    for(quint8 c = 0; c < 3; c++)
+        v_RawStats[c].slide(v_Color[c], v_RawColor[c][loop(curpos - m_estimationInterval)]);
 
     //color pruning block, based on statistics
     if(m_pruningFlag)
     {
-        for(quint16 i = 0; i < m_estimationInterval; i++)
+        for(quint8 c = 0; c < 3; c++)
         {
-            temp_pos = loopBuffer(curpos - i);
-            m_MeanCh1 += PCA_RAW_RGB(temp_pos, 0);
-            m_MeanCh2 += PCA_RAW_RGB(temp_pos, 1);
-            m_MeanCh3 += PCA_RAW_RGB(temp_pos, 2);
-        }
-        m_MeanCh1 /= m_estimationInterval;
-        m_MeanCh2 /= m_estimationInterval;
-        m_MeanCh3 /= m_estimationInterval;
-        qreal sko1 = 0.0;
-        qreal sko2 = 0.0;
-        qreal sko3 = 0.0;
-        for(quint16 i = 0; i < m_estimationInterval; i++)
-        {
-            temp_pos = loopBuffer(curpos - i);
-            sko1 += (PCA_RAW_RGB(temp_pos, 0) - m_MeanCh1)*(PCA_RAW_RGB(temp_pos, 0) - m_MeanCh1);
-            sko2 += (PCA_RAW_RGB(temp_pos, 1) - m_MeanCh2)*(PCA_RAW_RGB(temp_pos, 1) - m_MeanCh2);
-            sko3 += (PCA_RAW_RGB(temp_pos, 2) - m_MeanCh3)*(PCA_RAW_RGB(temp_pos, 2) - m_MeanCh3);
+            const qreal mean = v_RawStats[c].getMean();
+            const qreal sko = v_RawStats[c].getSD();
+            if( ((v_Color[c] - mean) < -PRUNING_SKO_COEFF*sko) || ((v_Color[c] - mean) > PRUNING_SKO_COEFF*sko) )
+            {
+                v_RawStats[c].replace(v_Color[c], mean);
+                v_Color[c] = mean;
+            }
         }
-        sko1 = sqrt(sko1 / (m_estimationInterval - 1));
-        sko2 = sqrt(sko2 / (m_estimationInterval - 1));
-        sko3 = sqrt(sko3 / (m_estimationInterval - 1));
-        if( ((PCA_RAW_RGB(pos, 0) - m_MeanCh1) < -PRUNING_SKO_COEFF*sko1) || ((PCA_RAW_RGB(pos, 0) - m_MeanCh1) > PRUNING_SKO_COEFF*sko1) )
-            PCA_RAW_RGB(pos, 0) = m_MeanCh1;
-        if( ((PCA_RAW_RGB(pos, 1) - m_MeanCh2) < -PRUNING_SKO_COEFF*sko2) || ((PCA_RAW_RGB(pos, 1) - m_MeanCh2) > PRUNING_SKO_COEFF*sko2) )
-            PCA_RAW_RGB(pos, 1) = m_MeanCh2;
-        if( ((PCA_RAW_RGB(pos, 2) - m_MeanCh3) < -PRUNING_SKO_COEFF*sko3) || ((PCA_RAW_RGB(pos, 2) - m_MeanCh3) > PRUNING_SKO_COEFF*sko3) )
-            PCA_RAW_RGB(pos, 2) = m_MeanCh3;
     }
+    for(quint8 c = 0; c < 3; c++)
+        writeMirrored(v_RawColor[c], curpos, v_Color[c]);
 
+    switch(m_ColorChannel) {
+        case RGB:
+            v_RawCh1[curpos] = v_Color[0] - v_Color[1];
+            v_RawCh2[curpos] = v_Color[0] + v_Color[1] - 2 * v_Color[2];
+            break;
+        case Red:
+            v_RawCh1[curpos] = v_Color[0];
+            break;
+        case Blue:
+            v_RawCh1[curpos] = v_Color[2];
+            break;
+        default: // Green and Experimental
+            v_RawCh1[curpos] = v_Color[1];
+            break;
+    }
+    m_Ch1Stats.slide(v_RawCh1[curpos], ch1Out);
+    m_Ch2Stats.slide(v_RawCh2[curpos], ch2Out); // not written out of RGB mode, then the window just follows the old counts
+    m_BreathAverageStats.slide(v_RawCh1[curpos], breathOut);
+    m_MeanCh1 = m_Ch1Stats.getMean();
+    m_MeanCh2 = m_Ch2Stats.getMean();
 
     if(m_ColorChannel == RGB) {
 
-        v_RawCh1[curpos] = PCA_RAW_RGB(pos, 0) - PCA_RAW_RGB(pos, 1);
-        v_RawCh2[curpos] = PCA_RAW_RGB(pos, 0) + PCA_RAW_RGB(pos, 1) - 2 * PCA_RAW_RGB(pos, 2);
-
-        m_MeanCh1 = 0.0;
-        m_MeanCh2 = 0.0;
-        for(quint16 i = 0; i < m_estimationInterval; i++)
-        {
-            temp_pos = loop(curpos - i);
-            m_MeanCh1 += v_RawCh1[temp_pos];
-            m_MeanCh2 += v_RawCh2[temp_pos];
-        }
-        m_MeanCh1 /= m_estimationInterval;
-        m_MeanCh2 /= m_estimationInterval;
-
-        qreal ch1_sko = 0.0;
-        qreal ch2_sko = 0.0;
-        for (unsigned int i = 0; i < m_estimationInterval; i++)
-        {
-            temp_pos = loop(curpos - i);
-            ch1_sko += (v_RawCh1[temp_pos] - m_MeanCh1)*(v_RawCh1[temp_pos] - m_MeanCh1);
-            ch2_sko += (v_RawCh2[temp_pos] - m_MeanCh2)*(v_RawCh2[temp_pos] - m_MeanCh2);
-        }
-        ch1_sko = sqrt(ch1_sko / (m_estimationInterval - 1));
+        qreal ch1_sko = m_Ch1Stats.getSD();
         if(ch1_sko < 0.01)
             ch1_sko = 1.0;
-        ch2_sko = sqrt(ch2_sko / (m_estimationInterval - 1));
+        qreal ch2_sko = m_Ch2Stats.getSD();
         if(ch2_sko < 0.01)
             ch2_sko = 1.0;
         v_HeartCNSignal[loopInput(curpos)] = (v_RawCh1[curpos] - m_MeanCh1) / ch1_sko  - (v_RawCh2[curpos] - m_MeanCh2) / ch2_sko;
 
     } else if(m_ColorChannel == Experimental) {
 
-        v_RawCh1[curpos] = PCA_RAW_RGB(pos, 1);
-
-        m_MeanCh1 = 0.0;
-        for(quint16 i = 0; i < m_estimationInterval; i++)
-        {
-            m_MeanCh1 += v_RawCh1[loop(curpos - i)];
-        }
-        m_MeanCh1 /= m_estimationInterval;
-
         v_HeartCNSignal[loopInput(curpos)] = (v_RawCh1[curpos] - m_MeanCh1);
 
     } else {
 
-        switch(m_ColorChannel) {
-            case Red:
-                v_RawCh1[curpos] = PCA_RAW_RGB(pos, 0);
-                break;
-            case Green:
-                v_RawCh1[curpos] = PCA_RAW_RGB(pos, 1);
-                break;
-            case Blue:
-                v_RawCh1[curpos] = PCA_RAW_RGB(pos, 2);
-                break;
-        }
-
-        m_MeanCh1 = 0.0;
-        for(quint16 i = 0; i < m_estimationInterval; i++)
-        {
-            m_MeanCh1 += v_RawCh1[loop(curpos - i)];
-        }
-        m_MeanCh1 /= m_estimationInterval;
-
-        qreal ch1_sko = 0.0;
-        for (quint16 i = 0; i < m_estimationInterval; i++)
-        {
-            temp_pos = loop(curpos - i);
-            ch1_sko += (v_RawCh1[temp_pos] - m_MeanCh1)*(v_RawCh1[temp_pos] - m_MeanCh1);
-        }
-        ch1_sko = sqrt(ch1_sko / (m_estimationInterval - 1));
+        qreal ch1_sko = m_Ch1Stats.getSD();
         if(ch1_sko < 0.01)
             ch1_sko = 1.0;
         v_HeartCNSignal[loopInput(curpos)] = (v_RawCh1[curpos] - m_MeanCh1)/ ch1_sko;
     }
 
-    v_HeartTime[curpos] = time;
-    emit TimeUpdated(v_HeartTime, m_DataLength);
+    writeMirrored(v_HeartTime, curpos, time);
+    emit TimeUpdated(getLatest(v_HeartTime, curpos, m_DataLength), m_DataLength); // plots get the last m_DataLength counts in time order
     //v_HeartSignal[curpos] = ( v_HeartCNSignal[loopInput(curpos)] + v_HeartSignal[loop(curpos - 1)] ) / 2.0;
-    v_HeartSignal[curpos] = ( v_HeartCNSignal[loopInput(curpos)] + v_HeartCNSignal[loopInput(curpos - 1)] + v_HeartCNSignal[loopInput(curpos - 2)] + v_HeartSignal[loop(curpos - 1)] ) / 4.0;
-    emit heartSignalUpdated(v_HeartSignal, m_DataLength);
+    const qreal heartOut = v_HeartSignal[loop(curpos - m_BufferLength)]; // leaves the window of m_HeartDFT
+    writeMirrored(v_HeartSignal, curpos, ( v_HeartCNSignal[loopInput(curpos)] + v_HeartCNSignal[loopInput(curpos - 1)] + v_HeartCNSignal[loopInput(curpos - 2)] + v_HeartSignal[loop(curpos - 1)] ) / 4.0);
+    slideSpectrum(m_HeartDFT, v_HeartSignal, curpos, heartOut);
+    emit heartSignalUpdated(getLatest(v_HeartSignal, curpos, m_DataLength), m_DataLength);
 
     ///------------------------------------------Breath signal part-------------------------------------------
-    v_BreathTime[m_BreathCurpos] += time;
+    writeMirrored(v_BreathTime, m_BreathCurpos, v_BreathTime[m_BreathCurpos] + time);
     m_BreathStrobeCounter =  (++m_BreathStrobeCounter) % m_BreathStrobe;
     if(m_BreathStrobeCounter ==  0)
     {
         ///Averaging from VPG
-        m_MeanCh1 = 0.0;
-        for(quint16 i = 0; i < m_BreathAverageInterval; i++)
-        {
-            m_MeanCh1 += v_RawCh1[loop(curpos - i)];
-        }
-        v_RawBreathSignal[m_BreathCurpos] = m_MeanCh1 / m_BreathAverageInterval;
+        if(m_BreathCurpos == 0)
+            rebuildBreathStatistics();
+        const qreal breathCNOut = v_RawBreathSignal[loop(m_BreathCurpos - m_BreathCNInterval)];
+        v_RawBreathSignal[m_BreathCurpos] = m_BreathAverageStats.getMean();
 
         ///Centering and normalization
-        m_MeanCh1 = 0.0;
-        for(quint16 i = 0; i < m_BreathCNInterval; i++)
-        {
-            m_MeanCh1 += v_RawBreathSignal[loop(m_BreathCurpos - i)];
-        }
-        m_MeanCh1 /= m_BreathCNInterval;
-        qreal temp_sko = 0.0;
-        for(quint16 i = 0; i < m_BreathCNInterval; i++)
-        {
-            temp_sko += (v_RawBreathSignal[loop(m_BreathCurpos - i)] - m_MeanCh1)*(v_RawBreathSignal[loop(m_BreathCurpos - i)] - m_MeanCh1);
-        }
-        temp_sko = sqrt(temp_sko / (m_BreathCNInterval - 1 ) );
+        m_BreathCNStats.slide(v_RawBreathSignal[m_BreathCurpos], breathCNOut);
+        m_MeanCh1 = m_BreathCNStats.getMean();
+        qreal temp_sko = m_BreathCNStats.getSD();
         if(temp_sko < 0.01)
             temp_sko = 1.0;
-        v_BreathSignal[m_BreathCurpos] = ((( v_RawBreathSignal[m_BreathCurpos] - m_MeanCh1 ) / temp_sko) + v_BreathSignal[loop(m_BreathCurpos - 1)] ) / 2.0;
+        const qreal breathSignalOut = v_BreathSignal[loop(m_BreathCurpos - m_BufferLength)]; // leaves the window of m_BreathDFT
+        writeMirrored(v_BreathSignal, m_BreathCurpos, ((( v_RawBreathSignal[m_BreathCurpos] - m_MeanCh1 ) / temp_sko) + v_BreathSignal[loop(m_BreathCurpos - 1)] ) / 2.0);
+        slideSpectrum(m_BreathDFT, v_BreathSignal, m_BreathCurpos, breathSignalOut);
         //v_BreathSignal[m_BreathCurpos] = (v_RawBreathSignal[m_BreathCurpos] - m_MeanCh1 ) / temp_sko;
-        emit breathSignalUpdated(v_BreathSignal, m_DataLength);
-        m_BreathCurpos = (++m_BreathCurpos) % m_DataLength;
-        v_BreathTime[m_BreathCurpos] = 0.0;
+        emit breathSignalUpdated(getLatest(v_BreathSignal, m_BreathCurpos, m_DataLength), m_DataLength);
+        m_BreathCurpos = loop(m_BreathCurpos + 1);
+        writeMirrored(v_BreathTime, m_BreathCurpos, 0.0);
     }
     ///--------------------------------------------End of breath signal part-------------------------------------------------
 
     qreal outputValue = 0.0;
     for(quint16 i = 0; i < DIGITAL_FILTER_LENGTH ; i++)
     {
-        outputValue += v_HeartCNSignal[i];
+        outputValue += v_HeartCNSignal[loopInput(curpos - i)];
     }
     v_SmoothedSignal[loopInput(curpos)] = outputValue / DIGITAL_FILTER_LENGTH;  
     v_Derivative[loopOnTwo(curpos)] = v_SmoothedSignal[loopInput(curpos)] - v_SmoothedSignal[loopInput(curpos - 1)];
@@ -309,8 +318,8 @@ void QHarmonicProcessor::EnrollData(unsigned long red, unsigned long green, unsi
             m_output *= -1.0;
         }
     }
-    v_BinaryOutput[curpos] = m_output; // note, however, that v_BinaryOutput accumulates phase delay about DIGITAL_FILTER_LENGTH
-    emit BinaryOutputUpdated(v_BinaryOutput, m_DataLength);
+    writeMirrored(v_BinaryOutput, curpos, m_output); // note, however, that v_BinaryOutput accumulates phase delay about DIGITAL_FILTER_LENGTH
+    emit BinaryOutputUpdated(getLatest(v_BinaryOutput, curpos, m_DataLength), m_DataLength);
     //----------------------------------------------------------------------------
 
     if(m_HeartSNRControlFlag)
@@ -334,77 +343,54 @@ void QHarmonicProcessor::EnrollData(unsigned long red, unsigned long green, unsi
 
     //----------------------------------------------------------------------------
 
-    emit CurrentValues(v_HeartSignal[curpos], PCA_RAW_RGB(pos, 0), PCA_RAW_RGB(pos, 1), PCA_RAW_RGB(pos, 2));
-    curpos = (++curpos) % m_DataLength; // for loop-like usage of ptData and the other arrays in this class
+    emit CurrentValues(v_HeartSignal[curpos], v_Color[0], v_Color[1], v_Color[2]);
+    curpos = loop(curpos + 1); // for loop-like usage of ptData and the other arrays in this class
 }
 
 //----------------------------------------------------------------------------------------------------------
 
 void QHarmonicProcessor::computeHeartRate()
 {
-    qint16 temp_position = curpos - 1;
-    qreal buffer_duration = 0.0; // for buffer duration accumulation without first time interval
+    const quint32 temp_position = curpos - 1;
+    const qreal buffer_duration = getHeartBufferDuration();
     if(f_PCA)
     {
-        alglib::pcabuildbasis(PCA_RAW_RGB, m_BufferLength, 3, PCA_Info, PCA_Variance, PCA_Basis);
-        if (PCA_Info == 1)
-        {
-            qreal mean0 = 0.0;
-            qreal mean1 = 0.0;
-            qreal mean2 = 0.0;
-            for (unsigned int i = 0; i < m_BufferLength; i++)
-            {
-                mean0 += PCA_RAW_RGB(i,0);
-                mean1 += PCA_RAW_RGB(i,1);
-                mean2 += PCA_RAW_RGB(i,2);
-            }
-            mean0 /= m_BufferLength;
-            mean1 /= m_BufferLength;
-            mean2 /= m_BufferLength;
-
-            qreal temp_sko = sqrt(PCA_Variance(0));
-            qint16 start = loopBuffer(temp_position) - (m_BufferLength - 1); // has to be signed
-            for (quint16 i = 0; i < m_BufferLength; i++)
-            {
-                quint16 pos = loopBuffer(start + i);
-                v_HeartForFFT[i] = ((PCA_RAW_RGB(pos,0) - mean0)*PCA_Basis(0,0) + (PCA_RAW_RGB(pos,1) - mean1)*PCA_Basis(1,0) + (PCA_RAW_RGB(pos,2) - mean2)*PCA_Basis(2,0)) / temp_sko;
-                buffer_duration += v_HeartTime[loop(temp_position - (m_BufferLength - 1) + i)];
-            }
-        }
+        prepareHeartWindow(v_HeartForFFT);
         emit PCAProjectionUpdated(v_HeartForFFT, m_BufferLength);
     }
-    else
+    else if(!m_slidingDFTFlag)
     {
-        quint16 pos;
-        for (unsigned int i = 0; i < m_BufferLength; i++)
-        {
-            //pos = loop(temp_position - (m_BufferLength - 1) + i);
-            pos = loop(temp_position - i);
-            v_HeartForFFT[i] = v_HeartSignal[pos];
-            buffer_duration += v_HeartTime[pos];
-        }
+        prepareHeartWindow(v_HeartForFFT);
     }
 
-    fftw_execute(m_HeartPlan); // Datas were prepared, now execute fftw_plan
+    quint16 bottom_bound;
+    quint16 top_bound;
+    getHeartBand(buffer_duration, bottom_bound, top_bound);
 
-    qreal totalPower = 0.0;
-    for (quint16 i = 0; i < (m_BufferLength/2 + 1); i++)
+    if(m_slidingDFTFlag && !f_PCA)
     {
-        v_HeartAmplitude[i] = v_HeartSpectrum[i][0]*v_HeartSpectrum[i][0] + v_HeartSpectrum[i][1]*v_HeartSpectrum[i][1];
-        totalPower += v_HeartAmplitude[i];
+        if(top_bound > bottom_bound)
+            readSpectrum(m_HeartDFT, getLatest(v_HeartSignal, temp_position, m_BufferLength), bottom_bound, top_bound - 1, v_HeartAmplitude);
+        else // buffer duration is too short, there is no band to anchor
+            std::fill(v_HeartAmplitude, v_HeartAmplitude + m_BufferLength/2 + 1, 0.0);
     }
-    for (quint16 i = 0; i < (m_BufferLength/2 + 1); i++) // normalization
+    else
     {
-        v_HeartAmplitude[i] /= totalPower;
+        fftw_execute_dft_r2c(m_FFTPlan, v_HeartForFFT, v_HeartSpectrum); // Datas were prepared, now execute fftw_plan
+
+        qreal totalPower = 0.0;
+        for (quint32 i = 0; i < (m_BufferLength/2 + 1); i++)
+        {
+            v_HeartAmplitude[i] = v_HeartSpectrum[i][0]*v_HeartSpectrum[i][0] + v_HeartSpectrum[i][1]*v_HeartSpectrum[i][1];
+            totalPower += v_HeartAmplitude[i];
+        }
+        for (quint32 i = 0; i < (m_BufferLength/2 + 1); i++) // normalization
+        {
+            v_HeartAmplitude[i] /= totalPower;
+        }
     }
     emit heartSpectrumUpdated(v_HeartAmplitude, m_BufferLength/2 + 1);
 
-    quint16 bottom_bound = (quint16)(BOTTOM_LIMIT * buffer_duration / 1000.0);   // You should ensure that ( LOW_HR_LIMIT < discretization frequency / 2 )
-    quint16 top_bound = (quint16)(TOP_LIMIT * buffer_duration / 1000.0);
-    if(top_bound > (m_BufferLength / 2 + 1))
-    {
-        top_bound = m_BufferLength / 2 + 1;
-    }
     quint16 index_of_maxpower = 0;
     qreal maxpower = 0.0;
     for (quint16 i = ( bottom_bound + HALF_INTERVAL ); i < ( top_bound - HALF_INTERVAL ); i++)
@@ -430,7 +416,78 @@ void QHarmonicProcessor::computeHeartRate()
         {
             noise_power += v_HeartAmplitude[i];
         }
-    }    
+    }
+    applyHeartBand(buffer_duration, index_of_maxpower, signal_power, noise_power, power_multiplyed_by_index);
+}
+
+//----------------------------------------------------------------------------------------------------
+
+qreal QHarmonicProcessor::getHeartBufferDuration() const
+{
+    qreal buffer_duration = 0.0; // for buffer duration accumulation without first time interval
+    const qreal *time = getLatest(v_HeartTime, curpos - 1, m_BufferLength);
+    for(quint32 i = 0; i < m_BufferLength; i++)
+        buffer_duration += time[i];
+    return buffer_duration;
+}
+
+//----------------------------------------------------------------------------------------------------
+
+void QHarmonicProcessor::getHeartBand(qreal buffer_duration, quint16 &bottom_bound, quint16 &top_bound) const
+{
+    bottom_bound = (quint16)(BOTTOM_LIMIT * buffer_duration / 1000.0);   // You should ensure that ( LOW_HR_LIMIT < discretization frequency / 2 )
+    top_bound = (quint16)(TOP_LIMIT * buffer_duration / 1000.0);
+    if(top_bound > (m_BufferLength / 2 + 1))
+    {
+        top_bound = m_BufferLength / 2 + 1;
+    }
+}
+
+//----------------------------------------------------------------------------------------------------
+
+void QHarmonicProcessor::prepareHeartWindow(qreal *window)
+{
+    const quint32 temp_position = curpos - 1;
+    if(f_PCA)
+    {
+        for(quint8 c = 0; c < 3; c++)
+        {
+            const qreal *color = getLatest(v_RawColor[c], temp_position, m_BufferLength);
+            for(quint32 i = 0; i < m_BufferLength; i++)
+                PCA_RAW_RGB(i, c) = color[i];
+        }
+        alglib::pcabuildbasis(PCA_RAW_RGB, m_BufferLength, 3, PCA_Info, PCA_Variance, PCA_Basis);
+        if (PCA_Info == 1)
+        {
+            qreal mean0 = 0.0;
+            qreal mean1 = 0.0;
+            qreal mean2 = 0.0;
+            for (unsigned int i = 0; i < m_BufferLength; i++)
+            {
+                mean0 += PCA_RAW_RGB(i,0);
+                mean1 += PCA_RAW_RGB(i,1);
+                mean2 += PCA_RAW_RGB(i,2);
+            }
+            mean0 /= m_BufferLength;
+            mean1 /= m_BufferLength;
+            mean2 /= m_BufferLength;
+
+            qreal temp_sko = sqrt(PCA_Variance(0));
+            for (quint32 i = 0; i < m_BufferLength; i++)
+                window[i] = ((PCA_RAW_RGB(i,0) - mean0)*PCA_Basis(0,0) + (PCA_RAW_RGB(i,1) - mean1)*PCA_Basis(1,0) + (PCA_RAW_RGB(i,2) - mean2)*PCA_Basis(2,0)) / temp_sko;
+        }
+    }
+    else
+    {
+        const qreal *signal = getLatest(v_HeartSignal, temp_position, m_BufferLength); // in time order, it was reversed before, power spectrum is the same
+        std::copy(signal, signal + m_BufferLength, window);
+    }
+}
+
+//----------------------------------------------------------------------------------------------------
+
+void QHarmonicProcessor::applyHeartBand(qreal buffer_duration, quint16 index_of_maxpower, qreal signal_power, qreal noise_power, qreal power_multiplyed_by_index)
+{
     if(signal_power < 0.01)
         m_HeartSNR = -13.0;
     else
@@ -448,10 +505,14 @@ void QHarmonicProcessor::computeHeartRate()
             emit heartRateUpdated(m_HeartRate, m_HeartSNR, true);
         else
             emit heartRateUpdated(m_HeartRate, m_HeartSNR, false);
+        emit heartRateMeasured(m_ID, m_HeartRate, m_HeartSNR, (m_HeartRate <= m_rightTreshold) && (m_HeartRate >= m_leftThreshold));
         computeSPO2(index_of_maxpower);
     }
     else
+    {
        emit heartTooNoisy(m_HeartSNR);
+       emit heartRateMeasured(m_ID, m_HeartRate, m_HeartSNR, false);
+    }
 
     if(m_HeartSNRControlFlag)
     {
@@ -483,8 +544,8 @@ void QHarmonicProcessor::switchColorMode(int value)
 
 void QHarmonicProcessor::CountFrequency()
 {
-    qint16 position = curpos - 1; // delay on 1 count is critical valuable here
-    quint16 watchDogCounter = 0;
+    quint32 position = curpos - 1; // delay on 1 count is critical valuable here
+    quint32 watchDogCounter = 0;
     quint16 sign_changes = m_PulseCounter;
     qreal temp_time = 0.0;
 
@@ -621,7 +682,10 @@ void QHarmonicProcessor::setID(quint32 value)
 void QHarmonicProcessor::setEstiamtionInterval(int value)
 {
     if((value > 1) && (value <= m_DataLength))
+    {
         m_estimationInterval = value;
+        rebuildStatistics();
+    }
 }
 
 //------------------------------------------------------------------------------------------------
@@ -656,32 +720,44 @@ void QHarmonicProcessor::setSnrControl(bool value)
 
 void QHarmonicProcessor::computeBreathRate()
 {
-    qint16 position = m_BreathCurpos - 1;
+    const quint32 position = m_BreathCurpos - 1;
     qreal duration = 0.0;
-    quint16 pos;
-    for(quint16 i = 0; i < m_BufferLength; i++)
+    const qreal *signal = getLatest(v_BreathSignal, position, m_BufferLength);
+    const qreal *time = getLatest(v_BreathTime, position, m_BufferLength);
+    for(quint32 i = 0; i < m_BufferLength; i++)
+        duration += time[i];
+
+    quint16 bottom = (quint16)(BREATH_BOTTOM_LIMIT * duration / 1000.0);   // You should ensure that ( LOW_HR_LIMIT < discretization frequency / 2 )
+    quint16 top = (quint16)(BREATH_TOP_LIMIT * duration / 1000.0);
+    if(top > (m_BufferLength / 2 + 1))
     {
-        pos = loop(position - (m_BufferLength - 1) + i);
-        v_BreathForFFT[i] = v_BreathSignal[pos];
-        duration += v_BreathTime[pos];
+        top = m_BufferLength / 2 + 1;
     }
 
-    fftw_execute(m_BreathPlan);
-
-    qreal total_power = 0.0;
-    for(quint16 i = 0; i < (m_BufferLength/2 + 1) ; i++)
+    if(m_slidingDFTFlag)
     {
-       v_BreathAmplitude[i] = v_BreathSpectrum[i][0]*v_BreathSpectrum[i][0] + v_BreathSpectrum[i][1]*v_BreathSpectrum[i][1];
-       total_power += v_BreathAmplitude[i];
+        if(top > bottom)
+            readSpectrum(m_BreathDFT, signal, bottom, top - 1, v_BreathAmplitude);
+        else // buffer duration is too short, there is no band to anchor
+            std::fill(v_BreathAmplitude, v_BreathAmplitude + m_BufferLength/2 + 1, 0.0);
     }
-    for(quint16 i = 0; i < (m_BufferLength/2 + 1) ; i++)
+    else
     {
-       v_BreathAmplitude[i] /= total_power;
+        std::copy(signal, signal + m_BufferLength, v_BreathForFFT);
+        fftw_execute_dft_r2c(m_FFTPlan, v_BreathForFFT, v_BreathSpectrum);
+
+        qreal total_power = 0.0;
+        for(quint32 i = 0; i < (m_BufferLength/2 + 1) ; i++)
+        {
+           v_BreathAmplitude[i] = v_BreathSpectrum[i][0]*v_BreathSpectrum[i][0] + v_BreathSpectrum[i][1]*v_BreathSpectrum[i][1];
+           total_power += v_BreathAmplitude[i];
+        }
+        for(quint32 i = 0; i < (m_BufferLength/2 + 1) ; i++)
+        {
+           v_BreathAmplitude[i] /= total_power;
+        }
     }
     emit breathSpectrumUpdated(v_BreathAmplitude, (m_BufferLength/2 + 1));
-
-    quint16 bottom = (quint16)(BREATH_BOTTOM_LIMIT * duration / 1000.0);   // You should ensure that ( LOW_HR_LIMIT < discretization frequency / 2 )
-    quint16 top = (quint16)(BREATH_TOP_LIMIT * duration / 1000.0);
     quint16 index_of_maxpower = 0;
     qreal maxpower = 0.0;
     for (quint16 i = ( bottom + BREATH_HALF_INTERVAL ); i < ( top - BREATH_HALF_INTERVAL ); i++)
@@ -748,6 +824,7 @@ void QHarmonicProcessor::setBreathAverage(int value)
     if((value > 0) && (value <= m_DataLength))
     {
         m_BreathAverageInterval = value;
+        rebuildStatistics();
     }
 }
 
@@ -758,6 +835,7 @@ void QHarmonicProcessor::setBreathCNInterval(int value)
     if((value > 1) && (value <= m_DataLength))
     {
         m_BreathCNInterval = value;
+        rebuildBreathStatistics();
     }
 }
 
@@ -795,15 +873,12 @@ void QHarmonicProcessor::computeSPO2(quint16 index)
 {
     if( (HALF_INTERVAL < index) && (index < (m_BufferLength/2 + 1 - HALF_INTERVAL)) && (m_HeartSNR > 6.0) )
     {
-        quint16 pos;
-        for(quint16 i = 0; i < m_BufferLength; i++)
-        {
-            pos = loopBuffer(curpos - 1 - i);
-            v_BlueForFFT[i] = PCA_RAW_RGB(pos,1);
-            v_RedForFFT[i] = PCA_RAW_RGB(pos,0);
-        }
-        fftw_execute(m_BluePlan);
-        fftw_execute(m_RedPlan);
+        const qreal *green = getLatest(v_RawColor[1], curpos - 1, m_BufferLength); // green goes to the blue spectrum as it always did
+        const qreal *red = getLatest(v_RawColor[0], curpos - 1, m_BufferLength);
+        std::copy(green, green + m_BufferLength, v_BlueForFFT);
+        std::copy(red, red + m_BufferLength, v_RedForFFT);
+        fftw_execute_dft_r2c(m_FFTPlan, v_BlueForFFT, v_BlueSpectrum);
+        fftw_execute_dft_r2c(m_FFTPlan, v_RedForFFT, v_RedSpectrum);
         qreal dcRed = v_RedSpectrum[0][0]*v_RedSpectrum[0][0] + v_RedSpectrum[0][1]*v_RedSpectrum[0][1];
         qreal acRed = v_RedSpectrum[index][0]*v_RedSpectrum[index][0] + v_RedSpectrum[index][1]*v_RedSpectrum[index][1];
         qreal dcBlue = v_BlueSpectrum[0][0]*v_BlueSpectrum[0][0] + v_BlueSpectrum[0][1]*v_BlueSpectrum[0][1];
@@ -831,3 +906,37 @@ void QHarmonicProcessor::computeSPO2(quint16 index)
     }
 }
 
+//------------------------------------------------------------------------------------------------
+
+void QHarmonicProcessor::setSlidingDFT(bool value)
+{
+    m_slidingDFTFlag = value;
+    m_HeartDFT.clear(); // bands will be anchored on the next spectrum reading, until then EnrollData(...) does not update them
+    m_BreathDFT.clear();
+}
+
+//------------------------------------------------------------------------------------------------
+
+void QHarmonicProcessor::slideSpectrum(SlidingDFT &dft, const qreal *history, quint32 position, qreal out)
+{
+    dft.update(history[position], out);
+    if(dft.isAnchorDue()) // drops rounding errors of the recurrence once per m_BufferLength counts
+        dft.anchor(getLatest(history, position, m_BufferLength));
+}
+
+//------------------------------------------------------------------------------------------------
+
+void QHarmonicProcessor::readSpectrum(SlidingDFT &dft, const qreal *window, quint32 first, quint32 last, qreal *amplitude)
+{
+    if(first > last) // band is empty when buffer duration is too short
+        last = first;
+    if(!dft.contains(first, last))
+        dft.anchor(window, first > SDFT_BAND_MARGIN ? first - SDFT_BAND_MARGIN : 0, last + SDFT_BAND_MARGIN);
+
+    std::fill(amplitude, amplitude + m_BufferLength/2 + 1, 0.0);
+    const qreal totalPower = dft.getTotalPower();
+    if(dft.isEmpty() || (totalPower == 0.0))
+        return;
+    for(quint32 i = dft.getFirst(); i <= dft.getLast(); i++)
+        amplitude[i] = dft.getPower(i) / totalPower; // normalization
+}
@@ -3,14 +3,19 @@
 
 #include <QObject>
 #include "fftw3.h"
+#include "fftplancache.h"
 #include "ap.h" // ALGLIB types
 #include "dataanalysis.h" // ALGLIB functions
+#include "slidingstats.h"
+#include "slidingdft.h"
 
 #define BOTTOM_LIMIT 0.8 // in s^-1, it is 48 bpm
 #define TOP_LIMIT 3.5 // in s^-1, it is 210 bpm
 #define SNR_TRESHOLD 2.0 // in most cases this value is suitable when (m_BufferLength == 256)
 #define HALF_INTERVAL 2 // defines the number of averaging indexes when frequency is evaluated, this value should be >= 1
 #define DIGITAL_FILTER_LENGTH 3 // in counts
+#define DIGITAL_FILTER_BUFFER 4 // power of two ring that holds the last DIGITAL_FILTER_LENGTH counts
+#define SDFT_BAND_MARGIN 4 // in bins, sliding DFT keeps that many extra bins on each side of the band, so small changes of buffer duration do not cause anchoring
 
 #define BREATH_TOP_LIMIT 0.5 // in s^-1, it is 30 rpm
 #define BREATH_BOTTOM_LIMIT 0.2 // in s^-1, it is 12 rpm
@@ -27,13 +32,19 @@ class QHarmonicProcessor : public QObject
 {
     Q_OBJECT
 public:
-    explicit QHarmonicProcessor(QObject *parent = NULL, quint16 length_of_data = 256, quint16 length_of_buffer = 256 );
+    explicit QHarmonicProcessor(QObject *parent = NULL, quint32 length_of_data = 256, quint32 length_of_buffer = 256 ); // histories are allocated with length_of_data rounded up to a power of two, plots and getDataLength() keep length_of_data
     ~QHarmonicProcessor();
     enum ColorChannel { Red, Green, Blue, RGB, Experimental };
     enum XMLparserError { NoError, FileOpenError, FileExistanceError, ReadError, ParseFailure };
     enum SexID { Male, Female };
     enum TwoSideAlpha { FiftyPercents, TwentyPercents, TenPercents, FivePercents, TwoPercents };
 
+    // computeHeartRate() split into steps, so QHarmonicProcessorMap could transform windows of all cells by one batched FFT
+    qreal getHeartBufferDuration() const; // in ms, duration of the last m_BufferLength counts
+    void getHeartBand(qreal buffer_duration, quint16 &bottom_bound, quint16 &top_bound) const; // bins [bottom_bound, top_bound) of heart rate limits
+    void prepareHeartWindow(qreal *window); // writes m_BufferLength counts to be transformed, PCA projection in PCA mode
+    void applyHeartBand(qreal buffer_duration, quint16 index_of_maxpower, qreal signal_power, qreal noise_power, qreal power_multiplyed_by_index); // powers are normalized by total power, evaluates SNR and heart rate and emits them
+
 signals:
     void heartSignalUpdated(const qreal * pointer_to_vector, quint16 length_of_vector);
     void heartSpectrumUpdated(const qreal * pointer_to_vector, quint16 length_of_vector);
@@ -43,6 +54,7 @@ signals:
     void BinaryOutputUpdated(const qreal *pointer_to_vector, quint16 length_of_vector);
     void CurrentValues(qreal signalValue, qreal meanRed, qreal meanGreen, qreal meanBlue);
     void heartTooNoisy(qreal snr_value);
+    void heartRateMeasured(quint32 id, qreal freq_value, qreal snr_value, bool reliable_data_flag); // for processors of several regions, too noisy result is unreliable
 
     void snrUpdated(quint32 id, qreal value);    // signal for mapping
     void vpgUpdated(quint32 id, qreal value);   // signal for mapping
@@ -60,7 +72,7 @@ signals:
     void spO2Updated(const qreal value);
 
 public slots:
-    void EnrollData(unsigned long red, unsigned long green, unsigned long blue, unsigned long area, double time);
+    void EnrollData(quint64 red, quint64 green, quint64 blue, quint64 area, double time);
     void computeHeartRate(); // computes Heart Rate by means of frequency analysis
     void computeBreathRate(); // computes Breath Rate by means of frequency analysis
     void computeSPO2(quint16 index); // computes SPO2 by means of frequency analysis and ratio of the ration method
@@ -69,6 +81,7 @@ public slots:
     void switchColorMode(int value); // controls colors enrollment
     int  loadWarningRates(const char *fileName, SexID sex, int age, TwoSideAlpha alpha);
     void setID(quint32 value); // use it to set ID, it is used for QHarmonicMapper internal logic management
+    void reset(); // drops enrolled data and measurements, settings and FFT plans are kept, so the instance could be reused for another region
     void setEstiamtionInterval(int value); // use it to set m_estimationInterval property value
     void setBreathStrobe(int value);
     void setBreathAverage(int value);
@@ -81,27 +94,30 @@ public slots:
     quint16 getBreathCNInterval() const;
     void setSnrControl(bool value);
     void setPruning(bool value);
+    void setSlidingDFT(bool value); // controls whether heart and breath spectra are read from sliding DFT instead of FFT of the whole buffer, PCA mode and SPO2 always use FFT
 
 
 private:
-    qreal *v_HeartSignal;  //a pointer to centered and normalized data (typedefinition from fftw3.h, a single precision complex float number type)
+    qreal *v_HeartSignal;  //a pointer to centered and normalized data (typedefinition from fftw3.h, a single precision complex float number type), mirrored
     qreal *v_HeartCNSignal; // a pointer to input counts history, for digital filtration
     fftw_complex *v_HeartSpectrum;  // a pointer to an array for FFT-spectrum
     qreal m_HeartSNR; // a variable for signal-to-noise ratio estimation storing
     qreal *v_RawCh1; //a pointer to spattialy averaged data (you should use it to write data to an instance of a class)
     qreal *v_RawCh2; //a pointer to spattialy averaged data (you should use it to write data to an instance of a class)
-    qreal *v_HeartForFFT; //a pointer to data prepared for FFT
+    qreal *v_HeartForFFT; //a pointer to data prepared for FFT, allocated by fftw_malloc(...) as all arrays for m_FFTPlan
     qreal *v_HeartAmplitude; // stores amplitude spectrum
-    qreal *v_HeartTime; //a pointer to an array for frame periods storing (values in milliseconds thus unsigned int)
+    qreal *v_HeartTime; //a pointer to an array for frame periods storing (values in milliseconds thus unsigned int), mirrored
     qreal m_HeartRate; //a variable for storing a last evaluated frequency of the 'strongest' harmonic
     unsigned int curpos; //a current position I meant
-    unsigned int m_DataLength; //a length of data array
+    unsigned int m_DataLength; //a length of data array as it was set, plots get the last m_DataLength counts
+    unsigned int m_RingLength; // capacity of histories, m_DataLength rounded up to a power of two
+    unsigned int m_RingMask; // m_RingLength - 1
     unsigned int m_BufferLength; //a lenght of sub data array for FFT (m_BufferLength should be <= m_DataLength)
     bool f_PCA; // this flag controls whether computeHeartRate use ordinary computation or PCA alignment, value is controlled by set_f_PCA(...)
-    fftw_plan m_HeartPlan; // a plan for FFT evaluation
+    fftw_plan m_FFTPlan; // a plan for FFT evaluation of m_BufferLength counts, it is shared by heart, breath, red and blue transforms and is owned by FFTPlanCache
 
     ColorChannel m_ColorChannel; // determines which color channel is enrolled by WriteToDataOneColor(...) method
-    qreal *v_BinaryOutput; // a pointer to a vector of digital filter output
+    qreal *v_BinaryOutput; // a pointer to a vector of digital filter output, mirrored
     qreal *v_SmoothedSignal; // for intermediate result storage
     qreal v_Derivative[2]; // to store two close counts from digital derivative
     quint8 m_zerocrossing; // controls zero crossings of the first derivative
@@ -110,65 +126,84 @@ private:
     double m_rightTreshold; // a top threshold for warning aboul low pulse value
     qreal m_output; // a variable for v_BinaryOutput control, it should take values 1.0 or -1.0
 
-    alglib::real_2d_array PCA_RAW_RGB; // a container for PCA analysis
+    alglib::real_2d_array PCA_RAW_RGB; // a container for PCA analysis, the last m_BufferLength counts of v_RawColor in time order, filled by computeHeartRate()
+    qreal *v_RawColor[3]; // mirrored histories of red, green and blue means
     alglib::real_1d_array PCA_Variance; // array[0..2] - variance values corresponding to basis vectors
     alglib::real_2d_array PCA_Basis; // array[0..2,0..2], whose columns will store basis vectors
     alglib::ae_int_t PCA_Info; // PCA result code
 
-    quint16 loop(qint16) const; //a function that return a loop-index
-    quint16 loopInput(qint16) const; //a function that return a loop-index
-    quint16 loopBuffer(qint16) const; //a function that return a loop-index
-    quint8 loopOnTwo(qint16 difference) const;
+    quint32 loop(quint32 index) const; //a function that return a loop-index, index could go below zero by unsigned wrap, as (curpos - i) does
+    quint32 loopInput(quint32 index) const; //a function that return a loop-index of DIGITAL_FILTER_BUFFER ring
+    quint8 loopOnTwo(quint32 index) const;
+    void writeMirrored(qreal *history, quint32 position, qreal value); // history has 2 * m_RingLength counts, the second half repeats the first one
+    const qreal *getLatest(const qreal *history, quint32 position, quint32 count) const; // contiguous span of count (<= m_RingLength) counts that ends at position of mirrored history
+    void rebuildStatistics(); // computes sliding statistics of the windows that end at (curpos - 1) from the buffers
+    void rebuildBreathStatistics(); // the same for the window that ends at (m_BreathCurpos - 1)
+    void slideSpectrum(SlidingDFT &dft, const qreal *history, quint32 position, qreal out); // history[position] has just been written, out is the count that left the window
+    void readSpectrum(SlidingDFT &dft, const qreal *window, quint32 first, quint32 last, qreal *amplitude); // normalized power spectrum of m_BufferLength/2 + 1 bins, zeros outside of [first, last], callers skip empty bands
 
     quint32 m_ID;
     quint16 m_estimationInterval; // stores the number of counts that will be used to evaluate mean and sko estimations
     bool m_HeartSNRControlFlag; //
+    SlidingStats v_RawStats[3]; // PCA_RAW_RGB columns over m_estimationInterval, for pruning
+    SlidingStats m_Ch1Stats; // v_RawCh1 over m_estimationInterval
+    SlidingStats m_Ch2Stats; // v_RawCh2 over m_estimationInterval
+    SlidingStats m_BreathAverageStats; // v_RawCh1 over m_BreathAverageInterval
+    SlidingStats m_BreathCNStats; // v_RawBreathSignal over m_BreathCNInterval
 
     qreal *v_RawBreathSignal; // stores slow changes in VPG, not centered and not normalized
-    qreal *v_BreathSignal; // to store a slow waves and evaluate a breath rate
-    qreal *v_BreathTime; // to store a time counters for breath signal
+    qreal *v_BreathSignal; // to store a slow waves and evaluate a breath rate, mirrored
+    qreal *v_BreathTime; // to store a time counters for breath signal, mirrored
     qreal *v_BreathForFFT;
     qreal *v_BreathAmplitude;
-    fftw_plan m_BreathPlan;
     fftw_complex *v_BreathSpectrum;
     qreal m_BreathRate; // to store a breath rate measurement
     quint16 m_BreathStrobe;
     quint16 m_BreathStrobeCounter;
-    quint16 m_BreathCurpos;
+    quint32 m_BreathCurpos;
     quint16 m_BreathAverageInterval;
     quint16 m_BreathCNInterval;
     qreal m_BreathSNR;
 
-    fftw_plan m_BluePlan;
     fftw_complex *v_BlueSpectrum;
     qreal *v_BlueForFFT;
-    fftw_plan m_RedPlan;
     fftw_complex *v_RedSpectrum;
     qreal *v_RedForFFT;
     qreal m_SPO2;
 
+    bool m_slidingDFTFlag;
+    SlidingDFT m_HeartDFT; // over v_HeartSignal window of m_BufferLength counts
+    SlidingDFT m_BreathDFT; // over v_BreathSignal window of m_BufferLength counts
+
     bool m_pruningFlag;
+
 };
 
 // inline, for speed, must therefore reside in header file
-inline quint16 QHarmonicProcessor::loop(qint16 difference) const
+inline quint32 QHarmonicProcessor::loop(quint32 index) const
+{
+    return index & m_RingMask; // m_RingLength is a power of two, so unsigned wrap of (curpos - i) keeps the result right
+}
+//---------------------------------------------------------------------------
+inline quint32 QHarmonicProcessor::loopInput(quint32 index) const
 {
-    return ((m_DataLength + (difference % m_DataLength)) % m_DataLength); // have finded it on wikipedia ), it always returns positive result
+    return index & (DIGITAL_FILTER_BUFFER - 1);
 }
 //---------------------------------------------------------------------------
-inline quint16 QHarmonicProcessor::loopInput(qint16 difference) const
+inline quint8 QHarmonicProcessor::loopOnTwo(quint32 index) const
 {
-    return ((DIGITAL_FILTER_LENGTH + (difference % DIGITAL_FILTER_LENGTH)) % DIGITAL_FILTER_LENGTH);
+    return index & 1;
 }
 //---------------------------------------------------------------------------
-inline quint16 QHarmonicProcessor::loopBuffer(qint16 difference) const
+inline void QHarmonicProcessor::writeMirrored(qreal *history, quint32 position, qreal value)
 {
-    return ((m_BufferLength + (difference % m_BufferLength)) % m_BufferLength);
+    history[position] = value;
+    history[position + m_RingLength] = value;
 }
 //---------------------------------------------------------------------------
-inline quint8 QHarmonicProcessor::loopOnTwo(qint16 difference) const
+inline const qreal *QHarmonicProcessor::getLatest(const qreal *history, quint32 position, quint32 count) const
 {
-    return ((2 + (difference % 2)) % 2);
+    return history + loop(position) + m_RingLength - (count - 1);
 }
 
 //---------------------------------------------------------------------------
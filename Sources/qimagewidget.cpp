@@ -24,6 +24,8 @@ QImageWidget::QImageWidget(QWidget *parent): WIDGET_CLASS(parent)
     m_drawDataFlag = false;
     v_map = NULL;
     m_imageFlag = true;
+    m_lassoFlag = false;
+    m_rectFlag = false;
     m_opacity = DEFAULT_OPACITY;
     computeColorTable();
 }
@@ -93,7 +95,9 @@ void QImageWidget::updateImage(const cv::Mat& image, qreal frame_period, quint32
             break;
     }
     assert(opencv_image.isContinuous()); // QImage needs the data to be stored continuously in memory
-    qt_image = QImage(opencv_image.data, opencv_image.cols, opencv_image.rows, opencv_image.cols * 3, QImage::Format_RGB888);  // Assign OpenCV's image buffer to the QImage
+    if( (qt_image.constBits() != opencv_image.data) || (qt_image.width() != opencv_image.cols) || (qt_image.height() != opencv_image.rows) ) // cvtColor reuses opencv_image buffer while frame size stays the same, so QImage wrapper is rebuilt only when buffer changes
+        qt_image = QImage(opencv_image.data, opencv_image.cols, opencv_image.rows, opencv_image.cols * 3, QImage::Format_RGB888);  // Assign OpenCV's image buffer to the QImage
+    emit imageUpdated();
     update();
 }
 
@@ -111,6 +115,7 @@ void QImageWidget::paintEvent(QPaintEvent* )
 
     drawMap(painter, temp_rect);
     drawStrings(painter, temp_rect);          // Will draw m_informationString on the widget
+    drawRegionStrings(painter, temp_rect);
 
     /*if(m_drawDataFlag)
         drawData(painter, temp_rect);
@@ -125,10 +130,22 @@ void QImageWidget::mousePressEvent(QMouseEvent *event)
     y0 = event->y();
     m_aimrect.setX( x0 );
     m_aimrect.setY( y0 );
+    m_lassoFlag = (event->modifiers() & Qt::ShiftModifier) != 0;
+    m_rectFlag = false;
+    v_lasso.clear();
+    if(m_lassoFlag)
+        v_lasso.push_back( map_to_image(event->pos()) );
 }
 
 void QImageWidget::mouseMoveEvent(QMouseEvent *event)
 {
+    if(m_lassoFlag)
+    {
+        cv::Point point = map_to_image(event->pos());
+        if(point != v_lasso.back())
+            v_lasso.push_back( point );
+        return;
+    }
     if( event->x() > x0)
     {
         m_aimrect.setWidth(event->x() - x0);
@@ -147,9 +164,24 @@ void QImageWidget::mouseMoveEvent(QMouseEvent *event)
         m_aimrect.setY( event->y() );
         m_aimrect.setHeight( y0 - event->y() );
     }
+    m_rectFlag = true;
     emit rect_was_entered( crop_aimrect() );
 }
 
+void QImageWidget::mouseReleaseEvent(QMouseEvent *)
+{
+    if(m_lassoFlag && (v_lasso.size() > 2))
+        emit polygon_was_entered(v_lasso);
+    else if(m_rectFlag)
+    {
+        cv::Rect region = crop_aimrect();
+        if(region.area() > 0)
+            emit rect_was_completed(region);
+    }
+    m_rectFlag = false;
+    m_lassoFlag = false;
+}
+
 //------------------------------------------------------------------------------------
 
 void QImageWidget::drawStrings(QPainter &painter, const QRect &input_rect)
@@ -374,6 +406,50 @@ void QImageWidget::updateSPO2(qreal value)
 
 //-----------------------------------------------------------------------------------
 
+void QImageWidget::updateRegionValues(quint32 id, qreal freq_value, qreal snr_value, bool reliable_data_flag)
+{
+    m_regionStrings.insert(id, "#" + QString::number(id) + ": " + QString::number(qRound(freq_value)) + tr(" bpm, ") + QString::number(snr_value,'f',1) + tr(" dB"));
+    m_regionFlags.insert(id, reliable_data_flag);
+}
+
+//-----------------------------------------------------------------------------------
+
+void QImageWidget::removeRegionValues(quint32 id)
+{
+    m_regionStrings.remove(id);
+    m_regionFlags.remove(id);
+}
+
+//-----------------------------------------------------------------------------------
+
+void QImageWidget::clearRegionValues()
+{
+    m_regionStrings.clear();
+    m_regionFlags.clear();
+}
+
+//-----------------------------------------------------------------------------------
+
+void QImageWidget::drawRegionStrings(QPainter &painter, const QRect &input_rect)
+{
+    if(m_regionStrings.isEmpty())
+        return;
+    qreal pointsize = (qreal)input_rect.height()/40;
+    qreal startX = input_rect.x() + input_rect.width() * 0.66;
+    qreal startY = input_rect.y() + pointsize * 2.0 + m_margin;
+    painter.setFont( QFont("Calibri", pointsize, QFont::DemiBold) );
+    QMap<quint32, QString>::const_iterator it = m_regionStrings.constBegin();
+    while(it != m_regionStrings.constEnd())
+    {
+        painter.setPen( m_regionFlags.value(it.key()) ? QColor(Qt::green) : QColor(Qt::red) );
+        painter.drawText(startX, startY, it.value());
+        startY += pointsize * 1.75;
+        ++it;
+    }
+}
+
+//-----------------------------------------------------------------------------------
+
 void QImageWidget::drawData(QPainter &painter, const QRect &input_rect)
 {
     if((pt_data != NULL) && (m_datalength != 0))
@@ -13,6 +13,7 @@ QImage instance from cv::Mat image. The QImageWidget should be used as widget fo
 #include <QImage>
 #include <QPainter>
 #include <QMouseEvent>
+#include <QMap>
 #include <opencv2/opencv.hpp>
 
 #ifdef REPLACE_WIDGET_TO_OPENGLWIDGET
@@ -36,6 +37,9 @@ public:
 
 signals:
     void rect_was_entered(const cv::Rect &value);
+    void polygon_was_entered(const std::vector<cv::Point> &value); // emitted when lasso (mouse move with Shift pressed) is released
+    void rect_was_completed(const cv::Rect &value); // emitted once when mouse is released, unlike rect_was_entered(...) that follows mouse move
+    void imageUpdated(); // emitted when updateImage(...) has done with the input image
 
 public slots:
     void updateImage(const cv::Mat &image, qreal frame_period, quint32 pixels_enrolled); // takes cv::Mat image and converts it to the appropriate Qt QImage format
@@ -54,11 +58,15 @@ public slots:
     void clearMap();
     void setImageFlag(bool value);
     void updateSPO2(qreal value);
+    void updateRegionValues(quint32 id, qreal freq_value, qreal snr_value, bool reliable_data_flag); // heart rate of the region with id, for multiple regions mode
+    void removeRegionValues(quint32 id);
+    void clearRegionValues();
 
 protected:
     void paintEvent(QPaintEvent*);
     void mousePressEvent(QMouseEvent* event);
     void mouseMoveEvent(QMouseEvent *event);
+    void mouseReleaseEvent(QMouseEvent *event);
     void setSamplesNumber(int value);
 
 private:
@@ -73,6 +81,9 @@ private:
     QString m_spO2String;
     quint16 x0;             // stores coordinate of mousePressEvenr
     quint16 y0;             // stores coordinate of mousePressEvent
+    std::vector<cv::Point> v_lasso; // stores image coordinates of lasso vertices, lasso is drawn while Shift is pressed
+    bool m_lassoFlag;       // true while lasso is drawn
+    bool m_rectFlag;        // true if rectangle has been dragged since the last mouse press
     const qreal *pt_data;         // stores pointer to external data, wich is used to draw on this widget, point it to external data vector by menas of updatePointer(...) slot
     quint16 m_datalength;   // should be used ti store length of external vector
     QColor m_frequencyColor;     // stores the color of the m_frequencyString
@@ -96,14 +107,19 @@ private:
     const qreal *v_map;
     QColor v_colors[256];
 
+    QMap<quint32, QString> m_regionStrings; // heart rate strings of user regions, ordered by region id
+    QMap<quint32, bool> m_regionFlags;
+
 private slots:
     void computeColorTable(); // call in constructor to calculate appropriate colors and write them in v_colors[]
     inline QRect make_proportional_rect(QRect rect, int width, int height) const; // returns QRect inside input rect with the same center point, but with proportional sizes corresponding to width and height
     inline cv::Rect crop_aimrect() const;    // should be used for m_aimrect cropping
+    inline cv::Point map_to_image(const QPoint &point) const; // converts widget coordinates to image coordinates
     inline QRectF findMapRegion(const QRect &viewRect) const;
     void drawStrings(QPainter &painter, const QRect &input_rect); // use this eunction inside paintEvent(...) handler to draw string on the image
     void drawData(QPainter &painter, const QRect &input_rect);   // draws pt_Data[] if ptData != NULL and drops pt_Data to NULL on every function call
     void drawMap(QPainter &painter, const QRect &input_rect);
+    void drawRegionStrings(QPainter &painter, const QRect &input_rect); // draws column of m_regionStrings at the right side of the image
 };
 
 //------------------------------------------------------------------------------------------------------
@@ -144,6 +160,16 @@ inline cv::Rect QImageWidget::crop_aimrect() const
 
 //------------------------------------------------------------------------------------------------------
 
+inline cv::Point QImageWidget::map_to_image(const QPoint &point) const
+{
+    QRect workfield = make_proportional_rect(this->rect(), opencv_image.cols, opencv_image.rows);
+    int x = ( (qreal)(point.x() - workfield.x())/workfield.width() ) * opencv_image.cols;
+    int y = ( (qreal)(point.y() - workfield.y())/workfield.height() ) * opencv_image.rows;
+    return cv::Point( qBound(0, x, opencv_image.cols - 1), qBound(0, y, opencv_image.rows - 1) );
+}
+
+//------------------------------------------------------------------------------------------------------
+
 inline QRectF QImageWidget::findMapRegion(const QRect& viewRect) const
 {
     qreal x = viewRect.x() + ((qreal)m_mapRect.x / opencv_image.cols) * viewRect.width();
@@ -0,0 +1,48 @@
+/*------------------------------------------------------------------------------------------------------
+Taranov Alex, 2015									     HEADER FILE
+QMapFrame is a record of all map cells of one frame in structure of arrays layout.
+QOpencvProcessor::mapProcess(...) fills it and hands it over to QHarmonicProcessorMap in one
+blocking signal per frame, so the number of cross-thread calls does not depend on the map size.
+------------------------------------------------------------------------------------------------------*/
+
+#ifndef QMAPFRAME_H
+#define QMAPFRAME_H
+//------------------------------------------------------------------------------------------------------
+
+#include <vector>
+#include <QtGlobal>
+
+//------------------------------------------------------------------------------------------------------
+
+struct QMapFrame
+{
+    quint32 width;                  // cells in a row
+    quint32 height;                 // rows of cells
+    quint64 area;             // pixels in a cell, it is the same for all cells
+    double period;                  // frame period in ms
+    std::vector<quint64> red; // sums of cells in row-major order
+    std::vector<quint64> green;
+    std::vector<quint64> blue;
+
+    void resize(quint32 cellsX, quint32 cellsY);
+    quint32 getCount() const;
+};
+
+//------------------------------------------------------------------------------------------------------
+
+inline void QMapFrame::resize(quint32 cellsX, quint32 cellsY)
+{
+    width = cellsX;
+    height = cellsY;
+    red.resize(cellsX*cellsY); // capacity is kept, so the record is not reallocated from frame to frame
+    green.resize(cellsX*cellsY);
+    blue.resize(cellsX*cellsY);
+}
+
+inline quint32 QMapFrame::getCount() const
+{
+    return width*height;
+}
+
+//------------------------------------------------------------------------------------------------------
+#endif // QMAPFRAME_H
@@ -6,9 +6,6 @@ The simplest way to use it - rewrite appropriate section in QOpencvProcessor::cu
 
 #include "qopencvprocessor.h"
 
-#define OBJECT_MINSIZE 128
-#define LEVEL_SHIFT 32
-
 //------------------------------------------------------------------------------------------------------
 
 QOpencvProcessor::QOpencvProcessor(QObject *parent):
@@ -18,16 +15,33 @@ QOpencvProcessor::QOpencvProcessor(QObject *parent):
     m_cvRect.width = 0;
     m_cvRect.height = 0;
     m_framePeriod = 0.0;
+    m_lastTimestamp = -1.0;
+    m_mediaClockInterval = 0;
+    m_mediaClockCounter = 0.0;
     m_skinFlag = true;   
-    v_pixelSet = NULL;
     m_seekCalibColors = false;
     m_calibFlag = false;
+    m_skinModelFlag = false;
+    m_mapCellSizeX = 0;
+    m_mapCellSizeY = 0;
+    m_mapStrideX = 1;
+    m_mapStrideY = 1;
     m_blurSize = 4;
     f_fill = true;
     //------------
-    m_emptyFrames = 0;
-    m_facePos = 0;
-    //------------
+    pt_frameRing = NULL;
+    pt_framePool = NULL;
+    m_asyncDisplayFlag = false;
+    m_displayBusy.store(0);
+    m_pixelFormat = YUVInput::BGR;
+    m_displayImageFlag = true;
+    m_regionCounter = 0;
+    m_patchCols = 1;
+    m_patchRows = 1;
+    m_lowResMaskFlag = false;
+    for(int i = 0; i < 256; i++)
+        v_histSum[i] = 0;
+    m_histTime = 0.0;
 }
 
 //-----------------------------------------------------------------------------------------------------
@@ -47,14 +61,190 @@ void QOpencvProcessor::setMapRegion(const cv::Rect &input_rect)
 
 //-----------------------------------------------------------------------------------------------------
 
+bool QOpencvProcessor::isHistogramConnected()
+{
+    return receivers(SIGNAL(histUpdated(const qreal*,quint16))) > 0;
+}
+
+//-----------------------------------------------------------------------------------------------------
+
+void QOpencvProcessor::publishHistogram()
+{
+    for(int i = 0; i < 256; i++)
+        v_histSum[i] += v_temphist[i];
+    m_histTime += m_framePeriod;
+    if(m_histTime < HIST_PUBLISH_PERIOD)
+        return;
+    m_histTime = 0.0;
+
+    quint32 mass = 0;
+    for(int i = 0; i < 256; i++)
+        mass += v_histSum[i];
+    if(mass > 0)
+    {
+        for(int i = 0; i < 256; i++)
+            v_hist[i] = (qreal)v_histSum[i]/mass;
+    }
+    for(int i = 0; i < 256; i++)
+        v_histSum[i] = 0;
+    emit histUpdated(v_hist, 256);
+}
+
+//-----------------------------------------------------------------------------------------------------
+
 void QOpencvProcessor::updateTime()
 {
-    m_timeCounter = cv::getTickCount();
+    m_lastTimestamp = -1.0; // frames source could be changed or repositioned, so the next frame keeps the previous period
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void QOpencvProcessor::updateFramePeriod(double timestamp)
+{
+    if(timestamp < 0.0)
+        timestamp = getTimestamp();
+    const bool periodFlag = (m_lastTimestamp >= 0.0);
+    if(periodFlag)
+        m_framePeriod = timestamp - m_lastTimestamp; // result is calculated in milliseconds
+    m_lastTimestamp = timestamp;
+
+    if(periodFlag && (m_mediaClockInterval > 0)) // every process slot but mapProcess(...) comes here once per frame
+    {
+        m_mediaClockCounter += m_framePeriod;
+        if(m_mediaClockCounter >= m_mediaClockInterval)
+        {
+            m_mediaClockCounter -= m_mediaClockInterval;
+            emit mediaClockTick();
+        }
+    }
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void QOpencvProcessor::setMediaClockInterval(int value)
+{
+    if(value >= 0)
+    {
+        m_mediaClockInterval = value;
+        m_mediaClockCounter = 0.0;
+    }
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void QOpencvProcessor::setFrameRing(QFrameRing *ring, QFramePool *pool)
+{
+    pt_frameRing = ring;
+    pt_framePool = pool;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void QOpencvProcessor::drainFrameRing()
+{
+    if(pt_frameRing)
+    {
+        pt_frameRing->acknowledgeNotification(); // should be called before pop(), otherwise the last notification could be lost
+        QCapturedFrame *frame;
+        while((frame = pt_frameRing->pop()) != NULL)
+        {
+            emit frameDequeued(frame->image, frame->timestamp, frame->roi);
+            pt_framePool->release(frame);
+        }
+    }
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void QOpencvProcessor::setAsyncDisplay(bool value)
+{
+    m_asyncDisplayFlag = value;
+    m_displayBusy.store(0);
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void QOpencvProcessor::frameDisplayed()
+{
+    m_displayBusy.storeRelease(0);
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void QOpencvProcessor::emitFrameProcessed(const cv::Mat &frame, quint32 pixels_enrolled)
+{
+    if(m_asyncDisplayFlag && !m_displayBusy.testAndSetOrdered(0, 1)) // display is slower than processing, measurements go on and display drops the frame
+        return;
+    if(m_pixelFormat == YUVInput::BGR)
+    {
+        if(m_asyncDisplayFlag) // queued argument would hold the pooled buffer, so display gets its own copy
+        {
+            frame.copyTo(m_displayFrame); // buffer is reused, the previous frame has been converted by display already
+            emit frameProcessed(m_displayFrame, m_framePeriod, pixels_enrolled);
+        }
+        else
+        {
+            emit frameProcessed(frame, m_framePeriod, pixels_enrolled); // blocking connection does not copy the argument
+        }
+        return;
+    }
+    // raw frame is converted only here, i.e. only for the frames that display really takes
+    const cv::Mat image = YUVInput::getImageView(frame, m_pixelFormat);
+    if(m_displayImageFlag || (m_displayFrame.cols != image.cols) || (m_displayFrame.rows != image.rows))
+        YUVInput::toBGR(frame, m_pixelFormat, m_displayFrame);
+    emit frameProcessed(m_displayFrame, m_framePeriod, pixels_enrolled);
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void QOpencvProcessor::setPixelFormat(int value)
+{
+    m_pixelFormat = (YUVInput::PixelFormat)value;
+    m_displayFrame.release();
 }
 
 //------------------------------------------------------------------------------------------------------
 
-void QOpencvProcessor::customProcess(const cv::Mat &input)
+void QOpencvProcessor::setDisplayImageFlag(bool value)
+{
+    m_displayImageFlag = value;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void QOpencvProcessor::blurRegion(const cv::Mat &input, cv::Mat &output, const cv::Rect &region)
+{
+    switch(m_pixelFormat)
+    {
+        case YUVInput::YUYV: // chroma is interleaved with luma, box filter would mix U and V, so region is taken as is
+            if(output.data != input.data)
+            {
+                const int left = region.x & ~1; // whole Y0 U Y1 V pairs, odd pixels take chroma from the previous element
+                const cv::Rect pairs(left, region.y, std::min(input.cols, (region.x + region.width + 1) & ~1) - left, region.height);
+                cv::Mat(input, pairs).copyTo(cv::Mat(output, pairs));
+            }
+            break;
+        case YUVInput::NV12: { // only Y plane is smoothed, chroma rows of the region are copied when output is a separate buffer
+            const cv::Mat luma = YUVInput::getImageView(input, YUVInput::NV12);
+            cv::Mat lumaOutput = YUVInput::getImageView(output, YUVInput::NV12); // shares data with output
+            const int height = luma.rows;
+            m_reduction.blur(luma, lumaOutput, region, m_blurSize); // filter border does not reach chroma rows
+            if(output.data != input.data)
+            {
+                const int left = region.x & ~1;
+                const cv::Rect chroma(left, height + region.y / 2, std::min(input.cols, (region.x + region.width + 1) & ~1) - left, (region.y + region.height + 1) / 2 - region.y / 2);
+                cv::Mat(input, chroma).copyTo(cv::Mat(output, chroma));
+            }
+        } break;
+        default:
+            m_reduction.blur(input, output, region, m_blurSize);
+            break;
+    }
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void QOpencvProcessor::customProcess(const cv::Mat &input, double timestamp)
 {
     cv::Mat output(input); // Copy the header and pointer to data of input object
     cv::Mat temp; // temporary object
@@ -75,10 +265,9 @@ void QOpencvProcessor::customProcess(const cv::Mat &input)
     }
 
     //-------------Time measurement--------------
-    m_framePeriod = (cv::getTickCount() -  m_timeCounter) * 1000.0 / cv::getTickFrequency(); // result is calculated in milliseconds
-    m_timeCounter = cv::getTickCount();
+    updateFramePeriod(timestamp);
 
-    emit frameProcessed(output, m_framePeriod, output.cols*output.rows);
+    emitFrameProcessed(output, output.cols*output.rows);
 }
 
 //------------------------------------------------------------------------------------------------------
@@ -86,318 +275,436 @@ void QOpencvProcessor::customProcess(const cv::Mat &input)
 void QOpencvProcessor::setRect(const cv::Rect &input_rect)
 {
     m_cvRect = input_rect;
+    v_polygon.clear();
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void QOpencvProcessor::setPolygon(const std::vector<cv::Point> &polygon)
+{
+    v_polygon = polygon;
+    if(polygon.size() > 2)
+        m_cvRect = cv::boundingRect(polygon);
+    else
+        m_cvRect = cv::Rect(0, 0, 0, 0);
+}
+
+//------------------------------------------------------------------------------------------------------
+
+quint32 QOpencvProcessor::addRegion(const cv::Rect &rect)
+{
+    if( (rect.area() == 0) || (v_regions.size() >= MAX_REGIONS) )
+        return 0;
+    Region region;
+    region.id = ++m_regionCounter;
+    region.shape = ROISpans::Rect;
+    region.rect = rect;
+    v_regions.push_back(region);
+    return region.id;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+quint32 QOpencvProcessor::addEllipseRegion(const cv::Rect &rect)
+{
+    const quint32 id = addRegion(rect);
+    if(id > 0)
+        v_regions.back().shape = ROISpans::Ellipse;
+    return id;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+quint32 QOpencvProcessor::addPolygonRegion(const std::vector<cv::Point> &polygon)
+{
+    if(polygon.size() < 3)
+        return 0;
+    const quint32 id = addRegion(cv::boundingRect(polygon));
+    if(id > 0)
+    {
+        v_regions.back().shape = ROISpans::Polygon;
+        v_regions.back().polygon = polygon;
+    }
+    return id;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+quint32 QOpencvProcessor::addMaskRegion(const cv::Mat &mask, const cv::Point &offset)
+{
+    const quint32 id = addRegion(cv::Rect(offset.x, offset.y, mask.cols, mask.rows));
+    if(id > 0)
+    {
+        v_regions.back().shape = ROISpans::Mask;
+        v_regions.back().mask = mask.clone(); // caller could reuse its buffer
+    }
+    return id;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void QOpencvProcessor::removeRegion(quint32 id)
+{
+    for(size_t i = 0; i < v_regions.size(); i++)
+        if(v_regions[i].id == id)
+        {
+            v_regions.erase(v_regions.begin() + i);
+            return;
+        }
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void QOpencvProcessor::clearRegions()
+{
+    v_regions.clear();
 }
 
 //------------------------------------------------------------------------------------------------------
 
 bool QOpencvProcessor::loadClassifier(const std::string &filename)
 {
-    return m_classifier.load( filename );
+    return m_faceDetector.loadClassifier( filename );
 }
 
 //------------------------------------------------------------------------------------------------------
-void QOpencvProcessor::faceProcess(const cv::Mat &input)
+void QOpencvProcessor::faceProcess(const cv::Mat &input, double timestamp)
+{
+    faceRegionProcess(input, timestamp, m_faceDetector.detect(YUVInput::getImageView(input, m_pixelFormat)));
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void QOpencvProcessor::faceRegionProcess(const cv::Mat &input, double timestamp, const cv::Rect &face)
 {
+    const bool lowResMask = m_lowResMaskFlag && m_skinFlag && (m_pixelFormat == YUVInput::BGR) && (input.channels() == 3); // no blur, so input is only read when fill is off
     cv::Mat output;
-    if(f_fill)
+    if(f_fill || lowResMask)
         output = input;
     else
-        output = input.clone();
-
-    cv::Mat gray; // Create an instance of cv::Mat for temporary image storage
-    cv::cvtColor(input, gray, CV_BGR2GRAY);
-    cv::equalizeHist(gray, gray);
-    std::vector<cv::Rect> faces_vector;
-
-    m_classifier.detectMultiScale(gray, faces_vector, 1.1, 7, cv::CASCADE_FIND_BIGGEST_OBJECT, cv::Size(OBJECT_MINSIZE, OBJECT_MINSIZE)); // Detect faces (list of flags CASCADE_DO_CANNY_PRUNING, CASCADE_DO_ROUGH_SEARCH, CASCADE_FIND_BIGGEST_OBJECT, CASCADE_SCALE_IMAGE )
-
-    if(faces_vector.size() == 0) {
-        m_emptyFrames++;
-        if(m_emptyFrames > FRAMES_WITHOUT_FACE_TRESHOLD)
-            setAverageFaceRect(0, 0, 0, 0);
-    } else {
-        m_emptyFrames = 0;
-        enrollFaceRect(faces_vector[0]);
+    {
+        m_workFrame.create(input.rows, input.cols, input.type()); // allocates only when frame size changes, only the face region is written below
+        output = m_workFrame;
     }
-    cv::Rect face = getAverageFaceRect();
 
     unsigned int X = face.x; // the top-left corner horizontal coordinate of future rectangle
     unsigned int Y = face.y; // the top-left corner vertical coordinate of future rectangle
     unsigned int rectwidth = face.width; //...
     unsigned int rectheight = face.height; //...
-    unsigned long red = 0; // an accumulator for red color channel
-    unsigned long green = 0; // an accumulator for green color channel
-    unsigned long blue = 0; // an accumulator for blue color channel
+    quint64 red = 0; // an accumulator for red color channel
+    quint64 green = 0; // an accumulator for green color channel
+    quint64 blue = 0; // an accumulator for blue color channel
     unsigned int dX = rectwidth/16;
     unsigned int dY = rectheight/30;
-    unsigned long area = 0;
+    quint64 area = 0;
+    const bool histogram = isHistogramConnected() && (m_patchCols * m_patchRows == 1); // patches are accumulated without histogram
 
     if(face.area() > 10000)
     {
-        for(int i = 0; i < 256; i++)
-            v_temphist[i] = 0;
-        cv::Mat blurRegion(output, face);
-        cv::blur(blurRegion, blurRegion, cv::Size(m_blurSize, m_blurSize));
+        if(histogram)
+        {
+            for(int i = 0; i < 256; i++)
+                v_temphist[i] = 0;
+        }
+        if(!lowResMask)
+            blurRegion(input, output, face); // in place when f_fill, otherwise into m_workFrame
         m_ellipsRect = cv::Rect(X + dX, Y - 6 * dY, rectwidth - 2 * dX, rectheight + 6 * dY);
         X = m_ellipsRect.x;
         rectwidth = m_ellipsRect.width;
-        unsigned char *p; // this pointer will be used to store adresses of the image rows
-        unsigned char tempBlue;
-        unsigned char tempRed;
-        unsigned char tempGreen;
-        if(output.channels() == 3)
+        const cv::Mat image = YUVInput::getImageView(output, m_pixelFormat);
+        const cv::Rect bounds = cv::Rect(X, Y, rectwidth, rectheight) & cv::Rect(0, 0, image.cols, image.rows);
+        ROIReduction::Params params = {ROIReduction::Plain, 0, 255, &m_skinModel, f_fill, m_pixelFormat, histogram};
+        if((output.channels() == 3) || (m_pixelFormat != YUVInput::BGR))
         {
             if(m_skinFlag)
             {
-                if(f_fill){
-                    for(unsigned int j = Y; j < Y + rectheight; j++) // it is lucky that unsigned int saves from out of image memory cells processing from image top bound, but not from bottom where you should check this issue explicitly
-                    {
-                        p = output.ptr(j); //takes pointer to beginning of data on row
-                        for(unsigned int i = X; i < X + rectwidth; i++)
-                        {
-                            tempBlue = p[3*i];
-                            tempGreen = p[3*i+1];
-                            tempRed = p[3*i+2];
-                            if( isSkinColor(tempRed, tempGreen, tempBlue) && isInEllips(i, j)) {
-                                area++;
-                                blue += tempBlue;
-                                green += tempGreen;
-                                red += tempRed;
-                                //p[3*i] = 255;
-                                //p[3*i+1] %= LEVEL_SHIFT;
-                                p[3*i+2] %= LEVEL_SHIFT;
-                                v_temphist[tempGreen]++;
-                            }
-                        }
-                    }
-                } else {
-                    for(unsigned int j = Y; j < Y + rectheight; j++) // it is lucky that unsigned int saves from out of image memory cells processing from image top bound, but not from bottom where you should check this issue explicitly
-                    {
-                        p = output.ptr(j); //takes pointer to beginning of data on row
-                        for(unsigned int i = X; i < X + rectwidth; i++)
-                        {
-                            tempBlue = p[3*i];
-                            tempGreen = p[3*i+1];
-                            tempRed = p[3*i+2];
-                            if( isSkinColor(tempRed, tempGreen, tempBlue) && isInEllips(i, j)) {
-                                area++;
-                                blue += tempBlue;
-                                green += tempGreen;
-                                red += tempRed;
-                                v_temphist[tempGreen]++;
-                            }
-                        }
-                    }
-                }
-            } else {
-                for(unsigned int j = Y; j < Y + rectheight; j++)
+                m_faceSpans.setEllipse(m_ellipsRect, bounds); // table is rebuilt only when face rect changes
+                params.kernel = (m_skinModelFlag && (m_pixelFormat == YUVInput::BGR)) ? ROIReduction::SkinModel : ROIReduction::SkinRule;
+            }
+            else
+                m_faceSpans.setRect(bounds, bounds);
+        }
+        else
+        {
+            m_faceSpans.setRect(bounds, bounds);
+            params.kernel = ROIReduction::Gray;
+        }
+        const bool masked = lowResMask && (bounds.area() > 0);
+        if(masked) // skin test is made once per cell of the small copy, then original pixels of skin cells are accumulated
+        {
+            m_reduction.skinMask(output, bounds, SKIN_MASK_SCALE, params, m_skinMask);
+            params.kernel = ROIReduction::Plain;
+        }
+        ROISums sums = {0, 0, 0, 0};
+        const int patches = m_patchCols * m_patchRows;
+        if(patches > 1) // all patches are accumulated in one traversal, histogram is not collected
+        {
+            v_patchSpans.resize(patches);
+            v_patchSkinSpans.resize(patches);
+            v_patchRects.resize(patches);
+            v_patchPointers.resize(patches);
+            for(int i = 0; i < patches; i++)
+            {
+                const int col = i % m_patchCols;
+                const int row = i / m_patchCols;
+                cv::Rect &cell = v_patchRects[i];
+                cell = cv::Rect(bounds.x + bounds.width * col / m_patchCols, bounds.y + bounds.height * row / m_patchRows,
+                                    bounds.width * (col + 1) / m_patchCols - bounds.width * col / m_patchCols, bounds.height * (row + 1) / m_patchRows - bounds.height * row / m_patchRows);
+                if(m_faceSpans.getShapeType() == ROISpans::Ellipse)
+                    v_patchSpans[i].setEllipse(m_ellipsRect, cell);
+                else
+                    v_patchSpans[i].setRect(cell, cell);
+                v_patchPointers[i] = &v_patchSpans[i];
+                if(masked)
                 {
-                    p = output.ptr(j); //takes pointer to beginning of data on row
-                    for(unsigned int i = X; i < X + rectwidth; i++)
-                    {
-                        blue += p[3*i];
-                        green += p[3*i+1];
-                        red += p[3*i+2];
-                        if(f_fill)  {
-                            //p[3*i] = 255;
-                            //p[3*i+1] %= LEVEL_SHIFT;
-                            p[3*i+2] %= LEVEL_SHIFT;
-                        }
-                        v_temphist[p[3*i+1]]++;
-                    }
+                    v_patchSkinSpans[i].setIntersection(v_patchSpans[i], m_skinMask, bounds.tl(), SKIN_MASK_SCALE);
+                    v_patchPointers[i] = &v_patchSkinSpans[i];
                 }
-                area = rectwidth*rectheight;
             }
-        } else {
-            for(unsigned int j = Y; j < Y + rectheight; j++)
+            ROISums zero = {0, 0, 0, 0};
+            v_patchSums.assign(patches, zero);
+            m_reduction.run(output, v_patchPointers, params, v_patchSums.data());
+            for(int i = 0; i < patches; i++)
             {
-                p = output.ptr(j);//pointer to beginning of data on rows
-                for(unsigned int i = X; i < X + rectwidth; i++)
+                if(params.kernel == ROIReduction::Gray)
                 {
-                    green += p[i];
-                    //Uncomment if want to see the enrolled domain on image
-                    if(f_fill)  {
-                        p[i] %= LEVEL_SHIFT;
-                    }
-                    v_temphist[p[i]]++;
+                    v_patchSums[i].blue = v_patchSums[i].green;
+                    v_patchSums[i].red = v_patchSums[i].green;
                 }
+                sums.area += v_patchSums[i].area;
             }
+        }
+        else if(masked)
+        {
+            m_skinSpans.setIntersection(m_faceSpans, m_skinMask, bounds.tl(), SKIN_MASK_SCALE);
+            m_reduction.run(output, m_skinSpans, params, sums, v_temphist);
+        }
+        else
+            m_reduction.run(output, m_faceSpans, params, sums, v_temphist);
+        red = sums.red;
+        green = sums.green;
+        blue = sums.blue;
+        area = sums.area;
+        if(params.kernel == ROIReduction::Gray)
+        {
             blue = green;
             red = green;
-            area = rectwidth*rectheight;
         }
     }
 
 
     //-----end of if(faces_vector.size() != 0)-----
-    m_framePeriod = ((double)cv::getTickCount() -  m_timeCounter)*1000.0 / cv::getTickFrequency();
-    m_timeCounter = cv::getTickCount();
+    updateFramePeriod(timestamp);
+    if( (m_patchCols * m_patchRows > 1) && (area > 5000) ) // fusion before the sample goes to QHarmonicProcessor
+    {
+        const ROISums fused = m_patchFusion.fuse(v_patchSums.data(), m_framePeriod);
+        red = fused.red;
+        green = fused.green;
+        blue = fused.blue;
+        area = fused.area;
+    }
     if(area > 5000)
     {
         if(!f_fill)
-            cv::rectangle( cv::Mat(input), face, cv::Scalar(15,15,250));
+        {
+            cv::Mat image = YUVInput::getImageView(input, m_pixelFormat);
+            cv::rectangle(image, face, cv::Scalar(15,15,250));
+            if(m_patchCols * m_patchRows > 1)
+            {
+                for(int i = 0; i < m_patchFusion.getCount(); i++) // brighter cell has bigger weight
+                    cv::rectangle(image, v_patchRects[i], cv::Scalar(15, qMin(55 + (int)(100.0 * m_patchFusion.getWeight(i) * m_patchFusion.getCount()), 255), 15));
+            }
+        }
         emit dataCollected( red , green, blue, area, m_framePeriod);
 
-        unsigned int mass = 0;
-        for(int i = 0; i < 256; i++)
-            mass += v_temphist[i];
-        if(mass > 0)
-        for(int i = 0; i < 256; i++)
-            v_hist[i] = (qreal)v_temphist[i]/mass;
-        emit histUpdated(v_hist, 256);
+        if(histogram)
+            publishHistogram();
     }
     else
     {
-        if(m_classifier.empty())
+        if(m_faceDetector.empty())
             emit selectRegion( QT_TRANSLATE_NOOP("QImageWidget", "Load cascade for detection") );
         else
             emit selectRegion( QT_TRANSLATE_NOOP("QImageWidget", "Come closer or change light") );
     }
-    emit frameProcessed(input, m_framePeriod, area);
+    emitFrameProcessed(input, area);
 }
 
 //------------------------------------------------------------------------------------------------
 
-void QOpencvProcessor::rectProcess(const cv::Mat &input)
+void QOpencvProcessor::facesProcess(const cv::Mat &input, double timestamp)
 {
-    cv::Mat output(input); //Copy constructor
-    unsigned int rectwidth = m_cvRect.width;
-    unsigned int rectheight = m_cvRect.height;
-    unsigned int X = m_cvRect.x;
-    unsigned int Y = m_cvRect.y;
+    cv::Mat output(input);
+    cv::Mat image = YUVInput::getImageView(output, m_pixelFormat);
+    const std::vector<QFaceTracker::Track> &tracks = m_faceTracker.update(m_faceDetector, image);
+    const quint32 count = (quint32)tracks.size();
 
-    if( (output.rows < (Y + rectheight)) || (output.cols < (X + rectwidth)) )
+    v_faceSpans.resize(qMax((size_t)count, v_faceSpans.size())); // tables are kept, so they are rebuilt only when face rect changes
+    v_regionSpans.resize(count);
+    cv::Rect blurRect;
+    for(quint32 i = 0; i < count; i++)
     {
-        rectheight = 0;
-        rectwidth = 0;
+        const cv::Rect &face = tracks[i].rect;
+        if(face.area() > 10000)
+        {
+            const int dX = face.width/16;
+            const int dY = face.height/30;
+            const cv::Rect ellipse(face.x + dX, face.y - 6 * dY, face.width - 2 * dX, face.height + 6 * dY); // the same as in faceRegionProcess(...)
+            const cv::Rect bounds = cv::Rect(ellipse.x, face.y, ellipse.width, face.height) & cv::Rect(0, 0, image.cols, image.rows);
+            if(m_skinFlag && ((output.channels() == 3) || (m_pixelFormat != YUVInput::BGR)))
+                v_faceSpans[i].setEllipse(ellipse, bounds);
+            else
+                v_faceSpans[i].setRect(bounds, bounds);
+            blurRect = (blurRect.area() > 0) ? (blurRect | bounds) : bounds;
+        }
+        else
+            v_faceSpans[i].clear();
+        v_regionSpans[i] = &v_faceSpans[i];
     }
 
-    unsigned long red = 0;
-    unsigned long green = 0;
-    unsigned long blue = 0;
-    unsigned long area = 0;
-    //-------------------------------------------------------------------------
-    if((rectheight > 0) && (rectwidth > 0))
+    ROISums zero = {0, 0, 0, 0};
+    v_regionSums.assign(count, zero);
+    ROIReduction::Params params = {ROIReduction::Plain, 0, 255, &m_skinModel, f_fill, m_pixelFormat, false};
+    if((output.channels() == 3) || (m_pixelFormat != YUVInput::BGR))
     {
-        for(int i = 0; i < 256; i++)
-            v_temphist[i] = 0;
+        if(m_skinFlag)
+            params.kernel = (m_skinModelFlag && (m_pixelFormat == YUVInput::BGR)) ? ROIReduction::SkinModel : ROIReduction::SkinRule;
+    }
+    else
+        params.kernel = ROIReduction::Gray;
+    if(blurRect.area() > 0)
+    {
+        blurRegion(output, output, blurRect);
+        m_reduction.run(output, v_regionSpans, params, v_regionSums.data()); // one traversal for all faces
+    }
 
-        cv::Mat blurRegion(output, m_cvRect);
-        cv::blur(blurRegion, blurRegion, cv::Size(m_blurSize, m_blurSize));
+    updateFramePeriod(timestamp);
+    m_regionFrame.resize(count);
+    m_regionFrame.period = m_framePeriod;
+    quint32 biggest = 0;
+    quint64 enrolled = 0;
+    for(quint32 i = 0; i < count; i++)
+    {
+        if(params.kernel == ROIReduction::Gray)
+        {
+            v_regionSums[i].blue = v_regionSums[i].green;
+            v_regionSums[i].red = v_regionSums[i].green;
+        }
+        if(v_regionSums[i].area <= 5000) // too small or too dark face, its processor waits
+            v_regionSums[i] = zero;
+        m_regionFrame.id[i] = tracks[i].id;
+        m_regionFrame.red[i] = v_regionSums[i].red;
+        m_regionFrame.green[i] = v_regionSums[i].green;
+        m_regionFrame.blue[i] = v_regionSums[i].blue;
+        m_regionFrame.area[i] = v_regionSums[i].area;
+        if(v_regionSums[i].area > v_regionSums[biggest].area)
+            biggest = i;
+        enrolled += v_regionSums[i].area;
+    }
 
-        unsigned char *p; // a pointer to store the adresses of image rows
-        if(output.channels() == 3)
+    if(enrolled > 0)
+    {
+        if(!f_fill)
         {
-            if(m_seekCalibColors)
-            {
-                unsigned char tempRed;
-                unsigned char tempGreen;
-                unsigned char tempBlue;
-                for(unsigned int j = Y; j < Y + rectheight; j++)
-                {
-                    p = output.ptr(j); //takes pointer to beginning of data on rows
-                    for(unsigned int i = X; i < X + rectwidth; i++)
-                    {
-                        tempBlue = p[3*i];
-                        tempGreen = p[3*i+1];
-                        tempRed = p[3*i+2];
-                        if( isCalibColor(tempGreen) && isSkinColor(tempRed, tempGreen, tempBlue) ) {
-                            area++;
-                            blue += tempBlue;
-                            green += tempGreen;
-                            red += tempRed;
-                            if(f_fill)  {
-                                //p[3*i] = 255;
-                                //p[3*i+1] %= LEVEL_SHIFT;
-                                p[3*i+2] %= LEVEL_SHIFT;
-                            }
-                            v_temphist[tempGreen]++;
-                        }
-                    }
-                }
-            } else {
-            if(m_skinFlag)
+            for(quint32 i = 0; i < count; i++)
             {
-                unsigned char tempRed;
-                unsigned char tempGreen;
-                unsigned char tempBlue;
-                for(unsigned int j = Y; j < Y + rectheight; j++)
-                {
-                    p = output.ptr(j); //takes pointer to beginning of data on rows
-                    for(unsigned int i = X; i < X + rectwidth; i++)
-                    {
-                        tempBlue = p[3*i];
-                        tempGreen = p[3*i+1];
-                        tempRed = p[3*i+2];
-                        if( isSkinColor(tempRed, tempGreen, tempBlue)) {
-                            area++;
-                            blue += tempBlue;
-                            green += tempGreen;
-                            red += tempRed;
-                            if(f_fill)  {
-                                //p[3*i] = 255;
-                                //p[3*i+1] %= LEVEL_SHIFT;
-                                p[3*i+2] %= LEVEL_SHIFT;
-                            }
-                            v_temphist[tempGreen]++;
-                        }
-                    }
-                }
-            }
-            else
-            {
-                for(unsigned int j = Y; j < Y + rectheight; j++)
-                {
-                    p = output.ptr(j); //takes pointer to beginning of data on rows
-                    for(unsigned int i = X; i < X + rectwidth; i++)
-                    {
-                        blue += p[3*i];
-                        green += p[3*i+1];
-                        red += p[3*i+2];
-                        if(f_fill)  {
-                            //p[3*i] = 255;
-                            //p[3*i+1] %= LEVEL_SHIFT;
-                            p[3*i+2] %= LEVEL_SHIFT;
-                        }
-                        v_temphist[p[3*i+1]]++;
-                    }
-                }
-                area = rectwidth*rectheight;
-            }
+                cv::rectangle(image, tracks[i].rect, cv::Scalar(15,15,250));
+                cv::putText(image, QString::number(tracks[i].id).toStdString(), cv::Point(tracks[i].rect.x + 2, tracks[i].rect.y + 14), cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(15,15,250));
             }
         }
+        const ROISums &sums = v_regionSums[biggest];
+        emit dataCollected(sums.red, sums.green, sums.blue, sums.area, m_framePeriod);
+    }
+    else
+    {
+        if(m_faceDetector.empty())
+            emit selectRegion( QT_TRANSLATE_NOOP("QImageWidget", "Load cascade for detection") );
         else
+            emit selectRegion( QT_TRANSLATE_NOOP("QImageWidget", "Come closer or change light") );
+    }
+    emit regionsProcessed(&m_regionFrame); // also when faces are lost, so the pool drops their processors
+    emitFrameProcessed(output, enrolled);
+}
+
+//------------------------------------------------------------------------------------------------
+
+void QOpencvProcessor::rectProcess(const cv::Mat &input, double timestamp)
+{
+    cv::Mat output(input); //Copy constructor
+    cv::Mat image = YUVInput::getImageView(output, m_pixelFormat); // Y plane header for NV12, output itself otherwise
+    const cv::Rect bounds(0, 0, image.cols, image.rows);
+    if(v_polygon.empty())
+        m_regionSpans.setRect(m_cvRect, bounds);
+    else
+        m_regionSpans.setPolygon(v_polygon, bounds); // both calls rebuild the table only when the region or frame size changes
+    const cv::Rect region = m_cvRect & bounds;
+
+    quint64 red = 0;
+    quint64 green = 0;
+    quint64 blue = 0;
+    quint64 area = 0;
+    const bool histogram = isHistogramConnected();
+    //-------------------------------------------------------------------------
+    if(m_regionSpans.getArea() > 0)
+    {
+        if(histogram)
         {
-            for(unsigned int j = Y; j < Y + rectheight; j++)
+            for(int i = 0; i < 256; i++)
+                v_temphist[i] = 0;
+        }
+
+        const bool lowResMask = m_lowResMaskFlag && (m_seekCalibColors || m_skinFlag) && (m_pixelFormat == YUVInput::BGR) && (output.channels() == 3);
+        if(!lowResMask)
+            blurRegion(output, output, region);
+
+        ROIReduction::Params params = {ROIReduction::Plain, 0, 255, &m_skinModel, f_fill, m_pixelFormat, histogram};
+        if(m_pixelFormat != YUVInput::BGR)
+        {
+            if(m_seekCalibColors || m_skinFlag) // skin model and calibrated green range need BGR, chroma rule is used instead
+                params.kernel = ROIReduction::SkinRule;
+        }
+        else if(output.channels() == 3)
+        {
+            if(m_calibFlag)
+                trainSkinModel(output); // before accumulation, because fill changes colors
+            if(m_skinModelFlag && (m_seekCalibColors || m_skinFlag)) // calibrated model already contains the green range
+                params.kernel = ROIReduction::SkinModel;
+            else if(m_seekCalibColors || m_skinFlag)
             {
-                p = output.ptr(j);//pointer to beginning of data on rows
-                for(unsigned int i = X; i < X + rectwidth; i++)
-                {
-                    green += p[i];
-                    if(f_fill)  {
-                        p[i] %= LEVEL_SHIFT;
-                    }
-                    v_temphist[p[i]]++;
-                }
+                params.kernel = ROIReduction::SkinRule;
+                if(m_seekCalibColors)
+                    getCalibRange(params.greenMin, params.greenMax);
             }
-            area = rectwidth*rectheight;
         }
+        else
+            params.kernel = ROIReduction::Gray;
+        ROISums sums = {0, 0, 0, 0};
+        if(lowResMask) // skin test is made once per cell of the small copy, then original pixels of skin cells are accumulated
+        {
+            m_reduction.skinMask(output, region, SKIN_MASK_SCALE, params, m_skinMask);
+            m_skinSpans.setIntersection(m_regionSpans, m_skinMask, region.tl(), SKIN_MASK_SCALE);
+            params.kernel = ROIReduction::Plain;
+            m_reduction.run(output, m_skinSpans, params, sums, v_temphist);
+        }
+        else
+            m_reduction.run(output, m_regionSpans, params, sums, v_temphist);
+        red = sums.red;
+        green = sums.green;
+        blue = sums.blue;
+        area = sums.area;
     }
-    //------end of if((rectheight > 0) && (rectwidth > 0))
-    m_framePeriod = ((double)cv::getTickCount() -  m_timeCounter)*1000.0 / cv::getTickFrequency();
-    m_timeCounter = cv::getTickCount();
+    //------end of if(m_regionSpans.getArea() > 0)
+    updateFramePeriod(timestamp);
     if( area > 0 )
     {
-        cv::rectangle( output , m_cvRect, cv::Scalar(15,250,15));
+        if(v_polygon.empty())
+            cv::rectangle( image , m_cvRect, cv::Scalar(15,250,15));
+        else
+            cv::polylines( image, v_polygon, true, cv::Scalar(15,250,15));
         emit dataCollected(red, green, blue, area, m_framePeriod);
 
-        unsigned int mass = 0;
-        for(int i = 0; i < 256; i++)
-            mass += v_temphist[i];
-        if(mass > 0)
-        for(int i = 0; i < 256; i++)
-            v_hist[i] = (qreal)v_temphist[i]/mass;
-        emit histUpdated(v_hist, 256);
+        if(histogram)
+            publishHistogram();
 
         if(m_calibFlag)
         {
@@ -417,6 +724,9 @@ void QOpencvProcessor::rectProcess(const cv::Mat &input)
                 m_calibSamples = 0;
                 m_calibFlag = false;
                 m_seekCalibColors = true;
+                unsigned char greenMin, greenMax;
+                getCalibRange(greenMin, greenMax);
+                m_skinModelFlag = m_skinModel.endTraining(greenMin, greenMax);
                 emit calibrationDone(m_calibMean, m_calibError/10, m_calibSamples);
             }
         }
@@ -425,94 +735,187 @@ void QOpencvProcessor::rectProcess(const cv::Mat &input)
     {
         emit selectRegion( QT_TRANSLATE_NOOP("QImageWidget", "Select region on image" ) );
     }
-    emit frameProcessed(output, m_framePeriod, area);
+    emitFrameProcessed(output, area);
 }
 
 //-----------------------------------------------------------------------------------------------
 
-void QOpencvProcessor::mapProcess(const cv::Mat &input)
+void QOpencvProcessor::mapProcess(const cv::Mat &input, double /*timestamp*/)
 {
-    cv::Mat output(input);
     int X = m_mapRect.x;
     int Y = m_mapRect.y;
     int W = m_mapRect.width;
     int H = m_mapRect.height;
+    const cv::Mat image = YUVInput::getImageView(input, m_pixelFormat); // NV12 buffer is taller than the image that the map covers
 
-    if((output.cols >= (X+W)) && (output.rows >= (Y+H)))
+    if((image.cols >= (X+W)) && (image.rows >= (Y+H)) && (W >= m_mapCellSizeX) && (H >= m_mapCellSizeY) && (m_mapCellSizeX > 0) && (m_mapCellSizeY > 0))
     {
-        int stepsY = H / m_mapCellSizeY;
-        int stepsX = W / m_mapCellSizeX;
+        int stepsY = (H - m_mapCellSizeY) / m_mapStrideY + 1;
+        int stepsX = (W - m_mapCellSizeX) / m_mapStrideX + 1;
         int area = m_mapCellSizeY*m_mapCellSizeX;
 
-        unsigned long sumRed = 0;
-        unsigned long sumBlue = 0;
-        unsigned long sumGreen = 0;
-
-        int performance_pill;
-
-        if(input.channels() == 3)
+        // one pass over the map region, then every cell costs four lookups whatever its size and overlap are
+        cv::Mat source(input);
+        if(m_pixelFormat != YUVInput::BGR) // cells need R, G, B sums of every pixel, so raw frame is converted here
+        {
+            YUVInput::toBGR(input, m_pixelFormat, m_mapSource);
+            source = m_mapSource;
+        }
+        cv::integral(cv::Mat(source, m_mapRect), m_mapIntegral, CV_32S);
+        m_mapFrame.resize(stepsX, stepsY);
+        m_mapFrame.area = area;
+        m_mapFrame.period = m_framePeriod; // the slot is connected after rectProcess(...) or regionsProcess(...), they have updated period for this frame
+        const int channels = source.channels();
+        quint64 *red = m_mapFrame.red.data();
+        quint64 *green = m_mapFrame.green.data();
+        quint64 *blue = m_mapFrame.blue.data();
+        for(int i = 0; i < stepsY; i++)
         {
-            for(int i = 0; i < stepsY; i++)
+            // partial sums could wrap around 32 bits for large regions, unsigned arithmetic gives exact cell sums anyway
+            const quint32 *top = m_mapIntegral.ptr<quint32>(i*m_mapStrideY);
+            const quint32 *bottom = m_mapIntegral.ptr<quint32>(i*m_mapStrideY + m_mapCellSizeY);
+            for(int j = 0; j < stepsX; j++)
             {
-                for(int p = 0; p < m_mapCellSizeY; p++)
+                const int left = channels * j*m_mapStrideX;
+                const int right = left + channels * m_mapCellSizeX;
+                if(channels == 3)
                 {
-                    v_pixelSet[p] = output.ptr(Y + i*m_mapCellSizeY + p);
+                    *blue = bottom[right] - bottom[left] - top[right] + top[left];
+                    *green = bottom[right+1] - bottom[left+1] - top[right+1] + top[left+1];
+                    *red = bottom[right+2] - bottom[left+2] - top[right+2] + top[left+2];
                 }
-                for(int j = 0; j < stepsX; j++)
+                else
                 {
-                    for(int k = 0; k < m_mapCellSizeX; k++)
-                    {
-                        performance_pill = 3*(X + j*m_mapCellSizeX + k);
-                        for(int p = 0; p < m_mapCellSizeY; p++)
-                        {
-                            sumBlue += v_pixelSet[p][performance_pill];
-                            sumGreen += v_pixelSet[p][performance_pill + 1];
-                            sumRed += v_pixelSet[p][performance_pill + 2];
-                        }
-                    }
-                    emit mapCellProcessed(sumRed, sumGreen, sumBlue, area, m_framePeriod);
-                    sumBlue = 0;
-                    sumGreen = 0;
-                    sumRed = 0;
+                    *green = bottom[right] - bottom[left] - top[right] + top[left];
+                    *blue = *green;
+                    *red = *green;
                 }
+                red++;
+                green++;
+                blue++;
             }
         }
-        else
+        emit mapFrameProcessed(&m_mapFrame); // one handoff for the whole map, connect it by Qt::BlockingQueuedConnection because m_mapFrame is rewritten by the next frame
+    }
+}
+
+//-----------------------------------------------------------------------------------------------
+
+void QOpencvProcessor::regionsProcess(const cv::Mat &input, double timestamp)
+{
+    cv::Mat output(input);
+    cv::Mat image = YUVInput::getImageView(output, m_pixelFormat);
+    const cv::Rect bounds(0, 0, image.cols, image.rows);
+    const quint32 count = (quint32)v_regions.size();
+
+    v_regionSpans.resize(count);
+    cv::Rect blurRect;
+    for(quint32 i = 0; i < count; i++)
+    {
+        Region &region = v_regions[i];
+        switch(region.shape) // tables are rebuilt only when frame size changes
+        {
+            case ROISpans::Ellipse:
+                region.spans.setEllipse(region.rect, bounds);
+                break;
+            case ROISpans::Polygon:
+                region.spans.setPolygon(region.polygon, bounds);
+                break;
+            case ROISpans::Mask:
+                region.spans.setMask(region.mask, region.rect.tl(), bounds);
+                break;
+            default:
+                region.spans.setRect(region.rect, bounds);
+                break;
+        }
+        v_regionSpans[i] = &region.spans;
+        blurRect = (blurRect.area() > 0) ? (blurRect | (region.rect & bounds)) : (region.rect & bounds);
+    }
+
+    ROISums zero = {0, 0, 0, 0};
+    v_regionSums.assign(count, zero);
+    ROIReduction::Params params = {ROIReduction::Plain, 0, 255, &m_skinModel, f_fill, m_pixelFormat, false};
+    if((output.channels() == 3) || (m_pixelFormat != YUVInput::BGR))
+    {
+        if(m_skinFlag)
+            params.kernel = (m_skinModelFlag && (m_pixelFormat == YUVInput::BGR)) ? ROIReduction::SkinModel : ROIReduction::SkinRule;
+    }
+    else
+        params.kernel = ROIReduction::Gray;
+    if(blurRect.area() > 0)
+    {
+        blurRegion(output, output, blurRect); // once for all regions, so overlapped parts are not smoothed twice
+        m_reduction.run(output, v_regionSpans, params, v_regionSums.data()); // one traversal for all regions
+    }
+
+    updateFramePeriod(timestamp);
+    m_regionFrame.resize(count);
+    m_regionFrame.period = m_framePeriod;
+    ROISums total = {0, 0, 0, 0};
+    for(quint32 i = 0; i < count; i++)
+    {
+        if(params.kernel == ROIReduction::Gray)
+        {
+            v_regionSums[i].blue = v_regionSums[i].green;
+            v_regionSums[i].red = v_regionSums[i].green;
+        }
+        m_regionFrame.id[i] = v_regions[i].id;
+        m_regionFrame.red[i] = v_regionSums[i].red;
+        m_regionFrame.green[i] = v_regionSums[i].green;
+        m_regionFrame.blue[i] = v_regionSums[i].blue;
+        m_regionFrame.area[i] = v_regionSums[i].area;
+        total.red += v_regionSums[i].red;
+        total.green += v_regionSums[i].green;
+        total.blue += v_regionSums[i].blue;
+        total.area += v_regionSums[i].area;
+    }
+
+    if(total.area > 0)
+    {
+        for(quint32 i = 0; i < count; i++)
         {
-            for(int i = 0; i < stepsY; i++)
+            const Region &region = v_regions[i];
+            switch(region.shape)
             {
-                for(int p = 0; p < m_mapCellSizeY; p++)
-                {
-                    v_pixelSet[p] = output.ptr(Y + i*m_mapCellSizeY + p);
-                }
-                for(int j = 0; j < stepsX; j++)
-                {
-                    for(int k = 0; k < m_mapCellSizeX; k++)
-                    {
-                        performance_pill = X + j*m_mapCellSizeX + k;
-                        for(int p = 0; p < m_mapCellSizeY; p++)
-                        {
-                            sumBlue += v_pixelSet[p][performance_pill];
-                        }
-                    }
-                    emit mapCellProcessed(sumBlue, sumBlue, sumBlue, area, m_framePeriod);
-                    sumBlue = 0;
-                }
+                case ROISpans::Ellipse:
+                    cv::ellipse(image, cv::Point(region.rect.x + region.rect.width/2, region.rect.y + region.rect.height/2), cv::Size(region.rect.width/2, region.rect.height/2), 0.0, 0.0, 360.0, cv::Scalar(15,250,15));
+                    break;
+                case ROISpans::Polygon:
+                    cv::polylines(image, region.polygon, true, cv::Scalar(15,250,15));
+                    break;
+                default:
+                    cv::rectangle(image, region.rect, cv::Scalar(15,250,15));
+                    break;
             }
+            cv::putText(image, QString::number(region.id).toStdString(), cv::Point(region.rect.x + 2, region.rect.y + 14), cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(15,250,15));
         }
+        emit dataCollected(total.red, total.green, total.blue, total.area, m_framePeriod); // main harmonic processor gets all regions as one
     }
+    else
+    {
+        emit selectRegion( QT_TRANSLATE_NOOP("QImageWidget", "Select regions on image" ) );
+    }
+    emit regionsProcessed(&m_regionFrame); // also when regions are cleared, so the pool drops their processors
+    emitFrameProcessed(output, total.area);
 }
 
+//-----------------------------------------------------------------------------------------------
+
 void QOpencvProcessor::setMapCellSize(quint16 sizeX, quint16 sizeY)
 {
     m_mapCellSizeX = sizeX;
     m_mapCellSizeY = sizeY;
-    if(v_pixelSet)
+    m_mapStrideX = sizeX;
+    m_mapStrideY = sizeY;
+}
+
+void QOpencvProcessor::setMapCellStride(quint16 strideX, quint16 strideY)
+{
+    if((strideX > 0) && (strideY > 0))
     {
-        delete[] v_pixelSet;
-        v_pixelSet = NULL;
+        m_mapStrideX = strideX;
+        m_mapStrideY = strideY;
     }
-    v_pixelSet = new unsigned char*[m_mapCellSizeY];
 }
 
 void QOpencvProcessor::setSkinSearchingFlag(bool value)
@@ -524,45 +927,72 @@ void QOpencvProcessor::calibrate(bool value)
 {
     if(!value) {
         m_seekCalibColors = false;
+        m_skinModelFlag = false;
         return;
     } else {
         m_calibFlag = true;
         m_calibSamples = 0;
         m_calibMean = 0.0;
+        m_skinModelFlag = false; // rule-based test is used while the model is trained
+        m_skinModel.beginTraining();
     }
 }
 
-void QOpencvProcessor::setBlurSize(uint size)
+//-----------------------------------------------------------------------------------------------
+
+bool QOpencvProcessor::loadSkinModel(const QString &fileName)
 {
-    if(size > 1)
+    if(!m_skinModel.load(fileName)) // model and calibration in progress are kept, load does not touch them on failure
     {
-        m_blurSize = size;
+        qWarning("Can not load skin model from %s", fileName.toLocal8Bit().constData());
+        return false;
+    }
+    if(m_calibFlag) // load drops the training counts, so calibration in progress is cancelled
+    {
+        m_calibFlag = false;
+        m_calibSamples = 0;
     }
+    m_skinModelFlag = true;
+    return true;
 }
 
-cv::Rect QOpencvProcessor::getAverageFaceRect() const
+//-----------------------------------------------------------------------------------------------
+
+bool QOpencvProcessor::saveSkinModel(const QString &fileName)
 {
-    qreal x = 0.0;
-    qreal y = 0.0;
-    qreal w = 0.0;
-    qreal h = 0.0;
-    for(quint8 i = 0; i < FACE_RECT_VECTOR_LENGTH; i++) {
-        x += v_faceRect[i].x;
-        y += v_faceRect[i].y;
-        w += v_faceRect[i].width;
-        h += v_faceRect[i].height;
+    if(!m_skinModel.save(fileName))
+    {
+        qWarning("Can not save skin model to %s", fileName.toLocal8Bit().constData());
+        return false;
     }
-    x /= FACE_RECT_VECTOR_LENGTH;
-    y /= FACE_RECT_VECTOR_LENGTH;
-    w /= FACE_RECT_VECTOR_LENGTH;
-    h /= FACE_RECT_VECTOR_LENGTH;
-    return cv::Rect(x, y, w, h);
+    return true;
 }
 
-void QOpencvProcessor::enrollFaceRect(const cv::Rect &rect)
+//-----------------------------------------------------------------------------------------------
+
+void QOpencvProcessor::trainSkinModel(const cv::Mat &image)
 {
-    v_faceRect[m_facePos] = rect;
-    m_facePos = (++m_facePos) % FACE_RECT_VECTOR_LENGTH;
+    if(!m_skinModel.isTraining())
+        return;
+    const unsigned char *p;
+    const ROISpan *span;
+    for(int j = m_regionSpans.getTop(); j < m_regionSpans.getBottom(); j++)
+    {
+        p = image.ptr(j);
+        span = m_regionSpans.getSpans(j);
+        for(int k = 0; k < m_regionSpans.getCount(j); k++)
+            for(int i = span[k].begin; i < span[k].end; i++)
+                if(isSkinPixel(p[3*i+2], p[3*i+1], p[3*i]))
+                    m_skinModel.train(p[3*i], p[3*i+1], p[3*i+2]);
+    }
+}
+
+void QOpencvProcessor::setBlurSize(uint size)
+{
+    if(size > 1)
+    {
+        m_blurSize = size;
+    }
 }
 
 void QOpencvProcessor::setFillFlag(bool value)
@@ -570,14 +1000,9 @@ void QOpencvProcessor::setFillFlag(bool value)
     f_fill = value;
 }
 
-void QOpencvProcessor::setAverageFaceRect(uint x, uint y, uint w, uint h)
+void QOpencvProcessor::setLowResMaskFlag(bool value)
 {
-    for(quint8 i = 0; i < FACE_RECT_VECTOR_LENGTH; i++) {
-        v_faceRect[i].x = x;
-        v_faceRect[i].y = y;
-        v_faceRect[i].width = w;
-        v_faceRect[i].height = h;
-    }
+    m_lowResMaskFlag = value;
 }
 
 uint QOpencvProcessor::getBlurSize() const
@@ -587,5 +1012,41 @@ uint QOpencvProcessor::getBlurSize() const
 
 void QOpencvProcessor::resetFaceRect()
 {
-    setAverageFaceRect(0,0,0,0);
+    m_faceDetector.reset();
+    m_faceTracker.reset();
+}
+
+void QOpencvProcessor::setPatchCount(int value)
+{
+    if( (value < 1) || (value > MAX_PATCHES) )
+        return;
+    m_patchCols = (int)std::sqrt((double)value); // 2 - one above another, 4 - 2x2, 6 - 2x3, 9 - 3x3
+    m_patchRows = (value + m_patchCols - 1) / m_patchCols;
+    m_patchFusion.setCount(m_patchCols * m_patchRows);
+}
+
+void QOpencvProcessor::setDetectionPeriod(int value)
+{
+    m_faceDetector.setDetectionPeriod(value);
+}
+
+void QOpencvProcessor::setDetectionDownscale(int value)
+{
+    if(value > 0)
+        m_faceDetector.setDetectionScale(1.0 / value);
+}
+
+void QOpencvProcessor::getCalibRange(unsigned char &greenMin, unsigned char &greenMax) const
+{
+    // integer bounds of isCalibColor(...): (mean - error) < green < (mean + error)
+    const qreal low = std::floor(m_calibMean - m_calibError) + 1.0;
+    const qreal high = std::ceil(m_calibMean + m_calibError) - 1.0;
+    if( (low > high) || (high < 0.0) || (low > 255.0) )
+    {
+        greenMin = 255; // empty range
+        greenMax = 0;
+        return;
+    }
+    greenMin = (unsigned char)qMax(low, 0.0);
+    greenMax = (unsigned char)qMin(high, 255.0);
 }
@@ -11,9 +11,22 @@ The simplest way to use it - rewrite appropriate section in QOpencvProcessor::cu
 #include <QObject>
 #include <opencv2/opencv.hpp>
 
+#include "qframering.h"
+#include "qframepool.h"
+#include "qfacedetector.h"
+#include "qfacetracker.h"
+#include "roispans.h"
+#include "skinlut.h"
+#include "roireduction.h"
+#include "yuvinput.h"
+#include "qmapframe.h"
+#include "qregionframe.h"
+#include "patchfusion.h"
+
 #define CALIBRATION_VECTOR_LENGTH 25
-#define FACE_RECT_VECTOR_LENGTH 16
-#define FRAMES_WITHOUT_FACE_TRESHOLD 16
+#define MAX_REGIONS 16 // limit of regionsProcess(...) regions
+#define SKIN_MASK_SCALE 4 // cell size in pixels of the low resolution skin mask
+#define HIST_PUBLISH_PERIOD 200.0 // ms, histUpdated(...) is not emitted more often, histograms of frames between are summed
 
 //------------------------------------------------------------------------------------------------------
 
@@ -25,64 +38,141 @@ public:
 
 signals:
     void frameProcessed(const cv::Mat& value, double frame_period, quint32 pixels_enrolled); //should be emited in the end of each frame processing
-    void dataCollected(unsigned long red, unsigned long green, unsigned long blue, unsigned long area, double period);
+    void dataCollected(quint64 red, quint64 green, quint64 blue, quint64 area, double period);
     void selectRegion(const char * string);     // emit it if no objects has been detected or no regions are selected
-    void mapCellProcessed(unsigned long red, unsigned long green, unsigned long blue, unsigned long area, double period);
+    void mapFrameProcessed(const QMapFrame *frame); // all cells of the map for one frame, the record is valid until the next mapProcess(...) call
+    void regionsProcessed(const QRegionFrame *frame); // all regions of regionsProcess(...) for one frame, the record is valid until the next call
     void mapRegionUpdated(const cv::Rect& rect);
     void calibrationDone(qreal mean, qreal stdev, quint16 samples);
-    void histUpdated(const qreal *pt, quint16 length);
+    void histUpdated(const qreal *pt, quint16 length); // histogram is collected only while this signal is connected
+    void mediaClockTick(); // emitted every m_mediaClockInterval ms of frame timestamps, every processed frame counts whether a face has been found or not, use it instead of wall clock timer for offline processing
+    void frameDequeued(const cv::Mat& value, double timestamp, const cv::Rect& roi); // emitted by drainFrameRing() for each frame, connect it to appropriate process slot by Qt::DirectConnection, roi is the face found by QDetectionStage
 
 public slots:
-    void customProcess(const cv::Mat &input);   // just a template of how a program logic should work
+    void customProcess(const cv::Mat &input, double timestamp = -1.0);   // just a template of how a program logic should work
     void updateTime();                          // use it in the beginning of any time-measurement operations
     void setRect(const cv::Rect &input_rect);   // sets m_cvrect
-    void faceProcess(const cv::Mat &input);     // an algorithm that evaluates PPG from skin region, region evaluates by means of opencv's cascadeclassifier functions
-    void rectProcess(const cv::Mat &input);     // an algorithm that evaluates PPG from skin region defined by user
+    void setPolygon(const std::vector<cv::Point> &polygon); // sets region of rectProcess(...) to polygon, m_cvRect becomes its bounding rect, setRect(...) drops polygon
+    void faceProcess(const cv::Mat &input, double timestamp = -1.0);     // an algorithm that evaluates PPG from skin region, region evaluates by means of opencv's cascadeclassifier functions
+    void faceRegionProcess(const cv::Mat &input, double timestamp, const cv::Rect &face); // the accumulation part of faceProcess(...), face has been already found by detection stage
+    void facesProcess(const cv::Mat &input, double timestamp = -1.0);    // all faces are tracked, sums of every face are sent by regionsProcessed(...) with track id, the biggest face goes to dataCollected(...)
+    void rectProcess(const cv::Mat &input, double timestamp = -1.0);     // an algorithm that evaluates PPG from skin region defined by user
     bool loadClassifier(const std::string& filename); // an interface to CascadeClassifier::load(...) function
-    void mapProcess(const cv::Mat &input);
-    void calibrate(bool value);
+    void mapProcess(const cv::Mat &input, double timestamp = -1.0); // runs along with another process slot on the same frame, so it does not update frame period itself
+    void regionsProcess(const cv::Mat &input, double timestamp = -1.0); // accumulates all regions of v_regions in one pass, each of them separately
+    quint32 addRegion(const cv::Rect &rect);    // all add functions return id of the new region, or 0 if region could not be added
+    quint32 addEllipseRegion(const cv::Rect &rect);
+    quint32 addPolygonRegion(const std::vector<cv::Point> &polygon);
+    quint32 addMaskRegion(const cv::Mat &mask, const cv::Point &offset); // nonzero pixels of 8-bit mask, its top-left corner is placed at offset
+    void removeRegion(quint32 id);
+    void clearRegions();
+    void setFrameRing(QFrameRing *ring, QFramePool *pool); // sets the source for drainFrameRing() and the pool where processed frames are released
+    void setAsyncDisplay(bool value);           // true - frameProcessed(...) is emitted only when display has shown the previous frame, connect it by Qt::QueuedConnection then
+    void frameDisplayed();                      // display should call it (Qt::DirectConnection) when it has done with the frame in async display mode
+    void drainFrameRing();                      // pops all frames from pt_frameRing, emits frameDequeued(...) for each of them and releases them to pt_framePool
+    void calibrate(bool value);                 // true - starts calibration on selected region, skin model is trained on it, false - returns to the rule-based skin test
+    bool loadSkinModel(const QString &fileName); // on success skin pixels are classified by the loaded model
+    bool saveSkinModel(const QString &fileName); // saves the model of the last calibration or the loaded one
     void setBlurSize(uint size);
 
     cv::Rect getRect(); // returns current m_cvRect
     void setMapRegion(const cv::Rect &input_rect); // sets up map region, see m_mapRect
-    void setMapCellSize(quint16 sizeX, quint16 sizeY);
+    void setMapCellSize(quint16 sizeX, quint16 sizeY); // also sets stride equal to cell size, so cells do not overlap
+    void setMapCellStride(quint16 strideX, quint16 strideY); // distance between neighbour map cells, cells overlap if it is less than cell size
     void setSkinSearchingFlag(bool value);
     void setFillFlag(bool value);
+    void setLowResMaskFlag(bool value); // true - skin test is made on the downscaled region instead of the blurred one, sums are taken from unblurred pixels, BGR frames only
     uint getBlurSize() const;
     void resetFaceRect();
+    void setDetectionPeriod(int value);         // cascade runs every value frames, face is tracked on the rest
+    void setDetectionDownscale(int value);      // cascade input is downscaled value times
+    void setPixelFormat(int value);             // YUVInput::PixelFormat of the incoming frames, raw frames are processed without conversion
+    void setDisplayImageFlag(bool value);       // false - raw frames are not converted for display, the last converted frame is shown
+    void setPatchCount(int value);              // face ellipse of faceRegionProcess(...) is split into value patches fused by SNR, 1 disables split
+    void setMediaClockInterval(int value);      // in ms of frame timestamps, 0 disables mediaClockTick()
 
 private:
     bool m_fullFaceFlag;
     bool m_skinFlag;
-    int64 m_timeCounter;    // stores time of application/computer start
-    double m_framePeriod;   // stores time of frame processing
+    double m_lastTimestamp; // stores timestamp of the previous frame in ms
+    double m_framePeriod;   // stores time between the previous and the current frame in ms
+    int m_mediaClockInterval;
+    double m_mediaClockCounter;
     cv::Rect m_cvRect;      // this rect is used by process_rectregion_pulse slot
-    cv::CascadeClassifier m_classifier; //object that manages opencv's image recognition functions
+    std::vector<cv::Point> v_polygon; // if not empty, rectProcess(...) enrolls pixels inside this polygon instead of m_cvRect
+    ROISpans m_regionSpans; // span table of rectProcess(...) region
+    ROISpans m_faceSpans;   // span table of face ellipse in faceRegionProcess(...)
+    int m_patchCols;        // grid of face patches, see setPatchCount(...)
+    int m_patchRows;
+    std::vector<ROISpans> v_patchSpans; // face ellipse clipped by every cell of the grid
+    std::vector<cv::Rect> v_patchRects; // cells of the grid
+    std::vector<const ROISpans *> v_patchPointers;
+    std::vector<ROISums> v_patchSums;
+    std::vector<ROISpans> v_patchSkinSpans; // patches cut by m_skinMask
+    PatchFusion m_patchFusion;
+    ROIReduction m_reduction; // accumulates regions of faceRegionProcess(...) and rectProcess(...) by parallel stripes
+    QFaceDetector m_faceDetector; // object that finds face when detection stage is not used
+    QFaceTracker m_faceTracker; // tracks of facesProcess(...)
+    std::vector<ROISpans> v_faceSpans; // span tables of face ellipses in facesProcess(...), one per track
     quint16 m_mapCellSizeX;
     quint16 m_mapCellSizeY;
     cv::Rect m_mapRect;
-    unsigned char **v_pixelSet; // memory should be allocated in setMapCellSize() call
+    quint16 m_mapStrideX;
+    quint16 m_mapStrideY;
+    cv::Mat m_mapIntegral;  // integral image of m_mapRect, reused between frames
+    QMapFrame m_mapFrame;   // sums of map cells of the current frame
     bool m_calibFlag;
     bool m_seekCalibColors;
     quint16 m_calibSamples;
     qreal m_calibMean;
     qreal m_calibError;
     quint8 v_calibValues[CALIBRATION_VECTOR_LENGTH];   
+    SkinLUT m_skinModel;    // table skin model, trained during calibration or loaded from file
+    bool m_skinModelFlag;   // true - m_skinModel is used instead of isSkinColor(...) rule
     uint m_blurSize;
+    bool m_lowResMaskFlag;
+    cv::Mat m_skinMask;     // skin cells of the downscaled region, SKIN_MASK_SCALE x SKIN_MASK_SCALE pixels each
+    ROISpans m_skinSpans;   // accumulation region cut by m_skinMask
     bool f_fill;   
     qreal v_hist[256];
-    unsigned int v_temphist[256];
-    quint16 m_emptyFrames;
-    cv::Rect v_faceRect[FACE_RECT_VECTOR_LENGTH];
-    quint8 m_facePos;
+    unsigned int v_temphist[256];   // histogram of the current frame
+    quint32 v_histSum[256];         // frames histograms since the last histUpdated(...)
+    double m_histTime;              // ms since the last histUpdated(...)
     cv::Rect m_ellipsRect;
+    QFrameRing *pt_frameRing;
+    QFramePool *pt_framePool;
+    cv::Mat m_workFrame;    // reusable buffer for the blurred face region when f_fill is false, so input frame stays untouched without a full copy
+    bool m_asyncDisplayFlag;
+    QAtomicInt m_displayBusy; // set when frame has been sent to display, cleared by frameDisplayed(), so the display queue is never longer than one frame
+    YUVInput::PixelFormat m_pixelFormat;
+    cv::Mat m_displayFrame; // BGR copy of raw frame, or of any frame in async display mode, for display
+    bool m_displayImageFlag;
+    cv::Mat m_mapSource;    // BGR copy of raw frame for mapProcess(...)
+
+    struct Region
+    {
+        quint32 id;
+        ROISpans::ShapeType shape;
+        cv::Rect rect;      // bounding rect for all shapes
+        std::vector<cv::Point> polygon;
+        cv::Mat mask;
+        ROISpans spans;
+    };
+    std::vector<Region> v_regions;
+    quint32 m_regionCounter;  // the last given id
+    std::vector<const ROISpans *> v_regionSpans;
+    std::vector<ROISums> v_regionSums;
+    QRegionFrame m_regionFrame;
 
-    cv::Rect getAverageFaceRect() const;
-    void enrollFaceRect(const cv::Rect &rect);
-    bool isInEllips(int x, int y) const;
+    void updateFramePeriod(double timestamp); // negative timestamp means that frame has not been stamped by source, then current time is used, timestamps of video file frames are media time
+    void emitFrameProcessed(const cv::Mat &frame, quint32 pixels_enrolled); // sends frame to display, skips it if display is still busy in async mode
+    void blurRegion(const cv::Mat &input, cv::Mat &output, const cv::Rect &region); // prefilter of accumulation region, region is given in image coordinates
+    bool isHistogramConnected(); // true if someone listens to histUpdated(...)
+    void publishHistogram();     // adds v_temphist to v_histSum, emits histUpdated(...) once per HIST_PUBLISH_PERIOD
     bool isSkinColor(unsigned char valueRed, unsigned char valueGreen, unsigned char valueBlue);
     bool isCalibColor(unsigned char value);
-    void setAverageFaceRect(uint x, uint y, uint w, uint h);
+    void trainSkinModel(const cv::Mat &image); // counts colors of skin pixels of m_regionSpans for m_skinModel
+    void getCalibRange(unsigned char &greenMin, unsigned char &greenMax) const; // converts isCalibColor(...) to inclusive integer bounds for ROIKernels
 };
 
 inline bool QOpencvProcessor::isSkinColor(unsigned char valueRed, unsigned char valueGreen, unsigned char valueBlue)
@@ -103,15 +193,6 @@ inline bool QOpencvProcessor::isCalibColor(unsigned char value)
     } else return false;
 }
 
-inline bool QOpencvProcessor::isInEllips(int x, int y) const
-{
-    qreal cx = (m_ellipsRect.x + m_ellipsRect.width / 2.0 - x) / (m_ellipsRect.width / 2.0);
-    qreal cy = (m_ellipsRect.y + m_ellipsRect.height/ 2.0 - y) / (m_ellipsRect.height / 2.0);
-    if( (cx*cx + cy*cy) < 1.0 )
-        return true;
-    return false;
-}
-
 
 //------------------------------------------------------------------------------------------------------
 #endif // QOPENCVPROCESSOR_H
@@ -0,0 +1,47 @@
+/*------------------------------------------------------------------------------------------------------
+Taranov Alex, 2015									     HEADER FILE
+QRegionFrame is a record of all user regions of one frame in structure of arrays layout.
+QOpencvProcessor::regionsProcess(...) fills it and hands it over to QHarmonicProcessorPool in one
+blocking signal per frame, the pool passes sums of every region to the processor of its id.
+------------------------------------------------------------------------------------------------------*/
+
+#ifndef QREGIONFRAME_H
+#define QREGIONFRAME_H
+//------------------------------------------------------------------------------------------------------
+
+#include <vector>
+#include <QtGlobal>
+
+//------------------------------------------------------------------------------------------------------
+
+struct QRegionFrame
+{
+    double period;                  // frame period in ms
+    std::vector<quint32> id;        // region identifiers, they do not change while region exists
+    std::vector<quint64> red;
+    std::vector<quint64> green;
+    std::vector<quint64> blue;
+    std::vector<quint64> area; // enrolled pixels of the region, zero if region is out of frame or has no skin
+
+    void resize(quint32 count);
+    quint32 getCount() const;
+};
+
+//------------------------------------------------------------------------------------------------------
+
+inline void QRegionFrame::resize(quint32 count)
+{
+    id.resize(count); // capacity is kept, so the record is not reallocated from frame to frame
+    red.resize(count);
+    green.resize(count);
+    blue.resize(count);
+    area.resize(count);
+}
+
+inline quint32 QRegionFrame::getCount() const
+{
+    return (quint32)id.size();
+}
+
+//------------------------------------------------------------------------------------------------------
+#endif // QREGIONFRAME_H
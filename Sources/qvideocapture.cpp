@@ -5,24 +5,63 @@ Work with: call openfile(...) or opendevice(...) and on success, object will sta
 frame_was_captured(const cv::Mat& value) signal with determined period of time.
 To stop frame capturing use pause() or close(). Also
 class provides some GUI interface to cv::VideoCapture::set(...) function.
+In grab thread mode frames are grabbed by a dedicated thread that blocks on cv::VideoCapture::grab()
+and pushes them into QFrameRing, then framesAvailable() is emitted and consumer should drain the ring.
+Frames are taken from QFramePool, consumer should release them back after processing.
+All calls to cv::VideoCapture are serialized by a mutex, so properties could be set while grab thread runs.
 ------------------------------------------------------------------------------------------------------*/
 
 #include "qvideocapture.h"
 
+QGrabThread::QGrabThread(QVideoCapture *owner) :
+    QThread(),
+    pt_owner(owner)
+{
+}
+
+void QGrabThread::run()
+{
+    pt_owner->grabLoop();
+}
+
+//--------------------------------------------------------------------------------------------------
+
 QVideoCapture::QVideoCapture(QObject *parent) :
     QObject(parent),
-    device_id(0)
+    device_id(0),
+    m_framePool(DEFAULT_FRAME_POOL_SIZE),
+    m_frameRing(DEFAULT_FRAME_RING_CAPACITY, QFrameRing::DropOldest),
+    m_grabThread(this),
+    m_stopGrabFlag(0),
+    m_grabThreadMode(false),
+    m_grabCounter(0),
+    m_offlineFlag(false),
+    m_fps(0.0),
+    m_rawFlag(false),
+    m_pixelFormat(YUVInput::BGR),
+    m_frameWidth(0),
+    m_frameHeight(0),
+    m_rawRowFlag(false),
+    m_timestampSource(UnknownTimestamp)
 {
 }
 
 bool QVideoCapture::openfile(const QString &filename)
 {
-    pt_timer->stop();
-    if( m_cvCapture.open( filename.toLocal8Bit().constData() ) )
+    stopGrabbing();
+    m_captureMutex.lock();
+    const bool opened = m_cvCapture.open( filename.toLocal8Bit().constData() );
+    m_captureMutex.unlock();
+    if( opened )
     {
         m_frameCounter = 0;
         deviceFlag = false;
-        pt_timer->setInterval( 1000/m_cvCapture.get(CV_CAP_PROP_FPS) ); // CV_CAP_PROP_FPS - m_frame rate
+        m_timestampSource = UnknownTimestamp;
+        m_pixelFormat = YUVInput::BGR; // decoders give BGR anyway
+        m_fps = getProperty(CV_CAP_PROP_FPS); // CV_CAP_PROP_FPS - m_frame rate
+        if(m_fps <= 0.0)
+            m_fps = 1000.0 / DEFAULT_FRAME_PERIOD;
+        pt_timer->setInterval( m_offlineFlag ? 0 : 1000/m_fps ); // zero interval means that the next frame is read as soon as the previous one has been processed
         return true;
     }
     return false;
@@ -30,12 +69,16 @@ bool QVideoCapture::openfile(const QString &filename)
 
 bool QVideoCapture::opendevice(int period) // period should be entered in ms
 {
-    pt_timer->stop();
+    stopGrabbing();
     if(device_id >= 0)
     {
-        if( m_cvCapture.open( device_id ) )
+        m_captureMutex.lock();
+        const bool opened = m_cvCapture.open( device_id );
+        m_captureMutex.unlock();
+        if( opened )
         {
             deviceFlag = true;
+            m_pixelFormat = YUVInput::BGR; // new device starts with conversion on, see updatePixelFormat()
             pt_timer->setInterval( period );
             return true;
         }
@@ -45,15 +88,21 @@ bool QVideoCapture::opendevice(int period) // period should be entered in ms
 
 bool QVideoCapture::set(int propertyID, double value)
 {
+    QMutexLocker locker(&m_captureMutex);
     return m_cvCapture.set( propertyID, value);
 }
 
+double QVideoCapture::getProperty(int propertyID)
+{
+    QMutexLocker locker(&m_captureMutex);
+    return m_cvCapture.get(propertyID);
+}
+
 bool QVideoCapture::resume()
 {
     if( m_cvCapture.isOpened() )
     {
-        pt_timer->start();
-        return true;
+        return startGrabbing();
     }
     return false;
 }
@@ -64,7 +113,7 @@ bool QVideoCapture::start()
     {
         if(deviceFlag)
         {
-            pt_timer->start();
+            startGrabbing();
         }
         else
         {
@@ -79,7 +128,8 @@ bool QVideoCapture::close()
 {
     if( m_cvCapture.isOpened() )
     {
-        pt_timer->stop();
+        stopGrabbing();
+        QMutexLocker locker(&m_captureMutex);
         m_cvCapture.release();
         return true;
     }
@@ -90,7 +140,7 @@ bool QVideoCapture::pause()
 {
     if( m_cvCapture.isOpened() )
     {
-        pt_timer->stop();
+        stopGrabbing();
         return true;
     }
     return false;
@@ -98,12 +148,16 @@ bool QVideoCapture::pause()
 
 bool QVideoCapture::read_frame()
 {
-    if( ( m_cvCapture.read(m_frame) ) && ( !m_frame.empty() ) )
+    unwrapFrame(m_frame);
+    m_captureMutex.lock();
+    const bool grabbed = m_cvCapture.read(m_frame);
+    m_captureMutex.unlock();
+    if( grabbed && ( !m_frame.empty() ) && wrapFrame(m_frame) )
     {
-        emit frame_was_captured(m_frame);
+        emit frame_was_captured(m_frame, deviceFlag ? getTimestamp() : getMediaTimestamp());
         if(!deviceFlag)
         {
-            emit capturedFrameNumber((int)m_cvCapture.get(CV_CAP_PROP_POS_FRAMES));
+            emit capturedFrameNumber((int)getProperty(CV_CAP_PROP_POS_FRAMES));
         }
         return true;
     }
@@ -176,8 +230,8 @@ bool QVideoCapture::open_resolutionDialog()
 
         if(dialog.exec() == QDialog::Accepted)
         {
-            m_cvCapture.set( CV_CAP_PROP_FRAME_WIDTH, CBresolution.itemText(CBresolution.currentIndex()).section(" x ",0,0).toDouble() );
-            m_cvCapture.set( CV_CAP_PROP_FRAME_HEIGHT, CBresolution.itemText(CBresolution.currentIndex()).section(" x ",1,1).toDouble() );
+            set( CV_CAP_PROP_FRAME_WIDTH, CBresolution.itemText(CBresolution.currentIndex()).section(" x ",0,0).toDouble() );
+            set( CV_CAP_PROP_FRAME_HEIGHT, CBresolution.itemText(CBresolution.currentIndex()).section(" x ",1,1).toDouble() );
             pt_timer->setInterval( 1000/CBm_framerate.itemText(CBm_framerate.currentIndex()).section(" ",0,0).toDouble() );
         }
         return true;
@@ -212,9 +266,9 @@ bool QVideoCapture::open_settingsDialog()
                 Sbrightness.setOrientation(Qt::Horizontal);
                 Sbrightness.setMinimum(MIN_BRIGHTNESS);
                 Sbrightness.setMaximum(MAX_BRIGHTNESS);
-                Sbrightness.setValue( (int)m_cvCapture.get(CV_CAP_PROP_BRIGHTNESS) );
+                Sbrightness.setValue( (int)getProperty(CV_CAP_PROP_BRIGHTNESS) );
                 QLabel Lbrightness;
-                Lbrightness.setNum( (int)m_cvCapture.get(CV_CAP_PROP_BRIGHTNESS) );
+                Lbrightness.setNum( (int)getProperty(CV_CAP_PROP_BRIGHTNESS) );
                 connect(&Sbrightness, SIGNAL(valueChanged(int)), &Lbrightness, SLOT(setNum(int)));
                 connect(&Sbrightness, SIGNAL(valueChanged(int)), this, SLOT(set_brightness(int)));
                 connect(this, SIGNAL(set_default_brightness(int)), &Sbrightness, SLOT(setValue(int)));
@@ -224,9 +278,9 @@ bool QVideoCapture::open_settingsDialog()
                 Scontrast.setOrientation(Qt::Horizontal);
                 Scontrast.setMinimum(MIN_CONTRAST);
                 Scontrast.setMaximum(MAX_CONTRAST);
-                Scontrast.setValue( (int)m_cvCapture.get(CV_CAP_PROP_CONTRAST) );
+                Scontrast.setValue( (int)getProperty(CV_CAP_PROP_CONTRAST) );
                 QLabel Lcontrast;
-                Lcontrast.setNum( (int)m_cvCapture.get(CV_CAP_PROP_CONTRAST) );
+                Lcontrast.setNum( (int)getProperty(CV_CAP_PROP_CONTRAST) );
                 connect(&Scontrast, SIGNAL(valueChanged(int)), &Lcontrast, SLOT(setNum(int)));
                 connect(&Scontrast,SIGNAL(valueChanged(int)), this, SLOT(set_contrast(int)));
                 connect(this, SIGNAL(set_default_contrast(int)), &Scontrast, SLOT(setValue(int)));
@@ -236,9 +290,9 @@ bool QVideoCapture::open_settingsDialog()
                 Ssaturation.setOrientation(Qt::Horizontal);
                 Ssaturation.setMinimum(MIN_SATURATION);
                 Ssaturation.setMaximum(MAX_SATURATION);
-                Ssaturation.setValue( (int)m_cvCapture.get(CV_CAP_PROP_SATURATION) );
+                Ssaturation.setValue( (int)getProperty(CV_CAP_PROP_SATURATION) );
                 QLabel Lsaturation;
-                Lsaturation.setNum( (int)m_cvCapture.get(CV_CAP_PROP_SATURATION) );
+                Lsaturation.setNum( (int)getProperty(CV_CAP_PROP_SATURATION) );
                 connect(&Ssaturation, SIGNAL(valueChanged(int)), &Lsaturation, SLOT(setNum(int)));
                 connect(&Ssaturation,SIGNAL(valueChanged(int)), this, SLOT(set_saturation(int)));
                 connect(this, SIGNAL(set_default_saturation(int)), &Ssaturation, SLOT(setValue(int)));
@@ -248,9 +302,9 @@ bool QVideoCapture::open_settingsDialog()
                 SwhitebalanceU.setOrientation(Qt::Horizontal);
                 SwhitebalanceU.setMinimum(MIN_WHITE_BALANCE);
                 SwhitebalanceU.setMaximum(MAX_WHITE_BALANCE);
-                SwhitebalanceU.setValue( (int)m_cvCapture.get(CV_CAP_PROP_WHITE_BALANCE_BLUE_U) );
+                SwhitebalanceU.setValue( (int)getProperty(CV_CAP_PROP_WHITE_BALANCE_BLUE_U) );
                 QLabel LwhitebalanceU;
-                LwhitebalanceU.setNum( (int)m_cvCapture.get(CV_CAP_PROP_WHITE_BALANCE_BLUE_U) );
+                LwhitebalanceU.setNum( (int)getProperty(CV_CAP_PROP_WHITE_BALANCE_BLUE_U) );
                 connect(&SwhitebalanceU, SIGNAL(valueChanged(int)), &LwhitebalanceU, SLOT(setNum(int)));
                 connect(&SwhitebalanceU,SIGNAL(valueChanged(int)), this, SLOT(set_white_balanceU(int)));
                 connect(this, SIGNAL(set_default_white_balanceU(int)), &SwhitebalanceU, SLOT(setValue(int)));
@@ -260,9 +314,9 @@ bool QVideoCapture::open_settingsDialog()
                 SwhitebalanceV.setOrientation(Qt::Horizontal);
                 SwhitebalanceV.setMinimum(MIN_WHITE_BALANCE);
                 SwhitebalanceV.setMaximum(MAX_WHITE_BALANCE);
-                SwhitebalanceV.setValue( (int)m_cvCapture.get(CV_CAP_PROP_WHITE_BALANCE_RED_V) );
+                SwhitebalanceV.setValue( (int)getProperty(CV_CAP_PROP_WHITE_BALANCE_RED_V) );
                 QLabel LwhitebalanceV;
-                LwhitebalanceV.setNum( (int)m_cvCapture.get(CV_CAP_PROP_WHITE_BALANCE_RED_V) );
+                LwhitebalanceV.setNum( (int)getProperty(CV_CAP_PROP_WHITE_BALANCE_RED_V) );
                 connect(&SwhitebalanceV, SIGNAL(valueChanged(int)), &LwhitebalanceV, SLOT(setNum(int)));
                 connect(&SwhitebalanceV,SIGNAL(valueChanged(int)), this, SLOT(set_white_balanceV(int)));
                 connect(this, SIGNAL(set_default_white_balanceV(int)), &SwhitebalanceV, SLOT(setValue(int)));
@@ -307,9 +361,9 @@ bool QVideoCapture::open_settingsDialog()
             Sgain.setOrientation(Qt::Horizontal);
             Sgain.setMinimum(MIN_GAIN);
             Sgain.setMaximum(MAX_GAIN);
-            Sgain.setValue( (int)m_cvCapture.get(CV_CAP_PROP_GAIN) );
+            Sgain.setValue( (int)getProperty(CV_CAP_PROP_GAIN) );
             QLabel Lgain;
-            Lgain.setNum( (int)m_cvCapture.get(CV_CAP_PROP_GAIN) );
+            Lgain.setNum( (int)getProperty(CV_CAP_PROP_GAIN) );
             connect(&Sgain, SIGNAL(valueChanged(int)), &Lgain, SLOT(setNum(int)));
             connect(&Sgain,SIGNAL(valueChanged(int)), this, SLOT(set_gain(int)));
             connect(this, SIGNAL(set_default_gain(int)), &Sgain, SLOT(setValue(int)),Qt::DirectConnection);
@@ -319,9 +373,9 @@ bool QVideoCapture::open_settingsDialog()
             Sexposure.setOrientation(Qt::Horizontal);
             Sexposure.setMinimum(MIN_EXPOSURE);
             Sexposure.setMaximum(MAX_EXPOSURE);
-            Sexposure.setValue( (int)m_cvCapture.get(CV_CAP_PROP_EXPOSURE) );
+            Sexposure.setValue( (int)getProperty(CV_CAP_PROP_EXPOSURE) );
             QLabel Lexposure;
-            Lexposure.setNum( (int)m_cvCapture.get(CV_CAP_PROP_EXPOSURE) );
+            Lexposure.setNum( (int)getProperty(CV_CAP_PROP_EXPOSURE) );
             connect(&Sexposure, SIGNAL(valueChanged(int)), &Lexposure, SLOT(setNum(int)));
             connect(&Sexposure,SIGNAL(valueChanged(int)), this, SLOT(set_exposure(int)));
             connect(this, SIGNAL(set_default_exposure(int)), &Sexposure, SLOT(setValue(int)));
@@ -370,47 +424,50 @@ bool QVideoCapture::open_settingsDialog()
 
 bool QVideoCapture::isOpened()
 {
+    QMutexLocker locker(&m_captureMutex);
     return m_cvCapture.isOpened();
 }
 
 QVideoCapture::~QVideoCapture()
 {
+    m_stopGrabFlag.store(1);
+    m_grabThread.wait();
     delete pt_timer;
 }
 
 bool QVideoCapture::set_brightness(int value)
 {
-    return m_cvCapture.set(CV_CAP_PROP_BRIGHTNESS, (double)value);
+    return set(CV_CAP_PROP_BRIGHTNESS, (double)value);
 }
 
 bool QVideoCapture::set_contrast(int value)
 {
-    return m_cvCapture.set(CV_CAP_PROP_CONTRAST, (double)value);
+    return set(CV_CAP_PROP_CONTRAST, (double)value);
 }
 
 bool QVideoCapture::set_saturation(int value)
 {
-    return m_cvCapture.set(CV_CAP_PROP_SATURATION, (double)value);
+    return set(CV_CAP_PROP_SATURATION, (double)value);
 }
 
 bool QVideoCapture::set_gain(int value)
 {
-    return m_cvCapture.set(CV_CAP_PROP_GAIN, (double)value);
+    return set(CV_CAP_PROP_GAIN, (double)value);
 }
 
 bool QVideoCapture::set_exposure(int value)
 {
-    return m_cvCapture.set(CV_CAP_PROP_EXPOSURE, (double)value);
+    return set(CV_CAP_PROP_EXPOSURE, (double)value);
 }
 
 bool QVideoCapture::set_white_balanceU(int value)
 {
-    return m_cvCapture.set(CV_CAP_PROP_WHITE_BALANCE_BLUE_U, (double)value);
+    return set(CV_CAP_PROP_WHITE_BALANCE_BLUE_U, (double)value);
 }
 
 bool QVideoCapture::set_white_balanceV(int value)
 {
-    return m_cvCapture.set(CV_CAP_PROP_WHITE_BALANCE_RED_V, (double)value);
+    return set(CV_CAP_PROP_WHITE_BALANCE_RED_V, (double)value);
 }
 
 void QVideoCapture::set_default_settings()
@@ -476,13 +533,202 @@ void QVideoCapture::initiallizeTimer()
 
 double QVideoCapture::getFrameCounts()
 {
-    return m_cvCapture.get(CV_CAP_PROP_FRAME_COUNT);
+    return getProperty(CV_CAP_PROP_FRAME_COUNT);
 }
 
 void QVideoCapture::setFrameNumber(int number)
 {
-    if( !m_cvCapture.set(CV_CAP_PROP_POS_FRAMES, number) )
+    if( !set(CV_CAP_PROP_POS_FRAMES, number) )
     {
         qWarning("Can not set such frame number");
     }
 }
+
+void QVideoCapture::setGrabThreadMode(bool value)
+{
+    m_grabThreadMode = value;
+}
+
+bool QVideoCapture::getGrabThreadMode() const
+{
+    return m_grabThreadMode;
+}
+
+QFrameRing *QVideoCapture::getFrameRing()
+{
+    return &m_frameRing;
+}
+
+QFramePool *QVideoCapture::getFramePool()
+{
+    return &m_framePool;
+}
+
+bool QVideoCapture::startGrabbing()
+{
+    stopGrabbing();
+    updatePixelFormat();
+    if(m_grabThreadMode && deviceFlag) // video files are read by timer, so no frame is ever dropped
+    {
+        m_frameRing.resetCounters();
+        m_framePool.resetCounters();
+        if(m_pixelFormat == YUVInput::BGR)
+            m_framePool.reserve(m_frameHeight, m_frameWidth, CV_8UC3); // if guess is wrong, the first retrieve() reallocates buffers
+        else
+            m_framePool.reserve(1, YUVInput::getRawBytes(m_pixelFormat, m_frameWidth, m_frameHeight), CV_8UC1); // raw buffer as most backends return it
+        m_stopGrabFlag.store(0);
+        m_grabThread.start(QThread::HighPriority);
+    }
+    else
+    {
+        pt_timer->start();
+    }
+    return true;
+}
+
+void QVideoCapture::stopGrabbing()
+{
+    pt_timer->stop();
+    if(m_grabThread.isRunning())
+    {
+        m_stopGrabFlag.store(1);
+        m_grabThread.wait(); // grab() returns at least once per frame period, so the wait is short
+    }
+    QCapturedFrame *frame;
+    while((frame = m_frameRing.pop()) != NULL) // frames that consumer has not taken yet are stale for the next session
+        m_framePool.release(frame);
+    emit grabbingStopped();
+}
+
+void QVideoCapture::grabLoop()
+{
+    QCapturedFrame *frame = NULL;
+    QCapturedFrame *evicted = NULL;
+    bool failed = false;
+    while(m_stopGrabFlag.load() == 0)
+    {
+        m_captureMutex.lock(); // property calls of the video thread wait at most one frame period
+        if(!m_cvCapture.grab())
+        {
+            m_captureMutex.unlock();
+            failed = true;
+            break;
+        }
+        const double timestamp = getTimestamp();
+        frame = m_framePool.acquire();
+        if(frame == NULL) // all frames are held by consumer, grabbed frame is skipped rather than allocated
+        {
+            m_captureMutex.unlock();
+            continue;
+        }
+        unwrapFrame(frame->image);
+        const bool retrieved = m_cvCapture.retrieve(frame->image); // retrieve() writes into the existing buffer when size and type match
+        m_captureMutex.unlock();
+        if( !retrieved || frame->image.empty() || !wrapFrame(frame->image) )
+        {
+            m_framePool.release(frame);
+            failed = true;
+            break;
+        }
+        frame->timestamp = timestamp;
+        frame->number = m_grabCounter++;
+        if( !m_frameRing.push(frame, &evicted) )
+        {
+            m_framePool.release(frame); // DropNewest policy on full ring
+        }
+        m_framePool.release(evicted);
+        if(m_frameRing.requestNotification())
+        {
+            emit framesAvailable();
+        }
+        if(!deviceFlag)
+        {
+            emit capturedFrameNumber((int)getProperty(CV_CAP_PROP_POS_FRAMES));
+        }
+    }
+    if(failed) // device was unplugged or stream has ended, the session is paused as read_frame() does, from the thread of the object
+        QMetaObject::invokeMethod(this, "pause", Qt::QueuedConnection);
+}
+
+void QVideoCapture::setOfflineMode(bool value)
+{
+    m_offlineFlag = value;
+    if(m_cvCapture.isOpened() && !deviceFlag)
+    {
+        pt_timer->setInterval( m_offlineFlag ? 0 : 1000/m_fps );
+    }
+}
+
+bool QVideoCapture::getOfflineMode() const
+{
+    return m_offlineFlag;
+}
+
+double QVideoCapture::getMediaTimestamp()
+{
+    // one source per stream, otherwise periods jump where sources switch; both give 0 for the first frame
+    const double frames = getProperty(CV_CAP_PROP_POS_FRAMES); // index of the next frame
+    if(m_timestampSource == UnknownTimestamp)
+    {
+        if(getProperty(CV_CAP_PROP_POS_MSEC) > 0.0)
+            m_timestampSource = MsecTimestamp;
+        else if(frames > 1.0) // some backends do not support CV_CAP_PROP_POS_MSEC, it stays zero after the first frame, then nominal frame rate is used
+            m_timestampSource = FramesTimestamp;
+    }
+    if(m_timestampSource == FramesTimestamp)
+        return (frames - 1.0) * 1000.0 / m_fps;
+    return getProperty(CV_CAP_PROP_POS_MSEC); // presentation time of the last read frame
+}
+
+void QVideoCapture::setRawMode(bool value)
+{
+    m_rawFlag = value;
+}
+
+bool QVideoCapture::getRawMode() const
+{
+    return m_rawFlag;
+}
+
+int QVideoCapture::getPixelFormat() const
+{
+    return m_pixelFormat;
+}
+
+void QVideoCapture::updatePixelFormat()
+{
+    YUVInput::PixelFormat format = YUVInput::BGR;
+    if(deviceFlag)
+    {
+        if(m_rawFlag)
+        {
+            format = YUVInput::fromFourcc((int)getProperty(CV_CAP_PROP_FOURCC));
+            if( (format != YUVInput::BGR) && !set(CV_CAP_PROP_CONVERT_RGB, 0.0) ) // backend can not give raw frames
+                format = YUVInput::BGR;
+        }
+        if( (format == YUVInput::BGR) && (m_pixelFormat != YUVInput::BGR) )
+            set(CV_CAP_PROP_CONVERT_RGB, 1.0);
+    }
+    m_frameWidth = (int)getProperty(CV_CAP_PROP_FRAME_WIDTH); // resolution could be changed by open_resolutionDialog()
+    m_frameHeight = (int)getProperty(CV_CAP_PROP_FRAME_HEIGHT);
+    m_rawRowFlag = false;
+    m_pixelFormat = format;
+    emit pixelFormatChanged(m_pixelFormat); // before the first frame of the session, so consumers are switched in time
+}
+
+void QVideoCapture::unwrapFrame(cv::Mat &image)
+{
+    if(m_rawRowFlag)
+        YUVInput::unwrapRawFrame(image);
+}
+
+bool QVideoCapture::wrapFrame(cv::Mat &image)
+{
+    if(m_pixelFormat == YUVInput::BGR)
+        return true;
+    m_rawRowFlag = (image.rows == 1);
+    if(YUVInput::wrapRawFrame(image, m_pixelFormat, m_frameWidth, m_frameHeight))
+        return true;
+    qWarning("Raw frame size does not match %dx%d, select another resolution or turn raw input off", m_frameWidth, m_frameHeight);
+    return false;
+}
@@ -5,6 +5,10 @@ Work with: call openfile(...) or opendevice(...) and on success, object will sta
 frame_was_captured(const cv::Mat& value) signal with determined period of time.
 To stop frame capturing use pause() or close(). Also
 class provides some GUI interface to cv::VideoCapture::set(...) function.
+In grab thread mode frames are grabbed by a dedicated thread that blocks on cv::VideoCapture::grab()
+and pushes them into QFrameRing, then framesAvailable() is emitted and consumer should drain the ring.
+Frames are taken from QFramePool, consumer should release them back after processing.
+All calls to cv::VideoCapture are serialized by a mutex, so properties could be set while grab thread runs.
 ------------------------------------------------------------------------------------------------------*/
 
 #ifndef QVIDEOCAPTURE_H
@@ -25,9 +29,16 @@ class provides some GUI interface to cv::VideoCapture::set(...) function.
 #include <QCamera>
 #include <QList>
 #include <QByteArray>
+#include <QThread>
+#include <QAtomicInt>
+#include <QMutex>
 
 #include <opencv2/opencv.hpp>
 
+#include "qframering.h"
+#include "qframepool.h"
+#include "yuvinput.h"
+
 //---------------------------In most cases the following values are suitable-------------------------
 #define MIN_BRIGHTNESS 0
 #define MAX_BRIGHTNESS 255
@@ -56,6 +67,22 @@ class provides some GUI interface to cv::VideoCapture::set(...) function.
 #define DEFAULT_FRAME_PERIOD 35 // in ms
 //--------------------------------------------------------------------------------------------------
 
+class QVideoCapture;
+
+class QGrabThread : public QThread
+{
+public:
+    explicit QGrabThread(QVideoCapture *owner);
+
+protected:
+    void run();
+
+private:
+    QVideoCapture *pt_owner;
+};
+
+//--------------------------------------------------------------------------------------------------
+
 class QVideoCapture : public QObject
 {
     Q_OBJECT
@@ -64,8 +91,11 @@ public:
     ~QVideoCapture();
 
 signals:
-    void frame_was_captured(const cv::Mat& value); // should be emmited right after a new frame was captured, to use in your own Qt-projects first do qRegisterMetaType<cv::Mat>("cv::Mat")
+    void frame_was_captured(const cv::Mat& value, double timestamp); // should be emmited right after a new frame was captured, to use in your own Qt-projects first do qRegisterMetaType<cv::Mat>("cv::Mat"), timestamp is in ms (media time for video files)
+    void framesAvailable();                             // in grab thread mode, emitted when consumer should drain frame ring
     void capturedFrameNumber(const int number);
+    void pixelFormatChanged(int format);                // YUVInput::PixelFormat of the next frames, emitted on every start of grabbing
+    void grabbingStopped();                             // emitted when grabbing has been stopped and frame ring has been flushed, downstream rings should be flushed too
     //------------------------------------------
     void set_default_brightness(int value);
     void set_default_contrast(int value);
@@ -91,6 +121,15 @@ public slots:
     bool open_settingsDialog();                         // creates an QDialog instance with video device characteristic-controls, should be used as a GUI implementation of the camera controll functions
     double getFrameCounts();
     void setFrameNumber(int number);
+    void setGrabThreadMode(bool value);                 // true - frames are grabbed by dedicated thread into frame ring, false - by timer, takes effect on next start() or resume()
+    bool getGrabThreadMode() const;
+    QFrameRing *getFrameRing();                         // consumer should pop frames from here in grab thread mode, counters of ring and pool cover the last session until the next start
+    QFramePool *getFramePool();                         // consumer should release popped frames here
+    void setOfflineMode(bool value);                    // true - video file frames are read as fast as decoder and consumer can go, false - with the file's frame rate
+    bool getOfflineMode() const;
+    void setRawMode(bool value);                        // true - YUYV and NV12 cameras give frames without conversion to BGR, takes effect on next start() or resume()
+    bool getRawMode() const;
+    int getPixelFormat() const;                         // YUVInput::PixelFormat of the current session
     //------------------------------------------
     bool set(int propertyID , double value);// this function should to call cv::VideoCapture::set(propertyID, value)
     bool set_brightness(int value);
@@ -105,11 +144,38 @@ public slots:
 
 private:
     cv::VideoCapture m_cvCapture;           // an OpenCV's object for video capturing from video files or cameras
+    QMutex m_captureMutex;                  // cv::VideoCapture is not thread safe, it serializes m_grabThread and property calls of the video thread
     cv::Mat m_frame;                        // an OpenCV's object for image storing
     QTimer *pt_timer;                       // a timer for frames grabbing
     bool deviceFlag;                        // this flag should to show when frames are grabbing from video device [true] and when from video file [false] (I was using it for settings and resolution dialogs, which can't be called for video files playback)
     int device_id;                          // stores the curent device identifier, 0 on default    
     int m_frameCounter;                     // stores vurrent number of frame in video file
+    QFramePool m_framePool;                 // preallocated frames for m_frameRing
+    QFrameRing m_frameRing;                 // a queue of grabbed frames for the consumer in grab thread mode
+    QGrabThread m_grabThread;               // a thread that blocks on cv::VideoCapture::grab() in grab thread mode
+    QAtomicInt m_stopGrabFlag;              // signals m_grabThread to exit
+    bool m_grabThreadMode;
+    quint32 m_grabCounter;
+    bool m_offlineFlag;                     // read video file without pauses between frames
+    double m_fps;                           // frame rate of the opened video file
+    bool m_rawFlag;
+    YUVInput::PixelFormat m_pixelFormat;
+    int m_frameWidth;
+    int m_frameHeight;
+    bool m_rawRowFlag;                      // backend returns raw frames as one row buffer, so they are reshaped back before the next read
+    enum TimestampSource { UnknownTimestamp, MsecTimestamp, FramesTimestamp };
+    TimestampSource m_timestampSource;      // chosen by getMediaTimestamp() once per opened file
+
+    double getProperty(int propertyID);     // cv::VideoCapture::get(...) under m_captureMutex
+    double getMediaTimestamp();             // returns presentation time of the last read frame of video file in ms
+
+    bool startGrabbing();                   // starts the timer or m_grabThread, depends on m_grabThreadMode
+    void stopGrabbing();                    // stops both the timer and m_grabThread
+    void grabLoop();                        // the body of m_grabThread
+    void updatePixelFormat();               // switches device conversion according to m_rawFlag and camera fourcc
+    void unwrapFrame(cv::Mat &image);
+    bool wrapFrame(cv::Mat &image);         // gives raw frame the layout of YUVInput, false if size does not match
+    friend class QGrabThread;
 
 private slots:
     bool read_frame();                      // calls cv::VideoCapture::read()
@@ -0,0 +1,283 @@
+/*------------------------------------------------------------------------------------------------------
+Taranov Alex, 2015									     SOURCE FILE
+Row kernels for the region of interest accumulation in QOpencvProcessor.
+Kernel takes a span of BGR pixels, tests skin predicate, accumulates masked color sums, pixels count
+and green histogram, and optionally marks enrolled pixels on image (red %= 32).
+Histogram of kernels is banked: ROI_HIST_BANKS interleaved sub-histograms of 256 levels, they are
+summed by mergeHistBanks(...) once per stripe, not per pixel.
+Vector versions (SSSE3 and AVX2) are selected at runtime, scalar version is the reference,
+all of them give exactly the same results because only integer arithmetic is involved.
+Other combinations are instances of ROIKernels::Row<Pixel, Mask, Fill, Hist>, all policies are
+compile-time parameters, so each instance is a plain loop without flag tests inside.
+------------------------------------------------------------------------------------------------------*/
+
+#include "roikernels.h"
+
+#include <opencv2/opencv.hpp>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+    #define ROI_KERNELS_X86
+    #include <immintrin.h>
+    #if defined(__GNUC__)
+        #define ROI_TARGET(isa) __attribute__((target(isa)))
+    #else
+        #define ROI_TARGET(isa) // MSVC allows intrinsics of any instruction set without special flags
+    #endif
+#endif
+
+//------------------------------------------------------------------------------------------------------
+
+void ROIKernels::skinRowScalar(unsigned char *p, int length, unsigned char greenMin, unsigned char greenMax, bool fill, ROISums &sums, unsigned int *hist)
+{
+    unsigned char tempBlue;
+    unsigned char tempGreen;
+    unsigned char tempRed;
+    for(int i = 0; i < length; i++)
+    {
+        tempBlue = p[3*i];
+        tempGreen = p[3*i+1];
+        tempRed = p[3*i+2];
+        if( isSkinPixel(tempRed, tempGreen, tempBlue) && (tempGreen >= greenMin) && (tempGreen <= greenMax) ) {
+            sums.area++;
+            sums.blue += tempBlue;
+            sums.green += tempGreen;
+            sums.red += tempRed;
+            if(fill)
+                p[3*i+2] %= ROI_LEVEL_SHIFT;
+            if(hist)
+                hist[((i & (ROI_HIST_BANKS - 1)) << 8) + tempGreen]++;
+        }
+    }
+}
+
+//------------------------------------------------------------------------------------------------------
+
+#ifdef ROI_KERNELS_X86
+
+namespace {
+
+// Splits 16 BGR pixels (48 bytes) into planes
+ROI_TARGET("ssse3") inline void deinterleave16(const unsigned char *p, __m128i &b, __m128i &g, __m128i &r)
+{
+    const __m128i a0 = _mm_loadu_si128((const __m128i*)p);
+    const __m128i a1 = _mm_loadu_si128((const __m128i*)(p + 16));
+    const __m128i a2 = _mm_loadu_si128((const __m128i*)(p + 32));
+
+    b = _mm_or_si128(_mm_or_si128(
+        _mm_shuffle_epi8(a0, _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+        _mm_shuffle_epi8(a1, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1))),
+        _mm_shuffle_epi8(a2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13)));
+    g = _mm_or_si128(_mm_or_si128(
+        _mm_shuffle_epi8(a0, _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+        _mm_shuffle_epi8(a1, _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1))),
+        _mm_shuffle_epi8(a2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14)));
+    r = _mm_or_si128(_mm_or_si128(
+        _mm_shuffle_epi8(a0, _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+        _mm_shuffle_epi8(a1, _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1))),
+        _mm_shuffle_epi8(a2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15)));
+}
+
+// Returns 0xFF in lanes of skin pixels, x > c is evaluated as saturated (x - c) != 0
+ROI_TARGET("ssse3") inline __m128i skinMask16(__m128i b, __m128i g, __m128i r, __m128i gmin, __m128i gmax)
+{
+    __m128i m = _mm_min_epu8(_mm_subs_epu8(r, _mm_set1_epi8(95)), _mm_subs_epu8(g, _mm_set1_epi8(40)));
+    m = _mm_min_epu8(m, _mm_subs_epu8(b, _mm_set1_epi8(20)));
+    m = _mm_min_epu8(m, _mm_subs_epu8(_mm_subs_epu8(r, g), _mm_set1_epi8(7)));
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i inRange = _mm_cmpeq_epi8(_mm_or_si128(_mm_subs_epu8(gmin, g), _mm_subs_epu8(g, gmax)), zero); // gmin <= g <= gmax
+    return _mm_andnot_si128(_mm_cmpeq_epi8(m, zero), inRange);
+}
+
+// Sum of 16 bytes
+ROI_TARGET("ssse3") inline quint32 sum16(__m128i v)
+{
+    const __m128i s = _mm_sad_epu8(v, _mm_setzero_si128());
+    return (quint32)(_mm_cvtsi128_si32(s) + _mm_cvtsi128_si32(_mm_unpackhi_epi64(s, s)));
+}
+
+// Sum of 32 bytes
+ROI_TARGET("avx2") inline quint32 sum32(__m256i v)
+{
+    const __m256i s = _mm256_sad_epu8(v, _mm256_setzero_si256());
+    const __m128i t = _mm_add_epi64(_mm256_castsi256_si128(s), _mm256_extracti128_si256(s, 1));
+    return (quint32)(_mm_cvtsi128_si32(t) + _mm_cvtsi128_si32(_mm_unpackhi_epi64(t, t)));
+}
+
+inline unsigned int countBits(unsigned int v)
+{
+    v = v - ((v >> 1) & 0x55555555u);
+    v = (v & 0x33333333u) + ((v >> 2) & 0x33333333u);
+    return (((v + (v >> 4)) & 0x0F0F0F0Fu) * 0x01010101u) >> 24;
+}
+
+// Histogram and fill are scattered, so they are done per set bit of the mask, block starts at multiple of ROI_HIST_BANKS, hist could be NULL
+inline void scatter(unsigned char *p, const unsigned char *green, unsigned int bits, bool fill, unsigned int *hist)
+{
+    int k = 0;
+    while(bits)
+    {
+        if(bits & 1u)
+        {
+            if(hist)
+                hist[((k & (ROI_HIST_BANKS - 1)) << 8) + green[k]]++;
+            if(fill)
+                p[3*k+2] %= ROI_LEVEL_SHIFT;
+        }
+        bits >>= 1;
+        k++;
+    }
+}
+
+} // end of anonymous namespace
+
+//------------------------------------------------------------------------------------------------------
+
+ROI_TARGET("ssse3") void ROIKernels::skinRowSSSE3(unsigned char *p, int length, unsigned char greenMin, unsigned char greenMax, bool fill, ROISums &sums, unsigned int *hist)
+{
+    const __m128i gmin = _mm_set1_epi8((char)greenMin);
+    const __m128i gmax = _mm_set1_epi8((char)greenMax);
+    unsigned char green[16];
+    const bool scattered = fill || (hist != NULL); // without both the block needs only sums
+    __m128i b, g, r;
+    int i = 0;
+    for(; i + 16 <= length; i += 16)
+    {
+        deinterleave16(p + 3*i, b, g, r);
+        const __m128i mask = skinMask16(b, g, r, gmin, gmax);
+        const unsigned int bits = (unsigned int)_mm_movemask_epi8(mask);
+        if(bits == 0)
+            continue;
+        sums.blue += sum16(_mm_and_si128(b, mask));
+        sums.green += sum16(_mm_and_si128(g, mask));
+        sums.red += sum16(_mm_and_si128(r, mask));
+        sums.area += countBits(bits); // hardware popcnt is not a part of SSSE3
+        if(scattered)
+        {
+            _mm_storeu_si128((__m128i*)green, g);
+            scatter(p + 3*i, green, bits, fill, hist);
+        }
+    }
+    skinRowScalar(p + 3*i, length - i, greenMin, greenMax, fill, sums, hist);
+}
+
+//------------------------------------------------------------------------------------------------------
+
+ROI_TARGET("avx2") void ROIKernels::skinRowAVX2(unsigned char *p, int length, unsigned char greenMin, unsigned char greenMax, bool fill, ROISums &sums, unsigned int *hist)
+{
+    const __m256i gmin = _mm256_set1_epi8((char)greenMin);
+    const __m256i gmax = _mm256_set1_epi8((char)greenMax);
+    const __m256i zero = _mm256_setzero_si256();
+    unsigned char green[32];
+    const bool scattered = fill || (hist != NULL);
+    __m128i b0, g0, r0, b1, g1, r1;
+    int i = 0;
+    for(; i + 32 <= length; i += 32)
+    {
+        // 24-bit pixels can not be split by in-lane shuffles of 256-bit registers, so planes are assembled from two 128-bit halves
+        deinterleave16(p + 3*i, b0, g0, r0);
+        deinterleave16(p + 3*i + 48, b1, g1, r1);
+        const __m256i b = _mm256_inserti128_si256(_mm256_castsi128_si256(b0), b1, 1);
+        const __m256i g = _mm256_inserti128_si256(_mm256_castsi128_si256(g0), g1, 1);
+        const __m256i r = _mm256_inserti128_si256(_mm256_castsi128_si256(r0), r1, 1);
+
+        __m256i m = _mm256_min_epu8(_mm256_subs_epu8(r, _mm256_set1_epi8(95)), _mm256_subs_epu8(g, _mm256_set1_epi8(40)));
+        m = _mm256_min_epu8(m, _mm256_subs_epu8(b, _mm256_set1_epi8(20)));
+        m = _mm256_min_epu8(m, _mm256_subs_epu8(_mm256_subs_epu8(r, g), _mm256_set1_epi8(7)));
+        const __m256i inRange = _mm256_cmpeq_epi8(_mm256_or_si256(_mm256_subs_epu8(gmin, g), _mm256_subs_epu8(g, gmax)), zero);
+        const __m256i mask = _mm256_andnot_si256(_mm256_cmpeq_epi8(m, zero), inRange);
+        const unsigned int bits = (unsigned int)_mm256_movemask_epi8(mask);
+        if(bits == 0)
+            continue;
+
+        sums.blue += sum32(_mm256_and_si256(b, mask));
+        sums.green += sum32(_mm256_and_si256(g, mask));
+        sums.red += sum32(_mm256_and_si256(r, mask));
+        sums.area += countBits(bits);
+        if(scattered)
+        {
+            _mm256_storeu_si256((__m256i*)green, g);
+            scatter(p + 3*i, green, bits, fill, hist);
+        }
+    }
+    skinRowSSSE3(p + 3*i, length - i, greenMin, greenMax, fill, sums, hist);
+}
+
+#else // not x86, vector kernels fall back to the scalar one
+
+void ROIKernels::skinRowSSSE3(unsigned char *p, int length, unsigned char greenMin, unsigned char greenMax, bool fill, ROISums &sums, unsigned int *hist)
+{
+    skinRowScalar(p, length, greenMin, greenMax, fill, sums, hist);
+}
+
+void ROIKernels::skinRowAVX2(unsigned char *p, int length, unsigned char greenMin, unsigned char greenMax, bool fill, ROISums &sums, unsigned int *hist)
+{
+    skinRowScalar(p, length, greenMin, greenMax, fill, sums, hist);
+}
+
+#endif
+
+//------------------------------------------------------------------------------------------------------
+
+namespace {
+
+struct KernelChoice
+{
+    ROIKernels::SkinRowKernel kernel;
+    const char *name;
+};
+
+KernelChoice chooseKernel()
+{
+    KernelChoice choice = { ROIKernels::skinRowScalar, "scalar" };
+#ifdef ROI_KERNELS_X86
+    if(cv::checkHardwareSupport(CV_CPU_AVX2)) {
+        choice.kernel = ROIKernels::skinRowAVX2;
+        choice.name = "AVX2";
+    } else if(cv::checkHardwareSupport(CV_CPU_SSSE3)) {
+        choice.kernel = ROIKernels::skinRowSSSE3;
+        choice.name = "SSSE3";
+    }
+#endif
+    return choice;
+}
+
+const KernelChoice &getKernelChoice()
+{
+    static const KernelChoice choice = chooseKernel(); // CPU is probed once, on the first call
+    return choice;
+}
+
+} // end of anonymous namespace
+
+//------------------------------------------------------------------------------------------------------
+
+void ROIKernels::skinRow(unsigned char *p, int length, unsigned char greenMin, unsigned char greenMax, bool fill, ROISums &sums, unsigned int *hist)
+{
+    getKernelChoice().kernel(p, length, greenMin, greenMax, fill, sums, hist);
+}
+
+//------------------------------------------------------------------------------------------------------
+
+const char *ROIKernels::getInstructionSet()
+{
+    return getKernelChoice().name;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void ROIKernels::mergeHistBanks(const unsigned int *banks, unsigned int *hist)
+{
+#if defined(ROI_KERNELS_X86) && (defined(__SSE2__) || defined(_M_X64)) // SSE2 is the baseline of x86-64, no runtime check
+    for(int k = 0; k < 256; k += 4)
+    {
+        __m128i s = _mm_loadu_si128((const __m128i*)(hist + k));
+        for(int i = 0; i < ROI_HIST_BANKS; i++)
+            s = _mm_add_epi32(s, _mm_loadu_si128((const __m128i*)(banks + (i << 8) + k)));
+        _mm_storeu_si128((__m128i*)(hist + k), s);
+    }
+#else
+    for(int i = 0; i < ROI_HIST_BANKS; i++)
+        for(int k = 0; k < 256; k++)
+            hist[k] += banks[(i << 8) + k];
+#endif
+}
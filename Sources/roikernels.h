@@ -0,0 +1,177 @@
+/*------------------------------------------------------------------------------------------------------
+Taranov Alex, 2015									     HEADER FILE
+Row kernels for the region of interest accumulation in QOpencvProcessor.
+Kernel takes a span of BGR pixels, tests skin predicate, accumulates masked color sums, pixels count
+and green histogram, and optionally marks enrolled pixels on image (red %= 32).
+Histogram of kernels is banked: ROI_HIST_BANKS interleaved sub-histograms of 256 levels, they are
+summed by mergeHistBanks(...) once per stripe, not per pixel.
+Vector versions (SSSE3 and AVX2) are selected at runtime, scalar version is the reference,
+all of them give exactly the same results because only integer arithmetic is involved.
+Other combinations are instances of ROIKernels::Row<Pixel, Mask, Fill, Hist>, all policies are
+compile-time parameters, so each instance is a plain loop without flag tests inside.
+------------------------------------------------------------------------------------------------------*/
+
+#ifndef ROIKERNELS_H
+#define ROIKERNELS_H
+//------------------------------------------------------------------------------------------------------
+
+#define ROI_LEVEL_SHIFT 32 // enrolled pixels are marked by red channel modulo this value, should be power of two
+#define ROI_HIST_BANKS 4    // kernels count pixel x into bank x % ROI_HIST_BANKS, so neighbour pixels of the same level do not wait for each other's increment, should be power of two
+
+//------------------------------------------------------------------------------------------------------
+
+#include <QtGlobal>
+
+#include "skinlut.h"
+
+//------------------------------------------------------------------------------------------------------
+
+struct ROISums // 64-bit, a sum over 4K frame exceeds 32 bits (3840 * 2160 * 255 > 2^32)
+{
+    quint64 red;
+    quint64 green;
+    quint64 blue;
+    quint64 area;
+};
+
+//------------------------------------------------------------------------------------------------------
+
+namespace ROIKernels
+{
+    typedef void (*SkinRowKernel)(unsigned char *p, int length, unsigned char greenMin, unsigned char greenMax, bool fill, ROISums &sums, unsigned int *hist);
+
+    // p points to the first BGR pixel of the span, pixels with green out of [greenMin, greenMax] are not skin, hist could be NULL
+    void skinRow(unsigned char *p, int length, unsigned char greenMin, unsigned char greenMax, bool fill, ROISums &sums, unsigned int *hist);
+
+    void skinRowScalar(unsigned char *p, int length, unsigned char greenMin, unsigned char greenMax, bool fill, ROISums &sums, unsigned int *hist);
+    void skinRowSSSE3(unsigned char *p, int length, unsigned char greenMin, unsigned char greenMax, bool fill, ROISums &sums, unsigned int *hist);
+    void skinRowAVX2(unsigned char *p, int length, unsigned char greenMin, unsigned char greenMax, bool fill, ROISums &sums, unsigned int *hist);
+
+    const char *getInstructionSet(); // name of the instruction set that skinRow(...) uses on this machine
+    void mergeHistBanks(const unsigned int *banks, unsigned int *hist); // adds ROI_HIST_BANKS sub-histograms of banks to 256 levels of hist
+
+    template<class Pixel, class Mask, bool Fill, bool Hist> struct Row;
+    template<class Pixel, class Mask> struct Mark;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+inline bool isSkinPixel(unsigned char valueRed, unsigned char valueGreen, unsigned char valueBlue)
+{
+    // (R - min(G,B)) > 7 and R > G are implied by (R - G) > 7
+    return (valueRed > 95) && (valueGreen > 40) && (valueBlue > 20) && ((valueRed - valueGreen) > 7);
+}
+
+//------------------------------------------------------------------------------------------------------
+// Pixel policies, load(...) gives the values that go to blue, green and red fields of ROISums,
+// aux is the second plane row of planar formats (Planar == 1), histValue(...) is called after mark(...)
+
+struct BGRPixel
+{
+    enum { Planar = 0 };
+    static void load(const unsigned char *row, const unsigned char *, int x, unsigned char &b, unsigned char &g, unsigned char &r)
+    {
+        b = row[3*x];
+        g = row[3*x+1];
+        r = row[3*x+2];
+    }
+    static bool isSkin(unsigned char b, unsigned char g, unsigned char r) { return isSkinPixel(r, g, b); }
+    static void mark(unsigned char *row, int x) { row[3*x+2] %= ROI_LEVEL_SHIFT; }
+    static unsigned char histValue(const unsigned char *, int, unsigned char, unsigned char g, unsigned char) { return g; }
+};
+
+struct GrayPixel // 8-bit gray image, caller should take green sum only
+{
+    enum { Planar = 0 };
+    static void load(const unsigned char *row, const unsigned char *, int x, unsigned char &b, unsigned char &g, unsigned char &r) { b = g = r = row[x]; }
+    static bool isSkin(unsigned char, unsigned char, unsigned char) { return true; }
+    static void mark(unsigned char *row, int x) { row[x] %= ROI_LEVEL_SHIFT; }
+    static unsigned char histValue(const unsigned char *row, int x, unsigned char, unsigned char, unsigned char) { return row[x]; } // after fill, as QOpencvProcessor always did for gray images
+};
+
+//------------------------------------------------------------------------------------------------------
+// Mask policies, all of them are constructed from the same arguments
+
+struct FullMask
+{
+    FullMask(unsigned char, unsigned char, const SkinLUT *) {}
+    template<class Pixel> bool test(unsigned char, unsigned char, unsigned char) const { return true; }
+};
+
+struct SkinRuleMask // skin predicate of the pixel format and green (luma for YUV formats) in [greenMin, greenMax]
+{
+    SkinRuleMask(unsigned char min, unsigned char max, const SkinLUT *) : greenMin(min), greenMax(max) {}
+    template<class Pixel> bool test(unsigned char b, unsigned char g, unsigned char r) const { return Pixel::isSkin(b, g, r) && (g >= greenMin) && (g <= greenMax); }
+    unsigned char greenMin;
+    unsigned char greenMax;
+};
+
+struct SkinModelMask // BGR only
+{
+    SkinModelMask(unsigned char, unsigned char, const SkinLUT *lut) : model(lut) {}
+    template<class Pixel> bool test(unsigned char b, unsigned char g, unsigned char r) const { return model->isSkin(b, g, r); }
+    const SkinLUT *model;
+};
+
+//------------------------------------------------------------------------------------------------------
+
+template<class Pixel, class Mask, bool Fill, bool Hist>
+struct ROIKernels::Row
+{
+    // accumulates pixels [begin, end) of the row, hist is ROI_HIST_BANKS * 256 counters, it could be NULL if Hist is false
+    static void run(unsigned char *row, const unsigned char *aux, int begin, int end, const Mask &mask, ROISums &sums, unsigned int *hist)
+    {
+        quint32 red = 0; // one span could not overflow 32 bits, it is added to 64-bit sums once
+        quint32 green = 0;
+        quint32 blue = 0;
+        quint32 area = 0;
+        unsigned char b, g, r;
+        for(int x = begin; x < end; x++)
+        {
+            Pixel::load(row, aux, x, b, g, r);
+            if(mask.template test<Pixel>(b, g, r))
+            {
+                area++;
+                blue += b;
+                green += g;
+                red += r;
+                if(Fill)
+                    Pixel::mark(row, x);
+                if(Hist)
+                    hist[((x & (ROI_HIST_BANKS - 1)) << 8) + Pixel::histValue(row, x, b, g, r)]++;
+            }
+        }
+        sums.red += red;
+        sums.green += green;
+        sums.blue += blue;
+        sums.area += area;
+    }
+};
+
+template<bool Fill, bool Hist>
+struct ROIKernels::Row<BGRPixel, SkinRuleMask, Fill, Hist> // runtime selected vector kernel, with and without histogram
+{
+    static void run(unsigned char *row, const unsigned char *, int begin, int end, const SkinRuleMask &mask, ROISums &sums, unsigned int *hist)
+    {
+        skinRow(row + 3*begin, end - begin, mask.greenMin, mask.greenMax, Fill, sums, Hist ? hist : NULL);
+    }
+};
+
+template<class Pixel, class Mask>
+struct ROIKernels::Mark
+{
+    // only marks pixels that Row<Pixel, Mask, true, ...> would enroll, for regions that are filled after accumulation
+    static void run(unsigned char *row, const unsigned char *aux, int begin, int end, const Mask &mask)
+    {
+        unsigned char b, g, r;
+        for(int x = begin; x < end; x++)
+        {
+            Pixel::load(row, aux, x, b, g, r);
+            if(mask.template test<Pixel>(b, g, r))
+                Pixel::mark(row, x);
+        }
+    }
+};
+
+//------------------------------------------------------------------------------------------------------
+#endif // ROIKERNELS_H
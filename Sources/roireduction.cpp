@@ -0,0 +1,383 @@
+/*------------------------------------------------------------------------------------------------------
+Taranov Alex, 2015									     SOURCE FILE
+ROIReduction accumulates ROISums and green histogram over the spans of ROISpans by row kernels of
+ROIKernels. Rows are split into stripes that are processed in parallel by cv::parallel_for_,
+each stripe has its own partial sums and banked histogram, they are merged in stripe order afterwards,
+so results do not depend on the number of threads. Stripes count is tuned by the region size, large
+regions are cut into tiles of about ROI_TILE_BYTES, which are more than threads, so they are balanced
+between threads and every tile fits into cache. Box blur of large regions is tiled the same way.
+Raw YUYV and NV12 frames are processed in place, spans are given in image coordinates.
+Instance of the row kernel is chosen once per run(...) from Params, so no flag is tested per row.
+Several regions could be accumulated in one traversal of the rows, each of them gets its own sums.
+Skin mask could be taken from a smoothed low resolution copy, then sums come from the original pixels.
+------------------------------------------------------------------------------------------------------*/
+
+#include "roireduction.h"
+
+//------------------------------------------------------------------------------------------------------
+
+ROIReduction::ROIReduction():
+    m_maxStripes(ROI_MAX_STRIPES),
+    m_lastStripes(0)
+{
+}
+
+//------------------------------------------------------------------------------------------------------
+
+template<class Pixel, class Mask, bool Fill, bool Hist>
+void ROIReduction::processRows(cv::Mat &image, const ROISpans &spans, const Params &params, int top, int bottom, ROISums &sums, unsigned int *hist)
+{
+    const Mask mask(params.greenMin, params.greenMax, params.model);
+    const int chromaTop = image.rows * 2 / 3; // planar formats only
+    for(int j = top; j < bottom; j++)
+    {
+        unsigned char *row = image.ptr(j);
+        const unsigned char *aux = Pixel::Planar ? image.ptr(chromaTop + j/2) : NULL;
+        const ROISpan *span = spans.getSpans(j);
+        for(int k = 0; k < spans.getCount(j); k++)
+            ROIKernels::Row<Pixel, Mask, Fill, Hist>::run(row, aux, span[k].begin, span[k].end, mask, sums, hist);
+    }
+}
+
+//------------------------------------------------------------------------------------------------------
+
+template<class Pixel, class Mask, bool Fill>
+void ROIReduction::processRegionRows(cv::Mat &image, const ROISpans *const *regions, int count, const Params &params, int top, int bottom, ROISums *sums)
+{
+    const Mask mask(params.greenMin, params.greenMax, params.model);
+    const int chromaTop = image.rows * 2 / 3; // planar formats only
+    for(int j = top; j < bottom; j++)
+    {
+        unsigned char *row = image.ptr(j);
+        const unsigned char *aux = Pixel::Planar ? image.ptr(chromaTop + j/2) : NULL;
+        for(int i = 0; i < count; i++)
+        {
+            if( (j < regions[i]->getTop()) || (j >= regions[i]->getBottom()) )
+                continue;
+            const ROISpan *span = regions[i]->getSpans(j);
+            for(int k = 0; k < regions[i]->getCount(j); k++)
+                ROIKernels::Row<Pixel, Mask, false, false>::run(row, aux, span[k].begin, span[k].end, mask, sums[i], NULL);
+        }
+        if(Fill)
+        {
+            for(int i = 0; i < count; i++)
+            {
+                if( (j < regions[i]->getTop()) || (j >= regions[i]->getBottom()) )
+                    continue;
+                const ROISpan *span = regions[i]->getSpans(j);
+                for(int k = 0; k < regions[i]->getCount(j); k++)
+                    ROIKernels::Mark<Pixel, Mask>::run(row, aux, span[k].begin, span[k].end, mask);
+            }
+        }
+    }
+}
+
+//------------------------------------------------------------------------------------------------------
+
+template<class Pixel, class Mask>
+ROIReduction::RowsFunction ROIReduction::RowsSelector::select(const Params &params)
+{
+    if(params.fill)
+        return params.histogram ? &processRows<Pixel, Mask, true, true> : &processRows<Pixel, Mask, true, false>;
+    return params.histogram ? &processRows<Pixel, Mask, false, true> : &processRows<Pixel, Mask, false, false>;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+template<class Pixel, class Mask>
+ROIReduction::RegionRowsFunction ROIReduction::RegionRowsSelector::select(const Params &params)
+{
+    return params.fill ? &processRegionRows<Pixel, Mask, true> : &processRegionRows<Pixel, Mask, false>;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+template<class Selector>
+typename Selector::Function ROIReduction::dispatch(const Params &params)
+{
+    const bool skin = (params.kernel == SkinRule) || (params.kernel == SkinModel); // table model is trained on BGR, raw formats take the chroma rule
+    switch(params.format)
+    {
+        case YUVInput::YUYV:
+            return skin ? Selector::template select<YUYVPixel, SkinRuleMask>(params) : Selector::template select<YUYVPixel, FullMask>(params);
+        case YUVInput::NV12:
+            return skin ? Selector::template select<NV12Pixel, SkinRuleMask>(params) : Selector::template select<NV12Pixel, FullMask>(params);
+        default:
+            break;
+    }
+    switch(params.kernel)
+    {
+        case SkinRule:
+            return Selector::template select<BGRPixel, SkinRuleMask>(params);
+        case SkinModel:
+            return Selector::template select<BGRPixel, SkinModelMask>(params);
+        case Gray:
+            return Selector::template select<GrayPixel, FullMask>(params);
+        default:
+            return Selector::template select<BGRPixel, FullMask>(params);
+    }
+}
+
+//------------------------------------------------------------------------------------------------------
+
+ROIReduction::StripeBody::StripeBody(cv::Mat &image, const ROISpans &spans, const Params &params, RowsFunction rows, Stripe *stripes, int stripesCount):
+    r_image(image),
+    r_spans(spans),
+    r_params(params),
+    pt_rows(rows),
+    v_stripes(stripes),
+    m_stripesCount(stripesCount)
+{
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void ROIReduction::StripeBody::operator()(const cv::Range &range) const
+{
+    const int top = r_spans.getTop();
+    const int rows = r_spans.getBottom() - top;
+    for(int i = range.start; i < range.end; i++)
+    {
+        Stripe &stripe = v_stripes[i];
+        ROISums zero = {0, 0, 0, 0};
+        stripe.sums = zero;
+        if(r_params.histogram)
+            std::fill(stripe.hist, stripe.hist + ROI_HIST_BANKS * 256, 0u);
+        pt_rows(r_image, r_spans, r_params, top + (int)((long)rows * i / m_stripesCount), top + (int)((long)rows * (i + 1) / m_stripesCount), stripe.sums, stripe.hist);
+    }
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void ROIReduction::run(cv::Mat &image, const ROISpans &spans, const Params &params, ROISums &sums, unsigned int *hist)
+{
+    if(params.format != YUVInput::BGR)
+    {
+        ROISums chroma = {0, 0, 0, 0};
+        reduce(image, spans, params, chroma, hist);
+        YUVInput::toRGBSums(chroma);
+        sums.red += chroma.red;
+        sums.green += chroma.green;
+        sums.blue += chroma.blue;
+        sums.area += chroma.area;
+    }
+    else
+        reduce(image, spans, params, sums, hist);
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void ROIReduction::reduce(cv::Mat &image, const ROISpans &spans, const Params &params, ROISums &sums, unsigned int *hist)
+{
+    const RowsFunction rowsFunction = dispatch<RowsSelector>(params);
+    const int stripes = getStripesCount(spans.getArea(), spans.getBottom() - spans.getTop(), (int)image.elemSize());
+    m_lastStripes = qMax(stripes, 1);
+    if((int)v_stripes.size() < m_lastStripes)
+        v_stripes.resize(m_lastStripes);
+    if(stripes < 2)
+    {
+        if(!params.histogram)
+        {
+            rowsFunction(image, spans, params, spans.getTop(), spans.getBottom(), sums, NULL);
+            return;
+        }
+        StripeBody(image, spans, params, rowsFunction, v_stripes.data(), 1)(cv::Range(0, 1)); // on the calling thread, banks of the first stripe are used
+    }
+    else
+        cv::parallel_for_(cv::Range(0, stripes), StripeBody(image, spans, params, rowsFunction, v_stripes.data(), stripes));
+
+    for(int i = 0; i < m_lastStripes; i++) // merge in fixed order
+    {
+        sums.red += v_stripes[i].sums.red;
+        sums.green += v_stripes[i].sums.green;
+        sums.blue += v_stripes[i].sums.blue;
+        sums.area += v_stripes[i].sums.area;
+        if(params.histogram)
+            ROIKernels::mergeHistBanks(v_stripes[i].hist, hist);
+    }
+}
+
+//------------------------------------------------------------------------------------------------------
+
+ROIReduction::RegionStripeBody::RegionStripeBody(cv::Mat &image, const std::vector<const ROISpans *> &regions, const Params &params, RegionRowsFunction rows, int top, int bottom, ROISums *sums, int stripesCount):
+    r_image(image),
+    r_regions(regions),
+    r_params(params),
+    pt_rows(rows),
+    m_top(top),
+    m_bottom(bottom),
+    v_sums(sums),
+    m_stripesCount(stripesCount)
+{
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void ROIReduction::RegionStripeBody::operator()(const cv::Range &range) const
+{
+    const int count = (int)r_regions.size();
+    const int rows = m_bottom - m_top;
+    for(int i = range.start; i < range.end; i++)
+    {
+        ROISums *sums = v_sums + i * count;
+        ROISums zero = {0, 0, 0, 0};
+        std::fill(sums, sums + count, zero);
+        pt_rows(r_image, r_regions.data(), count, r_params, m_top + (int)((long)rows * i / m_stripesCount), m_top + (int)((long)rows * (i + 1) / m_stripesCount), sums);
+    }
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void ROIReduction::run(cv::Mat &image, const std::vector<const ROISpans *> &regions, const Params &params, ROISums *sums)
+{
+    const int count = (int)regions.size();
+    int top = image.rows;
+    int bottom = 0;
+    unsigned long area = 0;
+    for(int i = 0; i < count; i++)
+    {
+        if(regions[i]->getArea() == 0)
+            continue;
+        top = std::min(top, regions[i]->getTop());
+        bottom = std::max(bottom, regions[i]->getBottom());
+        area += regions[i]->getArea();
+    }
+    if(area == 0)
+        return;
+
+    const RegionRowsFunction rowsFunction = dispatch<RegionRowsSelector>(params);
+    ROISums zero = {0, 0, 0, 0};
+    v_regionTotals.assign(count, zero);
+    const int stripes = getStripesCount(area, bottom - top, (int)image.elemSize());
+    if(stripes < 2)
+    {
+        m_lastStripes = 1;
+        rowsFunction(image, regions.data(), count, params, top, bottom, v_regionTotals.data());
+    }
+    else
+    {
+        m_lastStripes = stripes;
+        if((int)v_regionSums.size() < stripes * count)
+            v_regionSums.resize(stripes * count);
+        cv::parallel_for_(cv::Range(0, stripes), RegionStripeBody(image, regions, params, rowsFunction, top, bottom, v_regionSums.data(), stripes));
+        for(int i = 0; i < stripes; i++) // merge in fixed order
+        for(int k = 0; k < count; k++)
+        {
+            const ROISums &partial = v_regionSums[i * count + k];
+            v_regionTotals[k].red += partial.red;
+            v_regionTotals[k].green += partial.green;
+            v_regionTotals[k].blue += partial.blue;
+            v_regionTotals[k].area += partial.area;
+        }
+    }
+    for(int k = 0; k < count; k++)
+    {
+        if(params.format != YUVInput::BGR)
+            YUVInput::toRGBSums(v_regionTotals[k]);
+        sums[k].red += v_regionTotals[k].red;
+        sums[k].green += v_regionTotals[k].green;
+        sums[k].blue += v_regionTotals[k].blue;
+        sums[k].area += v_regionTotals[k].area;
+    }
+}
+
+//------------------------------------------------------------------------------------------------------
+
+ROIReduction::BlurBody::BlurBody(const cv::Mat &input, cv::Mat &output, const cv::Rect &region, int size, int stripesCount):
+    r_input(input),
+    r_output(output),
+    m_region(region),
+    m_size(size),
+    m_stripesCount(stripesCount)
+{
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void ROIReduction::BlurBody::operator()(const cv::Range &range) const
+{
+    for(int i = range.start; i < range.end; i++)
+    {
+        const int top = m_region.height * i / m_stripesCount;
+        const int bottom = m_region.height * (i + 1) / m_stripesCount;
+        const cv::Rect tile(m_region.x, m_region.y + top, m_region.width, bottom - top);
+        cv::Mat output(r_output, cv::Rect(0, top, m_region.width, bottom - top));
+        cv::blur(cv::Mat(r_input, tile), output, cv::Size(m_size, m_size)); // tile is a part of input, so rows around it are taken as border, as for the whole region
+    }
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void ROIReduction::blur(const cv::Mat &input, cv::Mat &output, const cv::Rect &region, int size)
+{
+    const int stripes = getStripesCount((unsigned long)region.area(), region.height, (int)input.elemSize());
+    if(stripes < 2)
+    {
+        cv::blur(cv::Mat(input, region), cv::Mat(output, region), cv::Size(size, size));
+        return;
+    }
+    m_blurBuffer.create(region.height, region.width, input.type());
+    cv::parallel_for_(cv::Range(0, stripes), BlurBody(input, m_blurBuffer, region, size, stripes));
+    m_blurBuffer.copyTo(cv::Mat(output, region));
+}
+
+//------------------------------------------------------------------------------------------------------
+
+int ROIReduction::getStripesCount(unsigned long area, int rows, int pixelBytes) const
+{
+    const int threadStripes = 2 * std::max(cv::getNumThreads(), 1); // two stripes per thread smooth out unequal rows of ellipse and polygon
+    const int tiles = (int)std::min((double)area * pixelBytes / ROI_TILE_BYTES, (double)ROI_MAX_STRIPES); // 4K frame is cut into cache sized tiles
+    int stripes = (int)std::min(area / ROI_STRIPE_MIN_AREA, (unsigned long)ROI_MAX_STRIPES);
+    stripes = std::min(stripes, std::max(threadStripes, tiles));
+    return std::min(stripes, std::min(rows, m_maxStripes));
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void ROIReduction::setMaxStripes(int value)
+{
+    if(value > 0)
+        m_maxStripes = value;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+int ROIReduction::getMaxStripes() const
+{
+    return m_maxStripes;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+int ROIReduction::getLastStripes() const
+{
+    return m_lastStripes;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+template<class Mask>
+void ROIReduction::classify(const cv::Mat &small, const Params &params, cv::Mat &mask)
+{
+    const Mask test(params.greenMin, params.greenMax, params.model);
+    for(int j = 0; j < small.rows; j++)
+    {
+        const unsigned char *p = small.ptr(j);
+        unsigned char *m = mask.ptr(j);
+        for(int i = 0; i < small.cols; i++)
+            m[i] = test.template test<BGRPixel>(p[3*i], p[3*i+1], p[3*i+2]) ? 255 : 0;
+    }
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void ROIReduction::skinMask(const cv::Mat &image, const cv::Rect &region, int scale, const Params &params, cv::Mat &mask)
+{
+    const cv::Size size((region.width + scale - 1) / scale, (region.height + scale - 1) / scale); // the last cells could be partial
+    cv::resize(cv::Mat(image, region), m_smallBuffer, size, 0.0, 0.0, cv::INTER_AREA); // box average of cells, it smooths the copy as blur(...) would
+    mask.create(size, CV_8UC1);
+    if(params.kernel == SkinModel)
+        classify<SkinModelMask>(m_smallBuffer, params, mask);
+    else
+        classify<SkinRuleMask>(m_smallBuffer, params, mask);
+}
@@ -0,0 +1,147 @@
+/*------------------------------------------------------------------------------------------------------
+Taranov Alex, 2015									     HEADER FILE
+ROIReduction accumulates ROISums and green histogram over the spans of ROISpans by row kernels of
+ROIKernels. Rows are split into stripes that are processed in parallel by cv::parallel_for_,
+each stripe has its own partial sums and banked histogram, they are merged in stripe order afterwards,
+so results do not depend on the number of threads. Stripes count is tuned by the region size, large
+regions are cut into tiles of about ROI_TILE_BYTES, which are more than threads, so they are balanced
+between threads and every tile fits into cache. Box blur of large regions is tiled the same way.
+Raw YUYV and NV12 frames are processed in place, spans are given in image coordinates.
+Instance of the row kernel is chosen once per run(...) from Params, so no flag is tested per row.
+Several regions could be accumulated in one traversal of the rows, each of them gets its own sums.
+Skin mask could be taken from a smoothed low resolution copy, then sums come from the original pixels.
+------------------------------------------------------------------------------------------------------*/
+
+#ifndef ROIREDUCTION_H
+#define ROIREDUCTION_H
+//------------------------------------------------------------------------------------------------------
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "roikernels.h"
+#include "roispans.h"
+#include "skinlut.h"
+#include "yuvinput.h"
+
+#define ROI_STRIPE_MIN_AREA 32768   // regions smaller than two stripes are processed on the calling thread
+#define ROI_TILE_BYTES 262144       // image bytes of one stripe of a large region, about L2 cache size
+#define ROI_MAX_STRIPES 256
+
+//------------------------------------------------------------------------------------------------------
+
+class ROIReduction
+{
+public:
+    enum KernelType {SkinRule, SkinModel, Plain, Gray};
+
+    struct Params
+    {
+        KernelType kernel;
+        unsigned char greenMin;     // SkinRule only
+        unsigned char greenMax;     // SkinRule only
+        const SkinLUT *model;       // SkinModel only
+        bool fill;
+        YUVInput::PixelFormat format; // for YUYV and NV12 skin kernels test chroma, sums are converted to R, G, B in the end
+        bool histogram;             // false - hist is not touched and could be NULL
+    };
+
+    ROIReduction();
+
+    // image rows of spans are changed if params.fill is true, sums and hist are not cleared, results are added to them
+    void run(cv::Mat &image, const ROISpans &spans, const Params &params, ROISums &sums, unsigned int *hist);
+    // the same for several regions at once, sums[i] is for regions[i], params.histogram is ignored, regions could overlap,
+    // they are filled after the row has been accumulated for all of them, so every region enrolls original colors
+    void run(cv::Mat &image, const std::vector<const ROISpans *> &regions, const Params &params, ROISums *sums);
+
+    void blur(const cv::Mat &input, cv::Mat &output, const cv::Rect &region, int size); // cv::blur(...) of region, large regions are filtered by parallel tiles, input and output could be the same
+    // 8-bit mask of region downscaled by scale, cell is nonzero if the mean color of its scale x scale pixels passes the skin test of params,
+    // BGR images and SkinRule or SkinModel kernels only, use it with ROISpans::setIntersection(...) and Plain kernel instead of blur(...)
+    void skinMask(const cv::Mat &image, const cv::Rect &region, int scale, const Params &params, cv::Mat &mask);
+    void setMaxStripes(int value);  // 1 disables parallel processing
+    int getMaxStripes() const;
+    int getLastStripes() const;     // stripes count of the last run(...)
+
+private:
+    struct Stripe
+    {
+        ROISums sums;
+        unsigned int hist[ROI_HIST_BANKS * 256]; // banked, see ROIKernels::mergeHistBanks(...)
+    };
+
+    typedef void (*RowsFunction)(cv::Mat &image, const ROISpans &spans, const Params &params, int top, int bottom, ROISums &sums, unsigned int *hist);
+    typedef void (*RegionRowsFunction)(cv::Mat &image, const ROISpans *const *regions, int count, const Params &params, int top, int bottom, ROISums *sums);
+
+    struct RowsSelector
+    {
+        typedef RowsFunction Function;
+        template<class Pixel, class Mask> static Function select(const Params &params);
+    };
+
+    struct RegionRowsSelector
+    {
+        typedef RegionRowsFunction Function;
+        template<class Pixel, class Mask> static Function select(const Params &params);
+    };
+
+    class StripeBody : public cv::ParallelLoopBody
+    {
+    public:
+        StripeBody(cv::Mat &image, const ROISpans &spans, const Params &params, RowsFunction rows, Stripe *stripes, int stripesCount);
+        void operator()(const cv::Range &range) const;
+    private:
+        cv::Mat &r_image;
+        const ROISpans &r_spans;
+        const Params &r_params;
+        RowsFunction pt_rows;
+        Stripe *v_stripes;
+        int m_stripesCount;
+    };
+
+    class RegionStripeBody : public cv::ParallelLoopBody
+    {
+    public:
+        RegionStripeBody(cv::Mat &image, const std::vector<const ROISpans *> &regions, const Params &params, RegionRowsFunction rows, int top, int bottom, ROISums *sums, int stripesCount);
+        void operator()(const cv::Range &range) const;
+    private:
+        cv::Mat &r_image;
+        const std::vector<const ROISpans *> &r_regions;
+        const Params &r_params;
+        RegionRowsFunction pt_rows;
+        int m_top;
+        int m_bottom;
+        ROISums *v_sums;            // regions.size() sums per stripe
+        int m_stripesCount;
+    };
+
+    class BlurBody : public cv::ParallelLoopBody
+    {
+    public:
+        BlurBody(const cv::Mat &input, cv::Mat &output, const cv::Rect &region, int size, int stripesCount);
+        void operator()(const cv::Range &range) const;
+    private:
+        const cv::Mat &r_input;
+        cv::Mat &r_output;          // region sized buffer
+        cv::Rect m_region;
+        int m_size;
+        int m_stripesCount;
+    };
+
+    std::vector<Stripe> v_stripes;  // kept between runs to avoid allocations
+    cv::Mat m_blurBuffer;           // tiles are filtered here, then copied to output, so tiles read the original pixels around them
+    cv::Mat m_smallBuffer;          // downscaled region of skinMask(...)
+    std::vector<ROISums> v_regionSums;
+    std::vector<ROISums> v_regionTotals;
+    int m_maxStripes;
+    int m_lastStripes;
+
+    void reduce(cv::Mat &image, const ROISpans &spans, const Params &params, ROISums &sums, unsigned int *hist);
+    int getStripesCount(unsigned long area, int rows, int pixelBytes) const;
+    template<class Selector> static typename Selector::Function dispatch(const Params &params); // picks pixel and mask policies
+    template<class Pixel, class Mask, bool Fill, bool Hist> static void processRows(cv::Mat &image, const ROISpans &spans, const Params &params, int top, int bottom, ROISums &sums, unsigned int *hist);
+    template<class Mask> static void classify(const cv::Mat &small, const Params &params, cv::Mat &mask);
+    template<class Pixel, class Mask, bool Fill> static void processRegionRows(cv::Mat &image, const ROISpans *const *regions, int count, const Params &params, int top, int bottom, ROISums *sums);
+};
+
+//------------------------------------------------------------------------------------------------------
+#endif // ROIREDUCTION_H
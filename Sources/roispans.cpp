@@ -0,0 +1,231 @@
+/*------------------------------------------------------------------------------------------------------
+Taranov Alex, 2015									     SOURCE FILE
+ROISpans stores region of interest as a table of horizontal pixel spans [begin, end) for each row,
+so processing loops iterate over spans without any per-pixel geometry test.
+Table could be built from rect, ellipse, polygon or 8-bit mask. Rect, ellipse and polygon tables
+are cached and rebuilt only when the shape or clipping bounds change. Table of other shape could be
+cut by a low resolution mask, that is how the skin mask of a smoothed small copy is applied to the region.
+------------------------------------------------------------------------------------------------------*/
+
+#include "roispans.h"
+
+#include <cmath>
+#include <algorithm>
+
+//------------------------------------------------------------------------------------------------------
+
+ROISpans::ROISpans():
+    m_top(0),
+    m_area(0),
+    m_shape(Empty)
+{
+    v_rowStart.push_back(0);
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void ROISpans::clear()
+{
+    beginTable(0);
+    m_shape = Empty;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void ROISpans::beginTable(int top)
+{
+    v_spans.clear(); // capacity is kept, so tables of the same size are rebuilt without allocations
+    v_rowStart.clear();
+    v_rowStart.push_back(0);
+    m_top = top;
+    m_area = 0;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void ROISpans::addSpan(int begin, int end)
+{
+    ROISpan span = {begin, end};
+    v_spans.push_back(span);
+    m_area += end - begin;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void ROISpans::endRow()
+{
+    v_rowStart.push_back((int)v_spans.size());
+}
+
+//------------------------------------------------------------------------------------------------------
+
+bool ROISpans::setRect(const cv::Rect &rect, const cv::Rect &bounds)
+{
+    if( (m_shape == Rect) && (rect == m_shapeRect) && (bounds == m_bounds) )
+        return false;
+    m_shape = Rect;
+    m_shapeRect = rect;
+    m_bounds = bounds;
+
+    const cv::Rect region = rect & bounds;
+    beginTable(region.y);
+    for(int y = region.y; y < region.y + region.height; y++)
+    {
+        addSpan(region.x, region.x + region.width);
+        endRow();
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+bool ROISpans::setEllipse(const cv::Rect &ellipse, const cv::Rect &bounds)
+{
+    if( (m_shape == Ellipse) && (ellipse == m_shapeRect) && (bounds == m_bounds) )
+        return false;
+    m_shape = Ellipse;
+    m_shapeRect = ellipse;
+    m_bounds = bounds;
+
+    const cv::Rect region = ellipse & bounds;
+    beginTable(region.y);
+    if(region.area() > 0)
+    {
+        const double a = ellipse.width / 2.0;
+        const double b = ellipse.height / 2.0;
+        const double xc = ellipse.x + a;
+        const double yc = ellipse.y + b;
+        const int left = region.x;
+        const int right = region.x + region.width;
+        for(int y = region.y; y < region.y + region.height; y++)
+        {
+            // analytical estimate of the span, then its ends are adjusted by the exact test, so the table matches isInEllipse(...) pixel to pixel
+            const double cy = (yc - y) / b;
+            const double t = 1.0 - cy * cy;
+            if(t > 0.0)
+            {
+                const double dx = a * std::sqrt(t);
+                int begin = std::max(left, std::min(right, (int)std::floor(xc - dx)));
+                int end = std::max(left, std::min(right, (int)std::ceil(xc + dx) + 1));
+                while( (begin > left) && isInEllipse(ellipse, begin - 1, y) )
+                    begin--;
+                while( (begin < end) && !isInEllipse(ellipse, begin, y) )
+                    begin++;
+                while( (end < right) && isInEllipse(ellipse, end, y) )
+                    end++;
+                while( (end > begin) && !isInEllipse(ellipse, end - 1, y) )
+                    end--;
+                if(begin < end)
+                    addSpan(begin, end);
+            }
+            endRow();
+        }
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+bool ROISpans::setPolygon(const std::vector<cv::Point> &polygon, const cv::Rect &bounds)
+{
+    if( (m_shape == Polygon) && (polygon == v_polygon) && (bounds == m_bounds) )
+        return false;
+    v_polygon = polygon;
+
+    if(polygon.size() < 3)
+    {
+        clear();
+        m_shape = Polygon;
+        m_bounds = bounds;
+        return true;
+    }
+    const cv::Rect box = cv::boundingRect(polygon);
+    m_polygonMask.create(box.height + 1, box.width + 1, CV_8UC1); // boundingRect(...) excludes the right and bottom vertices, fillPoly(...) includes them
+    m_polygonMask.setTo(0);
+    const cv::Point *points = polygon.data();
+    const int count = (int)polygon.size();
+    cv::fillPoly(m_polygonMask, &points, &count, 1, cv::Scalar(255), 8, 0, cv::Point(-box.x, -box.y));
+    setMask(m_polygonMask, box.tl(), bounds);
+    m_shape = Polygon;
+    return true;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+bool ROISpans::setMask(const cv::Mat &mask, const cv::Point &offset, const cv::Rect &bounds)
+{
+    m_shape = Mask;
+    m_bounds = bounds;
+
+    const cv::Rect region = cv::Rect(offset.x, offset.y, mask.cols, mask.rows) & bounds;
+    beginTable(region.y);
+    for(int y = region.y; y < region.y + region.height; y++)
+    {
+        const unsigned char *p = mask.ptr(y - offset.y) - offset.x; // indexed by image column
+        int x = region.x;
+        const int right = region.x + region.width;
+        while(x < right)
+        {
+            while( (x < right) && (p[x] == 0) )
+                x++;
+            const int begin = x;
+            while( (x < right) && (p[x] != 0) )
+                x++;
+            if(x > begin)
+                addSpan(begin, x);
+        }
+        endRow();
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void ROISpans::setIntersection(const ROISpans &region, const cv::Mat &mask, const cv::Point &offset, int scale)
+{
+    m_shape = Mask;
+
+    const int left = offset.x;
+    const int right = offset.x + mask.cols * scale;
+    beginTable(region.getTop());
+    for(int y = region.getTop(); y < region.getBottom(); y++)
+    {
+        const int r = (y - offset.y) / scale;
+        if( (y >= offset.y) && (r < mask.rows) )
+        {
+            const unsigned char *p = mask.ptr(r);
+            const ROISpan *span = region.getSpans(y);
+            for(int k = 0; k < region.getCount(y); k++)
+            {
+                const int end = std::min(span[k].end, right);
+                int x = std::max(span[k].begin, left);
+                while(x < end)
+                {
+                    while( (x < end) && (p[(x - left) / scale] == 0) )
+                        x = left + ((x - left) / scale + 1) * scale; // to the next cell
+                    const int begin = x;
+                    while( (x < end) && (p[(x - left) / scale] != 0) )
+                        x = left + ((x - left) / scale + 1) * scale;
+                    x = std::min(x, end);
+                    if(x > begin)
+                        addSpan(begin, x);
+                }
+            }
+        }
+        endRow();
+    }
+}
+
+//------------------------------------------------------------------------------------------------------
+
+unsigned long ROISpans::getArea() const
+{
+    return m_area;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+ROISpans::ShapeType ROISpans::getShapeType() const
+{
+    return m_shape;
+}
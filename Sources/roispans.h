@@ -0,0 +1,96 @@
+/*------------------------------------------------------------------------------------------------------
+Taranov Alex, 2015									     HEADER FILE
+ROISpans stores region of interest as a table of horizontal pixel spans [begin, end) for each row,
+so processing loops iterate over spans without any per-pixel geometry test.
+Table could be built from rect, ellipse, polygon or 8-bit mask. Rect, ellipse and polygon tables
+are cached and rebuilt only when the shape or clipping bounds change. Table of other shape could be
+cut by a low resolution mask, that is how the skin mask of a smoothed small copy is applied to the region.
+------------------------------------------------------------------------------------------------------*/
+
+#ifndef ROISPANS_H
+#define ROISPANS_H
+//------------------------------------------------------------------------------------------------------
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+//------------------------------------------------------------------------------------------------------
+
+struct ROISpan
+{
+    int begin;  // the first column of the span
+    int end;    // the column after the last one
+};
+
+//------------------------------------------------------------------------------------------------------
+
+class ROISpans
+{
+public:
+    enum ShapeType {Empty, Rect, Ellipse, Polygon, Mask};
+
+    ROISpans();
+
+    bool setRect(const cv::Rect &rect, const cv::Rect &bounds);          // all build functions clip the shape by bounds and return true if the table has been rebuilt
+    bool setEllipse(const cv::Rect &ellipse, const cv::Rect &bounds);    // ellipse inscribed into rect, pixel is inside if isInEllipse(...) is true for it
+    bool setPolygon(const std::vector<cv::Point> &polygon, const cv::Rect &bounds); // polygon is rasterized as cv::fillPoly(...) does
+    bool setMask(const cv::Mat &mask, const cv::Point &offset, const cv::Rect &bounds); // nonzero pixels of 8-bit mask are inside, mask's top-left corner is placed at offset
+    void setIntersection(const ROISpans &region, const cv::Mat &mask, const cv::Point &offset, int scale); // pixels of region that fall into nonzero cells of low resolution 8-bit mask, cell (c, r) covers scale x scale pixels from offset + scale * (c, r), region should not be this table
+    void clear();
+
+    int getTop() const;                 // the first row of the table
+    int getBottom() const;              // the row after the last one
+    int getCount(int y) const;          // the number of spans in row y
+    const ROISpan *getSpans(int y) const;
+    unsigned long getArea() const;      // total number of pixels inside
+    ShapeType getShapeType() const;
+
+    static bool isInEllipse(const cv::Rect &ellipse, int x, int y);
+
+private:
+    std::vector<ROISpan> v_spans;
+    std::vector<int> v_rowStart;        // spans of row (m_top + i) are v_spans[v_rowStart[i]] ... v_spans[v_rowStart[i+1] - 1]
+    int m_top;
+    unsigned long m_area;
+    ShapeType m_shape;
+    cv::Rect m_shapeRect;               // cache key for Rect and Ellipse shapes
+    std::vector<cv::Point> v_polygon;   // cache key for Polygon shape
+    cv::Rect m_bounds;                  // cache key for all shapes
+    cv::Mat m_polygonMask;
+
+    void beginTable(int top);
+    void addSpan(int begin, int end);
+    void endRow();
+};
+
+//------------------------------------------------------------------------------------------------------
+
+inline bool ROISpans::isInEllipse(const cv::Rect &ellipse, int x, int y)
+{
+    double cx = (ellipse.x + ellipse.width / 2.0 - x) / (ellipse.width / 2.0);
+    double cy = (ellipse.y + ellipse.height/ 2.0 - y) / (ellipse.height / 2.0);
+    return (cx*cx + cy*cy) < 1.0;
+}
+
+inline int ROISpans::getTop() const
+{
+    return m_top;
+}
+
+inline int ROISpans::getBottom() const
+{
+    return m_top + (int)v_rowStart.size() - 1;
+}
+
+inline int ROISpans::getCount(int y) const
+{
+    return v_rowStart[y - m_top + 1] - v_rowStart[y - m_top];
+}
+
+inline const ROISpan *ROISpans::getSpans(int y) const
+{
+    return v_spans.data() + v_rowStart[y - m_top];
+}
+
+//------------------------------------------------------------------------------------------------------
+#endif // ROISPANS_H
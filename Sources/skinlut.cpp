@@ -0,0 +1,151 @@
+/*------------------------------------------------------------------------------------------------------
+Taranov Alex, 2015									     SOURCE FILE
+SkinLUT is a skin color model compiled into 3D bit table indexed by quantized BGR color,
+so classification of a pixel is a single table lookup whatever complex the model is.
+File format: magic, version, bits, then (2^bits)^3 / 8 bytes of the table, all via QDataStream.
+------------------------------------------------------------------------------------------------------*/
+
+#include "skinlut.h"
+
+#include <QFile>
+#include <QDataStream>
+
+#define SKINLUT_FILE_MAGIC 0x534B4C54 // "SKLT"
+#define SKINLUT_FILE_VERSION 1
+#define SKINLUT_MIN_BITS 3
+#define SKINLUT_MAX_BITS 8
+
+//------------------------------------------------------------------------------------------------------
+
+SkinLUT::SkinLUT():
+    m_trained(0),
+    m_bits(0),
+    m_shift(8)
+{
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void SkinLUT::resize(int bits)
+{
+    if(bits < SKINLUT_MIN_BITS)
+        bits = SKINLUT_MIN_BITS;
+    else if(bits > SKINLUT_MAX_BITS)
+        bits = SKINLUT_MAX_BITS;
+    m_bits = bits;
+    m_shift = 8 - bits;
+    v_table.assign((size_t)1 << (3*bits - 3), 0);
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void SkinLUT::beginTraining(int bits)
+{
+    if(bits < SKINLUT_MIN_BITS)
+        bits = SKINLUT_MIN_BITS;
+    else if(bits > SKINLUT_MAX_BITS)
+        bits = SKINLUT_MAX_BITS;
+    if(bits != m_bits) // the old model is dropped because cell indexes are not compatible
+    {
+        v_table.clear();
+        m_bits = bits;
+        m_shift = 8 - bits;
+    }
+    v_counts.assign((size_t)1 << (3*m_bits), 0);
+    m_trained = 0;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+bool SkinLUT::isTraining() const
+{
+    return !v_counts.empty();
+}
+
+//------------------------------------------------------------------------------------------------------
+
+bool SkinLUT::endTraining(unsigned char greenMin, unsigned char greenMax)
+{
+    if(v_counts.empty() || (m_trained == 0))
+    {
+        std::vector<unsigned int>().swap(v_counts);
+        return false;
+    }
+    const unsigned int threshold = qMax(1UL, (unsigned long)(m_trained * SKINLUT_TRAIN_THRESHOLD));
+    const int bits = m_bits;
+    resize(bits);
+    const int gMask = (1 << m_bits) - 1;
+    for(size_t index = 0; index < v_counts.size(); index++)
+    {
+        const int g = (int)(index >> m_bits) & gMask;
+        const int cellMin = g << m_shift;
+        const int cellMax = cellMin + (1 << m_shift) - 1;
+        if( (v_counts[index] >= threshold) && (cellMax >= greenMin) && (cellMin <= greenMax) )
+            v_table[index >> 3] |= (1 << (index & 7));
+    }
+    std::vector<unsigned int>().swap(v_counts); // counts are not needed between trainings
+    m_trained = 0;
+    return true;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+bool SkinLUT::load(const QString &fileName)
+{
+    QFile file(fileName);
+    if(!file.open(QIODevice::ReadOnly))
+        return false;
+    QDataStream stream(&file);
+    quint32 magic, version, bits;
+    stream >> magic >> version >> bits;
+    if( (stream.status() != QDataStream::Ok) || (magic != SKINLUT_FILE_MAGIC) || (version != SKINLUT_FILE_VERSION) ||
+        (bits < SKINLUT_MIN_BITS) || (bits > SKINLUT_MAX_BITS) )
+        return false;
+    std::vector<unsigned char> table((size_t)1 << (3*bits - 3));
+    if(stream.readRawData((char*)table.data(), (int)table.size()) != (int)table.size())
+        return false;
+    v_table.swap(table);
+    std::vector<unsigned int>().swap(v_counts); // training of the other table size could not be continued
+    m_trained = 0;
+    m_bits = bits;
+    m_shift = 8 - bits;
+    return true;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+bool SkinLUT::save(const QString &fileName) const
+{
+    if(empty())
+        return false;
+    QFile file(fileName);
+    if(!file.open(QIODevice::WriteOnly))
+        return false;
+    QDataStream stream(&file);
+    stream << (quint32)SKINLUT_FILE_MAGIC << (quint32)SKINLUT_FILE_VERSION << (quint32)m_bits;
+    stream.writeRawData((const char*)v_table.data(), (int)v_table.size());
+    return stream.status() == QDataStream::Ok;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void SkinLUT::clear()
+{
+    v_table.clear();
+    std::vector<unsigned int>().swap(v_counts);
+    m_trained = 0;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+bool SkinLUT::empty() const
+{
+    return v_table.empty();
+}
+
+//------------------------------------------------------------------------------------------------------
+
+int SkinLUT::getBits() const
+{
+    return m_bits;
+}
@@ -0,0 +1,71 @@
+/*------------------------------------------------------------------------------------------------------
+Taranov Alex, 2015									     HEADER FILE
+SkinLUT is a skin color model compiled into 3D bit table indexed by quantized BGR color,
+so classification of a pixel is a single table lookup whatever complex the model is.
+Table has (2^bits)^3 cells, one bit per cell, bits = 5 gives 4 KB table and bits = 6 gives 32 KB.
+Model is trained on pixels of calibration region (those that pass isSkinPixel(...)),
+saved to and loaded from binary file, so skin models could be tuned per camera without rebuild.
+------------------------------------------------------------------------------------------------------*/
+
+#ifndef SKINLUT_H
+#define SKINLUT_H
+//------------------------------------------------------------------------------------------------------
+
+#include <vector>
+#include <QString>
+
+#define SKINLUT_DEFAULT_BITS 5
+#define SKINLUT_TRAIN_THRESHOLD 0.0005 // cell becomes skin if it has got at least this part of the trained pixels
+
+//------------------------------------------------------------------------------------------------------
+
+class SkinLUT
+{
+public:
+    SkinLUT();
+
+    void beginTraining(int bits = SKINLUT_DEFAULT_BITS);     // starts to count colors, model stays the same until endTraining(...)
+    void train(unsigned char valueBlue, unsigned char valueGreen, unsigned char valueRed);
+    bool endTraining(unsigned char greenMin = 0, unsigned char greenMax = 255); // cells that have got enough pixels and intersect [greenMin, greenMax] by green become skin, returns false if nothing was trained
+    bool isTraining() const;
+
+    bool load(const QString &fileName);
+    bool save(const QString &fileName) const;
+    void clear();
+
+    bool empty() const;
+    int getBits() const;
+    bool isSkin(unsigned char valueBlue, unsigned char valueGreen, unsigned char valueRed) const;
+
+private:
+    std::vector<unsigned char> v_table; // bit i of byte (index >> 3) is the cell index, index = (b << 2*bits) | (g << bits) | r in quantized colors
+    std::vector<unsigned int> v_counts; // color counts of training
+    unsigned long m_trained;
+    int m_bits;
+    int m_shift;                        // 8 - m_bits
+
+    void resize(int bits);
+    int cellIndex(unsigned char valueBlue, unsigned char valueGreen, unsigned char valueRed) const;
+};
+
+//------------------------------------------------------------------------------------------------------
+
+inline int SkinLUT::cellIndex(unsigned char valueBlue, unsigned char valueGreen, unsigned char valueRed) const
+{
+    return ((valueBlue >> m_shift) << (2*m_bits)) | ((valueGreen >> m_shift) << m_bits) | (valueRed >> m_shift);
+}
+
+inline bool SkinLUT::isSkin(unsigned char valueBlue, unsigned char valueGreen, unsigned char valueRed) const
+{
+    const int index = cellIndex(valueBlue, valueGreen, valueRed);
+    return (v_table[index >> 3] >> (index & 7)) & 1;
+}
+
+inline void SkinLUT::train(unsigned char valueBlue, unsigned char valueGreen, unsigned char valueRed)
+{
+    v_counts[cellIndex(valueBlue, valueGreen, valueRed)]++;
+    m_trained++;
+}
+
+//------------------------------------------------------------------------------------------------------
+#endif // SKINLUT_H
@@ -0,0 +1,139 @@
+/*------------------------------------------------------------------------------------------------------
+Taranov Alex, 2015									     SOURCE FILE
+SlidingDFT keeps a band of bins of N-point DFT over the last N counts of a signal, bins are updated
+per count in O(band width) by the sliding DFT recurrence X'(k) = (X(k) - out + in) * exp(2*pi*i*k/N),
+so power spectrum of the band could be read at any moment without FFT. Bins have the same phase and
+scale as FFTW r2c output of the window in time order. Total one-sided power of the window, which is
+used for normalization, is kept by Parseval's theorem from running sum, sum of squares and N/2 bin.
+The recurrence accumulates rounding errors, so bins are computed directly from the window (anchored)
+when the band changes and every N counts, it costs O(N * band width) once per N counts.
+------------------------------------------------------------------------------------------------------*/
+
+#include "slidingdft.h"
+
+#include <cmath>
+
+//------------------------------------------------------------------------------------------------------
+
+SlidingDFT::SlidingDFT():
+    m_length(0),
+    m_first(0),
+    m_last(0),
+    m_updates(0),
+    m_sum(0.0),
+    m_sumSq(0.0),
+    m_alternating(0.0)
+{
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void SlidingDFT::setLength(quint32 length)
+{
+    m_length = length;
+    v_cos.resize(length);
+    v_sin.resize(length);
+    const double pi = 3.14159265358979323846; // M_PI is not standard
+    for(quint32 m = 0; m < length; m++)
+    {
+        v_cos[m] = std::cos(2.0 * pi * m / length);
+        v_sin[m] = std::sin(2.0 * pi * m / length);
+    }
+    clear();
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void SlidingDFT::clear()
+{
+    v_re.clear();
+    v_im.clear();
+    m_first = 0;
+    m_last = 0;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+bool SlidingDFT::contains(quint32 first, quint32 last) const
+{
+    return !isEmpty() && (first >= m_first) && (qMin(last, m_length / 2) <= m_last);
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void SlidingDFT::anchor(const qreal *window, quint32 first, quint32 last)
+{
+    last = qMin(last, m_length / 2);
+    if( (m_length == 0) || (first > last) )
+    {
+        clear();
+        return;
+    }
+    m_first = first;
+    m_last = last;
+    v_re.resize(last - first + 1);
+    v_im.resize(last - first + 1);
+    anchor(window);
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void SlidingDFT::anchor(const qreal *window)
+{
+    m_sum = 0.0;
+    m_sumSq = 0.0;
+    m_alternating = 0.0;
+    for(quint32 n = 0; n < m_length; n++)
+    {
+        m_sum += window[n];
+        m_sumSq += window[n] * window[n];
+        m_alternating += (n & 1) ? -window[n] : window[n];
+    }
+    for(quint32 k = m_first; k <= m_last; k++)
+    {
+        qreal re = 0.0;
+        qreal im = 0.0;
+        quint32 m = 0; // k*n mod N, by additions, so the table index never overflows
+        for(quint32 n = 0; n < m_length; n++)
+        {
+            re += window[n] * v_cos[m];
+            im -= window[n] * v_sin[m];
+            m += k;
+            if(m >= m_length)
+                m -= m_length;
+        }
+        v_re[k - m_first] = re;
+        v_im[k - m_first] = im;
+    }
+    m_updates = 0;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void SlidingDFT::update(qreal in, qreal out)
+{
+    if(isEmpty())
+        return;
+    const qreal delta = in - out;
+    m_sum += delta;
+    m_sumSq += in * in - out * out;
+    m_alternating = -(m_alternating + delta); // exp(i*pi) = -1
+    for(quint32 k = m_first; k <= m_last; k++)
+    {
+        const qreal a = v_re[k - m_first] + delta;
+        const qreal b = v_im[k - m_first];
+        v_re[k - m_first] = a * v_cos[k] - b * v_sin[k];
+        v_im[k - m_first] = a * v_sin[k] + b * v_cos[k];
+    }
+    m_updates++;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+qreal SlidingDFT::getTotalPower() const
+{
+    qreal edges = m_sum * m_sum; // bins 0 and N/2 are not doubled in the full spectrum
+    if((m_length & 1) == 0)
+        edges += m_alternating * m_alternating;
+    return (m_length * m_sumSq + edges) / 2.0;
+}
@@ -0,0 +1,83 @@
+/*------------------------------------------------------------------------------------------------------
+Taranov Alex, 2015									     HEADER FILE
+SlidingDFT keeps a band of bins of N-point DFT over the last N counts of a signal, bins are updated
+per count in O(band width) by the sliding DFT recurrence X'(k) = (X(k) - out + in) * exp(2*pi*i*k/N),
+so power spectrum of the band could be read at any moment without FFT. Bins have the same phase and
+scale as FFTW r2c output of the window in time order. Total one-sided power of the window, which is
+used for normalization, is kept by Parseval's theorem from running sum, sum of squares and N/2 bin.
+The recurrence accumulates rounding errors, so bins are computed directly from the window (anchored)
+when the band changes and every N counts, it costs O(N * band width) once per N counts.
+------------------------------------------------------------------------------------------------------*/
+
+#ifndef SLIDINGDFT_H
+#define SLIDINGDFT_H
+//------------------------------------------------------------------------------------------------------
+
+#include <vector>
+#include <QtGlobal>
+
+//------------------------------------------------------------------------------------------------------
+
+class SlidingDFT
+{
+public:
+    SlidingDFT();
+
+    void setLength(quint32 length);     // N, builds twiddle tables and drops the band
+    void clear();                       // drops the band, update(...) does nothing until the next anchor(...)
+    bool isEmpty() const;
+    bool contains(quint32 first, quint32 last) const; // true if bins [first, last] are kept
+
+    void anchor(const qreal *window, quint32 first, quint32 last); // computes bins [first, last] (clipped by N/2) of the last N counts directly, window is in time order
+    void anchor(const qreal *window);   // the same band
+    void update(qreal in, qreal out);   // in enters the window, out (N counts before in) leaves it
+    bool isAnchorDue() const;           // N updates have been made since the last anchor
+
+    quint32 getFirst() const;
+    quint32 getLast() const;
+    qreal getPower(quint32 bin) const;  // squared magnitude, first <= bin <= last
+    qreal getTotalPower() const;        // sum of squared magnitudes over bins 0...N/2
+
+private:
+    std::vector<qreal> v_cos;           // cos(2*pi*m/N), m = 0...N-1
+    std::vector<qreal> v_sin;
+    std::vector<qreal> v_re;            // bins of the band
+    std::vector<qreal> v_im;
+    quint32 m_length;
+    quint32 m_first;
+    quint32 m_last;
+    quint32 m_updates;                  // since the last anchor
+    qreal m_sum;                        // bin 0
+    qreal m_sumSq;
+    qreal m_alternating;                // bin N/2, real, even N only
+};
+
+//------------------------------------------------------------------------------------------------------
+
+inline bool SlidingDFT::isEmpty() const
+{
+    return v_re.empty();
+}
+
+inline bool SlidingDFT::isAnchorDue() const
+{
+    return m_updates >= m_length;
+}
+
+inline quint32 SlidingDFT::getFirst() const
+{
+    return m_first;
+}
+
+inline quint32 SlidingDFT::getLast() const
+{
+    return m_last;
+}
+
+inline qreal SlidingDFT::getPower(quint32 bin) const
+{
+    return v_re[bin - m_first]*v_re[bin - m_first] + v_im[bin - m_first]*v_im[bin - m_first];
+}
+
+//------------------------------------------------------------------------------------------------------
+#endif // SLIDINGDFT_H
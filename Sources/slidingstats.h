@@ -0,0 +1,92 @@
+/*------------------------------------------------------------------------------------------------------
+Taranov Alex, 2015									     HEADER FILE
+SlidingStats keeps mean and variance of the last N counts of a ring buffer, which is owned by the caller.
+Each new count costs O(1) whatever N is: caller passes the count that enters the window and the count
+that leaves it, mean and sum of squared deviations are updated by the sliding variant of Welford's
+algorithm, so no large sums of squares are subtracted from each other. Rounding errors still slowly
+accumulate, so caller should rebuild the statistics from the buffer from time to time by clear() and push().
+------------------------------------------------------------------------------------------------------*/
+
+#ifndef SLIDINGSTATS_H
+#define SLIDINGSTATS_H
+//------------------------------------------------------------------------------------------------------
+
+#include <cmath>
+#include <QtGlobal>
+
+//------------------------------------------------------------------------------------------------------
+
+class SlidingStats
+{
+public:
+    SlidingStats();
+
+    void clear();                           // window becomes empty
+    void push(qreal value);                 // window grows by value, use it to fill the window after clear()
+    void slide(qreal in, qreal out);        // in enters full window, out leaves it, the window length stays the same
+    void replace(qreal from, qreal to);     // a count of the window has been changed from one value to another
+
+    qreal getMean() const;
+    qreal getSD() const;                    // sample standard deviation, (N - 1) in denominator as the direct computation had
+    quint16 getLength() const;
+
+private:
+    qreal m_mean;
+    qreal m_m2;                             // sum of squared deviations from m_mean
+    quint16 m_length;
+};
+
+//------------------------------------------------------------------------------------------------------
+
+inline SlidingStats::SlidingStats()
+{
+    clear();
+}
+
+inline void SlidingStats::clear()
+{
+    m_mean = 0.0;
+    m_m2 = 0.0;
+    m_length = 0;
+}
+
+inline void SlidingStats::push(qreal value)
+{
+    m_length++;
+    const qreal delta = value - m_mean;
+    m_mean += delta / m_length;
+    m_m2 += delta * (value - m_mean);
+}
+
+inline void SlidingStats::slide(qreal in, qreal out)
+{
+    const qreal delta = in - out;
+    const qreal previous = m_mean;
+    m_mean += delta / m_length;
+    m_m2 += delta * (in - m_mean + out - previous);
+    if(m_m2 < 0.0) // could happen by rounding when all counts of the window are equal
+        m_m2 = 0.0;
+}
+
+inline void SlidingStats::replace(qreal from, qreal to)
+{
+    slide(to, from);
+}
+
+inline qreal SlidingStats::getMean() const
+{
+    return m_mean;
+}
+
+inline qreal SlidingStats::getSD() const
+{
+    return std::sqrt(m_m2 / (m_length - 1));
+}
+
+inline quint16 SlidingStats::getLength() const
+{
+    return m_length;
+}
+
+//------------------------------------------------------------------------------------------------------
+#endif // SLIDINGSTATS_H
@@ -0,0 +1,115 @@
+/*------------------------------------------------------------------------------------------------------
+Taranov Alex, 2015									     SOURCE FILE
+Helpers for raw camera frames, which are taken without conversion to BGR (CV_CAP_PROP_CONVERT_RGB off).
+------------------------------------------------------------------------------------------------------*/
+
+#include "yuvinput.h"
+
+#include <cmath>
+#include <QtGlobal>
+
+//------------------------------------------------------------------------------------------------------
+
+YUVInput::PixelFormat YUVInput::fromFourcc(int fourcc)
+{
+    if( (fourcc == CV_FOURCC('Y','U','Y','V')) || (fourcc == CV_FOURCC('Y','U','Y','2')) )
+        return YUYV;
+    if(fourcc == CV_FOURCC('N','V','1','2'))
+        return NV12;
+    return BGR;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+int YUVInput::getRawBytes(PixelFormat format, int width, int height)
+{
+    switch(format)
+    {
+        case YUYV:
+            return 2 * width * height;
+        case NV12:
+            return width * height * 3 / 2;
+        default:
+            return 3 * width * height;
+    }
+}
+
+//------------------------------------------------------------------------------------------------------
+
+bool YUVInput::wrapRawFrame(cv::Mat &frame, PixelFormat format, int width, int height)
+{
+    switch(format)
+    {
+        case YUYV:
+            if( (frame.type() == CV_8UC2) && (frame.cols == width) && (frame.rows == height) )
+                return true;
+            break;
+        case NV12:
+            if( (frame.type() == CV_8UC1) && (frame.cols == width) && (frame.rows == height * 3 / 2) )
+                return true;
+            break;
+        default:
+            return true;
+    }
+    if( !frame.isContinuous() || (frame.depth() != CV_8U) || ((int)(frame.total() * frame.elemSize()) != getRawBytes(format, width, height)) )
+        return false;
+    if(format == YUYV)
+        frame = frame.reshape(2, height);
+    else
+        frame = frame.reshape(1, height * 3 / 2);
+    return true;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void YUVInput::unwrapRawFrame(cv::Mat &frame)
+{
+    if(!frame.empty() && frame.isContinuous() && (frame.rows > 1))
+        frame = frame.reshape(1, 1);
+}
+
+//------------------------------------------------------------------------------------------------------
+
+cv::Mat YUVInput::getImageView(const cv::Mat &frame, PixelFormat format)
+{
+    if(format == NV12)
+        return frame.rowRange(0, frame.rows * 2 / 3);
+    return frame;
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void YUVInput::toBGR(const cv::Mat &frame, PixelFormat format, cv::Mat &output)
+{
+    switch(format)
+    {
+        case YUYV:
+            cv::cvtColor(frame, output, cv::COLOR_YUV2BGR_YUY2);
+            break;
+        case NV12:
+            cv::cvtColor(frame, output, cv::COLOR_YUV2BGR_NV12);
+            break;
+        default:
+            frame.copyTo(output);
+            break;
+    }
+}
+
+//------------------------------------------------------------------------------------------------------
+
+void YUVInput::toRGBSums(ROISums &sums)
+{
+    if(sums.area == 0)
+        return;
+    const double n = (double)sums.area;
+    const double y = 1.164 * ((double)sums.green - 16.0 * n);
+    const double cb = (double)sums.blue - 128.0 * n;
+    const double cr = (double)sums.red - 128.0 * n;
+    const double limit = 255.0 * n;
+    const double r = y + 1.596 * cr;
+    const double g = y - 0.391 * cb - 0.813 * cr;
+    const double b = y + 2.018 * cb;
+    sums.red = (quint64)std::floor(qBound(0.0, r, limit) + 0.5);
+    sums.green = (quint64)std::floor(qBound(0.0, g, limit) + 0.5);
+    sums.blue = (quint64)std::floor(qBound(0.0, b, limit) + 0.5);
+}
@@ -0,0 +1,80 @@
+/*------------------------------------------------------------------------------------------------------
+Taranov Alex, 2015									     HEADER FILE
+Helpers for raw camera frames, which are taken without conversion to BGR (CV_CAP_PROP_CONVERT_RGB off).
+YUYV frame is stored as CV_8UC2 matrix of image size (Y0 U, Y1 V, ...), NV12 frame is stored as
+CV_8UC1 matrix with image height * 3/2 rows (Y plane, then interleaved UV plane of half height).
+Skin test is made in YCbCr, color sums are accumulated as Y, Cb, Cr and converted to R, G, B sums once,
+conversion is linear, so only the pixels clipped by conversion make the difference with BGR sums.
+------------------------------------------------------------------------------------------------------*/
+
+#ifndef YUVINPUT_H
+#define YUVINPUT_H
+//------------------------------------------------------------------------------------------------------
+
+#include <opencv2/opencv.hpp>
+
+#include "roikernels.h"
+
+//------------------------------------------------------------------------------------------------------
+
+namespace YUVInput
+{
+    enum PixelFormat {BGR, YUYV, NV12}; // BGR also stands for 8-bit gray frames and for all converted frames
+
+    PixelFormat fromFourcc(int fourcc);                 // returns BGR for formats that are not supported as raw input
+    int getRawBytes(PixelFormat format, int width, int height);
+    bool wrapRawFrame(cv::Mat &frame, PixelFormat format, int width, int height); // reshapes raw buffer returned by capture into the layout described above without copy, returns false if buffer size does not match
+    void unwrapRawFrame(cv::Mat &frame);                // reshapes frame back to one row, so the next retrieve into it does not reallocate
+
+    cv::Mat getImageView(const cv::Mat &frame, PixelFormat format); // Y plane for NV12, frame itself otherwise, the result has image size
+    void toBGR(const cv::Mat &frame, PixelFormat format, cv::Mat &output);
+    void toRGBSums(ROISums &sums);                      // converts sums of Cr, Y, Cb (red, green, blue fields) to R, G, B sums
+}
+
+//------------------------------------------------------------------------------------------------------
+
+inline bool isSkinChroma(unsigned char valueCb, unsigned char valueCr)
+{
+    return (valueCb >= 77) && (valueCb <= 127) && (valueCr >= 133) && (valueCr <= 173);
+}
+
+inline unsigned char greenFromYCbCr(int valueY, int valueCb, int valueCr) // BT.601, as OpenCV converts YUV to BGR
+{
+    const int g = (298 * (valueY - 16) - 100 * (valueCb - 128) - 208 * (valueCr - 128) + 128) >> 8;
+    return (unsigned char)(g < 0 ? 0 : (g > 255 ? 255 : g));
+}
+
+//------------------------------------------------------------------------------------------------------
+// Pixel policies of ROIKernels::Row, ROISums hold Cr, Y, Cb in red, green, blue, pass them to toRGBSums(...) after accumulation
+
+struct YUYVPixel
+{
+    enum { Planar = 0 };
+    static void load(const unsigned char *row, const unsigned char *, int x, unsigned char &b, unsigned char &g, unsigned char &r)
+    {
+        const unsigned char *pair = row + 4 * (x >> 1); // Y0 U Y1 V
+        b = pair[1];
+        g = row[2*x];
+        r = pair[3];
+    }
+    static bool isSkin(unsigned char b, unsigned char, unsigned char r) { return isSkinChroma(b, r); }
+    static void mark(unsigned char *row, int x) { row[2*x] %= ROI_LEVEL_SHIFT; }
+    static unsigned char histValue(const unsigned char *, int, unsigned char b, unsigned char g, unsigned char r) { return greenFromYCbCr(g, b, r); }
+};
+
+struct NV12Pixel // aux is the UV row of the luma row
+{
+    enum { Planar = 1 };
+    static void load(const unsigned char *row, const unsigned char *aux, int x, unsigned char &b, unsigned char &g, unsigned char &r)
+    {
+        b = aux[x & ~1];
+        g = row[x];
+        r = aux[x | 1];
+    }
+    static bool isSkin(unsigned char b, unsigned char, unsigned char r) { return isSkinChroma(b, r); }
+    static void mark(unsigned char *row, int x) { row[x] %= ROI_LEVEL_SHIFT; }
+    static unsigned char histValue(const unsigned char *, int, unsigned char b, unsigned char g, unsigned char r) { return greenFromYCbCr(g, b, r); }
+};
+
+//------------------------------------------------------------------------------------------------------
+#endif // YUVINPUT_H